@@ -6,12 +6,19 @@
 
 #if defined(WIN32) || defined(__WIN32__) || defined(_WIN32)
 #pragma warning (disable : 4100)  /* Disable Unreferenced parameter warning */
+#define _CRT_RAND_S  /* rand_s() for the fair mode seed */
 #include <Windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
 #endif
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <math.h>
 #include <assert.h>
 #include "teamspeak/public_errors.h"
 #include "teamspeak/public_errors_rare.h"
@@ -23,16 +30,675 @@
 #include <stdlib.h>     /* srand, rand */
 #include <time.h>       /* time */
 
-typedef int bool;
-#define true 1
-#define false 0
+#define COLOR_BUFSIZE 32
+#define CLIENT_ID_COUNT 65536  /* anyID ist 16 Bit breit */
+
+/* Grenzen fuer Wuerfelbefehle, groessere Werte werden als Syntaxfehler behandelt */
+#define COMMAND_MAXLEN 256
+#define MAX_DICE 100
+#define MAX_SIDES 1000000
+#define MAX_MODIFIER 1000000
+#define EXPLOSION_CAP_DEFAULT 100       /* hoechstens so viele Explosionen pro Wuerfel */
+#define MAX_EXPLODING_TOTAL 1000000000  /* Obergrenze fuer count * sides * (Explosionen + 1), passt in int */
+#define MAX_BATCH_ROLLS 10              /* Wuerfe pro Nachricht, "!1w20+5; 2w6+3; 1w10" */
+#define MAX_REPEAT 100                  /* "!20x w20": hoechstens so viele Wiederholungen */
+#define MAX_REPEAT_DICE 1000            /* Wuerfel aller Wiederholungen zusammen */
 
-char subString[19999];
-int randomNumberCounter;
-char userColorColor[19999][19999];
-char tmpUserColor[19999];
+#define OUTPUT_BUFSIZE 19999
+#define ARENA_SIZE (64 * 1024)  /* Arbeitsspeicher pro Thread fuer eine Nachricht */
+
+char userColorColor[CLIENT_ID_COUNT][COLOR_BUFSIZE];
 bool chatBotActive = false;
 
+/* Fairer Modus: Commit-Reveal, jeder Wurf wird aus ChaCha20(seed, Nachricht * 2^32 + Wurf) abgeleitet */
+#define FAIR_SEED_SIZE 32
+#define SHA256_DIGEST_SIZE 32
+bool fairModeActive = false;
+unsigned char fairSeed[FAIR_SEED_SIZE];
+uint64 fairMessageCounter = 0;
+
+/*
+ * Kompakter Modus (!kompakt an/aus): Wuerfe im Channel gehen als Pluginbefehl (Varints, Base64) an die anderen
+ * AllDice-Clients, die sie selbst darstellen. Im Chat steht nur noch eine kurze Zusammenfassung.
+ */
+#define COMPACT_PREFIX "AD1 "
+#define COMPACT_VERSION 1
+bool compactModeActive = false;
+
+/*
+ * Leiterwahl: Haben mehrere Clients im selben Channel AllDice mit !an laufen, beantwortet nur der mit der
+ * kleinsten Client-ID die Befehle. Nur dieser Leiter sendet regelmaessig einen Herzschlag als Pluginbefehl,
+ * bleibt er ELECTION_TIMEOUT_MS aus, melden sich die anderen und der kleinste uebernimmt.
+ */
+#define ELECTION_HEARTBEAT_PREFIX "ADH "  /* "ADH <channelID>" */
+#define ELECTION_BYE_PREFIX "ADB "        /* "ADB <channelID>", der Leiter geht */
+#define ELECTION_CONNECTIONS 16
+#define ELECTION_HEARTBEAT_MS 5000
+#define ELECTION_TIMEOUT_MS 12000
+#define ELECTION_ANSWER_MS 1000           /* ausserplanmaessige Herzschlaege hoechstens so oft */
+#define ELECTION_TICK_MS 250
+
+/*
+ * Hotkeys: Zeilen "name = befehl" aus HOTKEY_FILE im Konfigurationsordner werden beim Laden einmal zerlegt und
+ * als TS3-Hotkeys angemeldet. Ein Tastendruck wuerfelt den fertigen Ausdruck, ohne ihn erneut zu zerlegen.
+ */
+#define HOTKEY_FILE "alldice_hotkeys.txt"
+#define HOTKEY_WARNING ":%d: Hotkey uebersprungen (Name = Befehl, hoechstens %d Hotkeys)"  /* hinter dem Dateipfad */
+#define HOTKEY_TOO_LONG ":%d: Zeile zu lang, hoechstens %d Zeichen"  /* nicht laenger als HOTKEY_WARNING */
+#define HOTKEY_PREFIX "alldice_"   /* Schluesselwort beim Client, dahinter der Name aus der Datei */
+#define MAX_HOTKEYS 32
+#define HOTKEY_TABLE_SIZE 64       /* Zweierpotenz, hoechstens halb voll */
+#define HOTKEY_NAME_MAXLEN 32
+
+/* Kontextmenue: Wurf fuer einen Client und Initiative fuer alle Clients eines Channels, beim Anmelden zerlegt */
+#define MENU_ROLL_COMMAND "1w20"
+#define MENU_INITIATIVE_COMMAND "1w20"
+#define MAX_INITIATIVE MAX_REPEAT
+
+/* Konsolenbefehl "/alldice ...": wertet nur lokal aus, nichts geht an den Server */
+#define CONSOLE_KEYWORD "alldice"
+#define BENCH_DEFAULT_RUNS 1000
+#define BENCH_MAX_RUNS 100000
+
+enum {
+	MENU_ID_CLIENT_ROLL = 1,
+	MENU_ID_CHANNEL_INITIATIVE,
+	MENU_ID_GLOBAL_TOGGLE,
+	MENU_ID_GLOBAL_METRICS
+};
+
+#ifdef _WIN32
+#define THREAD_LOCAL __declspec(thread)
+#define atomicIncrement64(p) ((uint64)InterlockedIncrement64((volatile LONG64*)(p)))
+#define atomicAdd64(p, value) InterlockedExchangeAdd64((volatile LONG64*)(p), (LONG64)(value))
+#define atomicCompareExchange64(p, expected, desired) (InterlockedCompareExchange64((volatile LONG64*)(p), (LONG64)(desired), (LONG64)(expected)) == (LONG64)(expected))
+#define atomicCompareExchangePointer(p, expected, desired) (InterlockedCompareExchangePointer((PVOID volatile*)(p), (desired), (expected)) == (expected))
+#define atomicLoad64(p) ((uint64)*(volatile LONG64*)(p))  /* ausgerichtet unter x64 atomar, volatile liest mit acquire */
+#define atomicStore64(p, value) InterlockedExchange64((volatile LONG64*)(p), (LONG64)(value))
+#define atomicStoreFence() MemoryBarrier()  /* fruehere Zugriffe vor allen folgenden Schreibzugriffen */
+#define atomicLoadFence() MemoryBarrier()   /* fruehere Lesezugriffe vor allen folgenden Zugriffen */
+#else
+#define THREAD_LOCAL __thread
+#define atomicIncrement64(p) __sync_add_and_fetch((p), 1)
+#define atomicAdd64(p, value) __sync_add_and_fetch((p), (value))
+#define atomicCompareExchange64(p, expected, desired) __sync_bool_compare_and_swap((p), (expected), (desired))
+#define atomicCompareExchangePointer(p, expected, desired) __sync_bool_compare_and_swap((p), (expected), (desired))
+#define atomicLoad64(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define atomicStore64(p, value) __atomic_store_n((p), (value), __ATOMIC_RELEASE)
+#define atomicStoreFence() __atomic_thread_fence(__ATOMIC_RELEASE)
+#define atomicLoadFence() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#endif
+
+/* Threads, Mutex und Bedingungsvariablen */
+#ifdef _WIN32
+typedef HANDLE Thread;
+typedef CRITICAL_SECTION Mutex;
+typedef CONDITION_VARIABLE Condition;
+#define THREAD_FUNCTION(name) DWORD WINAPI name(LPVOID arg)
+#define THREAD_RETURN 0
+#define threadStart(thread, function, arg) ((*(thread) = CreateThread(NULL, 0, (function), (arg), 0, NULL)) != NULL)
+#define threadJoin(thread) { WaitForSingleObject((thread), INFINITE); CloseHandle(thread); }
+#define mutexInit(m) InitializeCriticalSection(m)
+#define mutexDestroy(m) DeleteCriticalSection(m)
+#define mutexLock(m) EnterCriticalSection(m)
+#define mutexUnlock(m) LeaveCriticalSection(m)
+#define conditionInit(c) InitializeConditionVariable(c)
+#define conditionDestroy(c)
+#define conditionWait(c, m) SleepConditionVariableCS((c), (m), INFINITE)
+#define conditionBroadcast(c) WakeAllConditionVariable(c)
+#define sleepMillis(ms) Sleep(ms)
+#else
+typedef pthread_t Thread;
+typedef pthread_mutex_t Mutex;
+typedef pthread_cond_t Condition;
+#define THREAD_FUNCTION(name) void* name(void* arg)
+#define THREAD_RETURN NULL
+#define threadStart(thread, function, arg) (pthread_create((thread), NULL, (function), (arg)) == 0)
+#define threadJoin(thread) pthread_join((thread), NULL)
+#define mutexInit(m) pthread_mutex_init((m), NULL)
+#define mutexDestroy(m) pthread_mutex_destroy(m)
+#define mutexLock(m) pthread_mutex_lock(m)
+#define mutexUnlock(m) pthread_mutex_unlock(m)
+#define conditionInit(c) pthread_cond_init((c), NULL)
+#define conditionDestroy(c) pthread_cond_destroy(c)
+#define conditionWait(c, m) pthread_cond_wait((c), (m))
+#define conditionBroadcast(c) pthread_cond_broadcast(c)
+#define sleepMillis(ms) usleep((ms) * 1000)
+#endif
+
+/* Zustand des Zufallsgenerators, jeder Thread bzw. Shard besitzt einen eigenen */
+struct RandomState {
+	uint64 state[4];
+	bool seeded;
+	bool fair;            /* Wuerfe der aktuellen Nachricht kommen aus dem fairen Modus */
+	uint64 fairMessage;   /* Nachrichtennummer im fairen Modus, 0 = noch nicht vergeben */
+	uint32_t fairRoll;    /* Wurf innerhalb der Nachricht */
+};
+
+/* Begrenzter Ausgabepuffer, zu lange Ausgaben werden abgeschnitten */
+struct OutputBuilder {
+	char* data;
+	size_t length;
+	size_t capacity;
+};
+
+enum ExplodeMode {
+	EXPLODE_NONE = 0,
+	EXPLODE_COMPOUND,      /* e: jede Explosion addiert einen weiteren Wurf zum Wuerfel */
+	EXPLODE_PENETRATING    /* ep: wie e, aber jeder Zusatzwurf zaehlt einen Punkt weniger */
+};
+
+/* Geparster Wuerfelbefehl */
+struct DiceExpression {
+	const struct GameSystem* system;
+	int count;
+	int sides;
+	int modifier;
+	enum ExplodeMode explode;
+	int explosionCap;      /* hoechstens so viele Explosionen pro Wuerfel */
+	int keep;              /* kh/kl: so viele Wuerfel werden gewertet, 0 = alle */
+	bool keepLowest;
+	const char* text;      /* Befehl ohne '!' bis zum ersten Leerzeichen, fuer die Ausgabe */
+	int textLength;
+	int diceTextLength;    /* Laenge von text ohne Modifikator */
+	int targets[3];        /* DSA: Eigenschaftswerte */
+	int skill;             /* DSA: Fertigkeitswert */
+};
+
+/* Markierungen je Wuerfel in RollResult.flags */
+#define DIE_EXPLODED 0x01
+#define DIE_DROPPED 0x02       /* zaehlt nicht zur Summe (kh/kl, Wildcardwuerfel) */
+#define DIE_WILD 0x04          /* Savage Worlds: Wildcardwuerfel */
+
+/*
+ * Ergebnis eines Wurfes als Structure of Arrays. Alle Systeme fuellen dieselben Felder, Ausgabe, Simulation und
+ * Messwerte lesen nur noch diese Darstellung. Die Arrays liegen am Stueck in der Arena (rollResultAlloc).
+ */
+struct RollResult {
+	int count;             /* Eintraege in faces, explosions und flags */
+	int* faces;            /* Augenzahl je Wuerfel, bei explodierenden Wuerfeln die Summe aller Wuerfe */
+	int* explosions;       /* Explosionen je Wuerfel */
+	unsigned char* flags;  /* DIE_* */
+	int sum;               /* Summe der gewerteten Wuerfel ohne Modifikator */
+	int modifier;
+	int total;             /* sum + modifier */
+	int wildTotal;         /* Savage Worlds: Wildcardwuerfel + modifier */
+	int criticalFailure;   /* 0 = kein kritischer Fehlschlag/Patzer, sonst Art der Meldung */
+	int criticalSuccess;   /* DSA: kritischer Erfolg */
+};
+
+/* Alle Wuerfe einer Nachricht: eine Serie "!1w20; 2w6" oder eine Wiederholung "!6x 4w6kh3" */
+struct RollBatch {
+	struct DiceExpression* exprs;  /* bei einer Wiederholung nur exprs[0] fuer alle Wuerfe */
+	struct RollResult* rolls;
+	int count;
+	bool repeat;
+	uint64 fairMessage;
+};
+
+/* Einmal zerlegter Wuerfelbefehl fuer Hotkeys und Kontextmenue, exprs[].text zeigt in command */
+struct CompiledRoll {
+	char command[COMMAND_MAXLEN + 2];   /* mit '!' */
+	struct DiceExpression exprs[MAX_BATCH_ROLLS];
+	int count;
+	bool repeat;
+};
+
+struct Hotkey {
+	char keyword[PLUGIN_HOTKEY_BUFSZ];
+	struct CompiledRoll roll;
+};
+
+/* Mitglied eines Channels fuer Gruppenwuerfe aus dem Kontextmenue */
+struct ChannelMember {
+	anyID clientID;
+	char name[TS3_MAX_SIZE_CLIENT_NICKNAME];
+	int total;
+};
+
+/* Zaehler der Instrumentierung, siehe metricCounterNames */
+enum MetricCounter {
+	METRIC_MESSAGES = 0,   /* ausgewertete Chatnachrichten mit '!' */
+	METRIC_CMD_DICE,
+	METRIC_CMD_SWW,
+	METRIC_CMD_FATE,
+	METRIC_CMD_DSA,
+	METRIC_CMD_SHADOWRUN,
+	METRIC_CMD_COLOR,
+	METRIC_CMD_HELP,
+	METRIC_CMD_SIM,
+	METRIC_CMD_HOTKEY,
+	METRIC_CMD_MENU,
+	METRIC_CMD_CONSOLE,
+	METRIC_CMD_ADMIN,      /* !an, !aus, !version, !fair, !pm, !metrics */
+	METRIC_REJECTED,       /* Syntaxfehler und zu lange Befehle */
+	METRIC_DEFERRED,       /* Befehle, die ein anderer AllDice-Client im Channel beantwortet */
+	METRIC_DICE,           /* geworfene Wuerfel */
+	METRIC_EXPLOSIONS,
+	METRIC_SENT_MESSAGES,
+	METRIC_SENT_COMMANDS,  /* Pluginbefehle im kompakten Modus */
+	METRIC_SENT_BYTES,
+	METRIC_CHANNEL_HITS,   /* clientChannel ohne Client-API */
+	METRIC_CHANNEL_MISSES,
+	METRIC_IDENTITY_HITS,  /* clientIdentity aus dem Cache */
+	METRIC_IDENTITY_MISSES,
+	METRIC_COUNT
+};
+
+/* Gemessene Abschnitte, siehe metricTimerNames */
+enum MetricTimer {
+	TIMER_PARSE = 0,
+	TIMER_ROLL,
+	TIMER_FORMAT,
+	TIMER_SEND,
+	TIMER_MESSAGE,         /* Chatnachricht mit '!' vom Aufruf bis zur Rueckkehr */
+	TIMER_COUNT
+};
+
+/*
+ * Spielsystem (Fate, Savage Worlds, DSA, ...): Schluesselwort nach dem '!', Parser fuer den Rest des Befehls,
+ * Wurf und Ausgabe. Die Systeme werden in ts3plugin_init eingetragen (registerGameSystems), danach findet
+ * parseDiceExpression das System mit einem Tabellenzugriff ueber den ersten Buchstaben.
+ */
+#define MAX_GAME_SYSTEMS 16
+#define MAX_DSA_VALUE 99
+
+struct GameSystem {
+	const char* keyword;   /* "" = Standardsystem ![zahl]w[zahl] */
+	const char* help;      /* Zeilen fuer !help, durch \n getrennt */
+	enum MetricCounter metric;
+	/* Zerlegt text ab *pos (hinter dem Schluesselwort), ein abschliessender Modifikator wird danach gelesen */
+	bool (*parse)(const char* text, int length, int* pos, struct DiceExpression* expr);
+	/* Fuellt faces, explosions, flags, sum und total, die Arrays sind mit 0 vorbelegt */
+	void (*roll)(struct RandomState* random, const struct DiceExpression* expr, struct RollResult* roll);
+	/*
+	 * Wurf eines anderen Clients (checkDice): prueft faces und berechnet explosions, flags, sum, total und
+	 * criticalFailure neu, false bei unmoeglichen Augen. criticalFailure kommt mit dem Wert des Absenders an.
+	 */
+	bool (*check)(const struct DiceExpression* expr, struct RollResult* roll);
+	void (*format)(struct OutputBuilder* out, const struct DiceExpression* expr, const struct RollResult* roll);
+	int (*value)(const struct RollResult* roll);  /* Ergebnis fuer !sim, NULL = total */
+	void (*range)(const struct DiceExpression* expr, int64_t* low, int64_t* high);  /* Wertebereich fuer !sim */
+	bool hasDefaultTarget;  /* !sim ohne Ziel gibt die Erfolgswahrscheinlichkeit fuer defaultTarget aus */
+	int defaultTarget;
+	struct GameSystem* next;  /* naechstes System mit gleichem Anfangsbuchstaben */
+};
+
+struct GameSystem gameSystems[MAX_GAME_SYSTEMS];
+int gameSystemCount = 0;
+struct GameSystem* gameSystemTable[128];  /* nach erstem Buchstaben des Schluesselworts */
+const struct GameSystem* defaultGameSystem = NULL;
+
+/*
+ * Log-lineares Histogramm (wie HDR Histogram) ueber Nanosekunden: 8 Buckets pro Zweierpotenz, der
+ * relative Fehler eines Perzentils liegt damit unter 12.5%.
+ */
+#define HISTOGRAM_SUB_BUCKETS 8
+#define HISTOGRAM_BUCKETS (62 * HISTOGRAM_SUB_BUCKETS)
+
+struct Histogram {
+	uint64 counts[HISTOGRAM_BUCKETS];
+	uint64 total;
+	uint64 sum;
+	uint64 max;
+};
+
+/* Abschnitte im Trace: die Timer der Messwerte, TIMER_MESSAGE ist die komplette Nachricht */
+#define TRACE_MESSAGE TIMER_MESSAGE
+#define TRACE_STAGE_COUNT TIMER_COUNT
+#define TRACE_RING_SIZE 65536  /* Zweierpotenz */
+
+/*
+ * Ein abgeschlossener Abschnitt im Trace-Ring, sequence == 0 markiert einen ungueltigen Eintrag. sequence wird
+ * wie bei einem Seqlock nur ueber atomicLoad64/atomicStore64 gelesen und geschrieben (traceRecord, writeTrace).
+ */
+struct TraceEvent {
+	uint64 sequence;
+	uint64 begin;
+	uint64 end;
+	uint32_t message;
+	uint32_t thread;
+	int stage;
+};
+
+/* Messwerte eines Threads, werden nur von diesem geschrieben und beim Lesen zusammengefasst */
+struct Metrics {
+	uint64 counters[METRIC_COUNT];
+	struct Histogram timers[TIMER_COUNT];
+	size_t arenaHighWater;  /* nur im Ergebnis von collectMetrics, die Threads fuehren ihn in ihrer Arena */
+};
+
+/* Worker-Pool fuer Aufgaben ausserhalb des Callback-Threads */
+#define WORKER_MAX_THREADS 32
+
+typedef void (*WorkerTask)(void* arg, int worker);
+typedef void (*WorkerDone)(void* arg);
+
+struct WorkerThread {
+	struct WorkerPool* pool;
+	int index;
+};
+
+struct WorkerPool {
+	Thread threads[WORKER_MAX_THREADS];
+	struct WorkerThread workers[WORKER_MAX_THREADS];
+	int count;
+	bool started;
+	volatile bool shutdown;
+	Mutex mutex;
+	Condition wake;        /* neue Aufgabe oder Beenden */
+	Condition idle;        /* alle Worker sind mit der Aufgabe fertig */
+	uint64 generation;     /* wird fuer jede Aufgabe erhoeht */
+	int busy;
+	WorkerTask task;
+	WorkerDone done;
+	void* arg;
+};
+
+/*
+ * Ausgabe in Teilen: Antworten ueber messageSizeLimit Bytes werden an Zeilengrenzen geteilt. Alle Teile laufen
+ * durch einen Token-Bucket (sendBurst sofort, danach einer pro sendIntervalMs), damit der Server die Nachrichten
+ * nicht als Flood abweist. Was warten muss, sendet der Thread der SendQueue in der richtigen Reihenfolge.
+ */
+#define SEND_QUEUE_SIZE 64
+#define SEND_DROPPED_NOTICE "[ZZW DiceBot] Ausgabe verworfen, zu viele Nachrichten in der Warteschlange"
+#define SEND_BURST 5
+#define SEND_INTERVAL_MS 1000
+#define RUN_COMPRESS_MIN_DICE 20  /* ab so vielen Wuerfeln werden gleiche Augen zusammengefasst, "6x5" */
+
+struct QueuedMessage {
+	uint64 serverConnectionHandlerID;
+	uint64 channelID;
+	anyID fromID;
+	bool isPrivate;
+	char* text;            /* malloc, gibt der Sendethread frei */
+};
+
+struct SendQueue {
+	Mutex mutex;
+	Condition wake;
+	Thread thread;
+	bool initialized;
+	bool threadStarted;
+	bool shutdown;
+	bool threadFailed;     /* Thread liess sich nicht starten, es wird ungedrosselt direkt gesendet */
+	bool sending;          /* der Thread sendet gerade einen entnommenen Eintrag */
+	struct QueuedMessage entries[SEND_QUEUE_SIZE];
+	int head;
+	int count;
+	int reserved;          /* Plaetze fuer noch nicht eingereihte Teile angenommener Antworten */
+	uint64 nextSend;       /* Token-Bucket als "theoretische Ankunftszeit" in Nanosekunden */
+	uint64 dropped;        /* verworfene Antworten */
+};
+
+/*
+ * Client -> Channel je Serververbindung, nachgefuehrt aus den Move-Events statt bei jeder Antwort den Client zu
+ * fragen. Jeder Channel haelt eine doppelt verkettete Liste seiner Clients (Client-ID 0 = Listenende), die
+ * Channels liegen in einer offenen Hashtabelle mit linearem Sondieren.
+ */
+#define CLIENT_MAP_CONNECTIONS 16
+#define CHANNEL_TABLE_MIN 64   /* Zweierpotenz, waechst bei halber Fuellung */
+
+struct ChannelMembers {
+	uint64 channelID;      /* 0 = frei, leere Channels bleiben bis zum Vergroessern stehen */
+	anyID first;
+	int count;
+};
+
+/*
+ * Identitaet eines sichtbaren Clients. Client-IDs werden nach dem Verlassen neu vergeben, die UID und die
+ * Datenbank-ID bleiben. Die Eintraege liegen flach in einer offenen Hashtabelle (lineares Sondieren, Loeschen
+ * durch Nachruecken), damit Farben, Verlauf und Statistik ohne Aufruf des Client-API aufloesen koennen.
+ */
+#define IDENTITY_TABLE_MIN 64  /* Zweierpotenz, waechst bei halber Fuellung */
+#define IDENTITY_UID_SIZE 64   /* UIDs sind 28 Zeichen Base64 */
+#define HISTORY_LENGTH 8       /* letzte Wuerfe je Client fuer die Infoanzeige */
+#define HISTORY_TEXT_SIZE 24
+
+struct HistoryEntry {
+	int value;             /* rollValue */
+	char text[HISTORY_TEXT_SIZE];
+};
+
+struct ClientIdentity {
+	anyID clientID;        /* 0 = frei */
+	uint64 databaseID;     /* 0 = unbekannt */
+	char uid[IDENTITY_UID_SIZE];
+	char name[TS3_MAX_SIZE_CLIENT_NICKNAME];
+	uint64 rolls;          /* alle Wuerfe seit dem Betreten, der neueste steht in history[(rolls - 1) % HISTORY_LENGTH] */
+	int64_t rollSum;
+	struct HistoryEntry history[HISTORY_LENGTH];
+};
+
+struct ClientMap {
+	uint64 serverConnectionHandlerID;  /* 0 = frei */
+	anyID ownID;           /* eigene Client-ID, einmal beim Verbinden erfragt, 0 = unbekannt */
+	uint64* channelOf;     /* CLIENT_ID_COUNT Eintraege, 0 = unbekannt */
+	anyID* nextMember;
+	anyID* prevMember;
+	struct ChannelMembers* channels;
+	int channelCapacity;
+	int channelUsed;
+	struct ClientIdentity* identities;
+	int identityCapacity;
+	int identityUsed;
+};
+
+/*
+ * Sharding der Chatbefehle fuer viele parallele Tische: jeder Shard ist ein Thread mit eigener Warteschlange und
+ * eigenem DiceContext (Arena, Messwerte, Zufallsfolge). Ein Channel gehoert immer zu genau einem Shard, dadurch
+ * bleibt die Reihenfolge pro Channel erhalten, und kein Shard wartet auf die Warteschlange eines anderen.
+ */
+#define SHARD_QUEUE_SIZE 256
+#define SHARD_MESSAGE_SIZE (COMMAND_MAXLEN + 2)  /* laengere Befehle werden ohnehin nur abgelehnt */
+
+struct ShardMessage {
+	uint64 serverConnectionHandlerID;
+	uint64 channelID;      /* Channel des Absenders beim Eintreffen, dorthin geht die Antwort */
+	anyID targetMode;
+	anyID toID;
+	anyID fromID;
+	char fromName[TS3_MAX_SIZE_CLIENT_NICKNAME];
+	char fromUniqueIdentifier[IDENTITY_UID_SIZE];
+	char message[SHARD_MESSAGE_SIZE];
+};
+
+struct Shard {
+	Thread thread;
+	int index;
+	Mutex mutex;
+	Condition wake;        /* neue Nachricht oder Beenden */
+	Condition space;       /* eine Nachricht ist fertig verarbeitet */
+	struct ShardMessage* entries;  /* Ring mit SHARD_QUEUE_SIZE Eintraegen */
+	int head;
+	int count;             /* wartende Nachrichten einschliesslich der gerade verarbeiteten */
+	bool shutdown;
+	bool reseed;           /* vor der naechsten Nachricht die Zufallsfolge auf seed setzen */
+	uint64 seed;
+};
+
+struct ShardPool {
+	struct Shard shards[WORKER_MAX_THREADS];
+	int count;             /* 0 = alle Befehle im Callback-Thread */
+	Mutex mutex;           /* schuetzt count, Starten, Beenden und Einreihen; Shard-Threads nehmen ihn nie */
+};
+
+/* Wahlzustand einer Serververbindung */
+struct ElectionState {
+	uint64 serverConnectionHandlerID;  /* 0 = frei */
+	uint64 channelID;      /* eigener Channel, auf den sich leaderID bezieht */
+	anyID leaderID;        /* kleinste fremde Client-ID mit Herzschlag in diesem Channel, 0 = keine */
+	uint64 leaderSeen;     /* Nanosekunden */
+	uint64 lastSent;
+	bool announce;         /* beim naechsten Takt einen Herzschlag senden */
+	uint64 published;      /* leaderID | eigene ID << 16 | leaderSeen in ms << 32, fuer electionResponds ohne Sperre */
+};
+
+struct Election {
+	Mutex mutex;
+	Thread thread;
+	bool initialized;
+	bool threadStarted;
+	bool shutdown;
+	struct ElectionState connections[ELECTION_CONNECTIONS];
+};
+
+/* Monte-Carlo-Simulation (!sim) */
+#define SIMULATION_BUCKETS 1024
+#define SIMULATION_CHUNK 16384
+#define SIMULATION_DEFAULT_TRIALS 1000000
+#define SIMULATION_MAX_TRIALS 1000000000ull
+/* Fremde Clients duerfen nur kleine Simulationen starten und hoechstens eine pro Intervall */
+#define SIMULATION_REMOTE_MAX_TRIALS 10000000ull
+#define SIMULATION_REMOTE_INTERVAL_MS 60000
+
+/* Teilergebnis eines Workers */
+struct SimulationStats {
+	uint64 counts[SIMULATION_BUCKETS];
+	uint64 trials;
+	uint64 successes;
+	int64_t sum;
+	double sumSquares;
+	int64_t min;
+	int64_t max;
+};
+
+struct SimulationJob {
+	char text[COMMAND_MAXLEN + 1];
+	struct DiceExpression expr;
+	uint64 trials;
+	bool hasTarget;
+	int target;
+	int64_t low;           /* kleinster Wert im ersten Bucket */
+	int64_t bucketWidth;
+	int threads;
+	uint64 nextChunk;
+	uint64 completed;
+	volatile bool cancel;
+	uint64 start;
+	uint64 serverConnectionHandlerID;
+	uint64 channelID;
+	anyID fromID;
+	bool isPrivate;
+	bool local;            /* /alldice dist: Ergebnis nur ins eigene Chatfenster */
+	struct RandomState random[WORKER_MAX_THREADS];
+	struct SimulationStats stats[WORKER_MAX_THREADS];
+};
+
+/*
+ * Bump-Allocator fuer den Arbeitsspeicher einer Nachricht. Der Puffer wird einmal pro Thread angelegt und
+ * vor jeder Nachricht nur zurueckgesetzt, im Hot Path gibt es damit keine Heap-Allokation.
+ */
+struct Arena {
+	char* base;
+	size_t used;
+	size_t capacity;
+	size_t highWater;      /* groesster Verbrauch einer einzelnen Nachricht */
+};
+
+/*
+ * Arbeitsbereich fuer eine Nachricht. Parser, Wurf und Ausgabe arbeiten nur auf dem Kontext des Aufrufers,
+ * verschiedene Serververbindungen koennen so ohne Sperren parallel in eigenen Threads verarbeitet werden.
+ */
+struct DiceContext {
+	struct RandomState random;
+	struct Arena arena;
+	struct Metrics metrics;
+	char userColor[COLOR_BUFSIZE];
+	char* ausgabe;         /* OUTPUT_BUFSIZE Bytes aus der Arena, gueltig bis zur naechsten Nachricht */
+	struct DiceContext* next;  /* Liste aller Kontexte, fuer das Zusammenfassen der Messwerte */
+	uint64 generation;
+	uint32_t threadNumber;     /* laufende Nummer des Kontexts, tid im Trace */
+	uint32_t traceMessage;     /* Nummer der aktuellen Nachricht im Trace */
+	struct RollBatch* batch;   /* Wuerfe der aktuellen Nachricht in der Arena, NULL ohne Wurf */
+};
+
+/* Alle jemals angelegten Kontexte, neue werden vorne eingehaengt */
+struct DiceContext* volatile diceContextList = NULL;
+uint64 diceContextGeneration = 1;
+
+#define METRICS_BUFSIZE 2048
+#define METRICS_DUMP_INTERVAL (15ull * 60 * 1000000000)  /* Nanosekunden zwischen zwei Eintraegen im Log */
+uint64 nextMetricsDump = 0;
+uint64 diceContextCounter = 0;
+
+/* Optionaler Trace der Verarbeitungsschritte, !trace an/aus/dump */
+volatile bool traceActive = false;
+struct TraceEvent* traceEvents = NULL;
+uint64 traceSequence = 0;
+uint64 traceMessageCounter = 0;
+
+struct WorkerPool workerPool;
+struct ShardPool shardPool;
+struct SendQueue sendQueue;
+struct Election election;
+struct ClientMap clientMaps[CLIENT_MAP_CONNECTIONS];
+Mutex clientMapMutex;
+struct Hotkey hotkeys[MAX_HOTKEYS];
+int hotkeyCount = 0;
+unsigned char hotkeyTable[HOTKEY_TABLE_SIZE];  /* Index + 1 in hotkeys, 0 = frei */
+struct CompiledRoll menuRoll;
+struct CompiledRoll menuInitiative;
+
+/*
+ * Infoanzeige: der zuletzt angezeigte Text bleibt stehen, bis sich infoGeneration oder der Leiter im eigenen
+ * Channel aendert. Der Cache wird nur im Client-Thread benutzt (infoData und Ereignisse), infoGeneration
+ * erhoehen alle Threads atomar.
+ */
+#define INFO_BUFSIZE 4096
+#define INFO_REFRESH_MS 1000   /* hoechstens so oft eine neue Anzeige anfordern */
+
+struct InfoCache {
+	uint64 serverConnectionHandlerID;  /* 0 = leer */
+	enum PluginItemType type;
+	uint64 id;
+	uint64 generation;
+	bool responds;
+	char text[INFO_BUFSIZE];
+};
+
+struct InfoCache infoCache;
+uint64 infoGeneration = 1;
+uint64 infoRequested = 0;  /* Nanosekunden */
+int messageSizeLimit = TS3_MAX_SIZE_TEXTMESSAGE;
+int sendBurst = SEND_BURST;
+int sendIntervalMs = SEND_INTERVAL_MS;
+struct SimulationJob simulationJob;
+uint64 simulationRunning = 0;
+
+unsigned long mix(unsigned long a, unsigned long b, unsigned long c);
+void outputInit(struct OutputBuilder* out, char* buffer, size_t capacity);
+void collectMetrics(struct Metrics* result);
+void formatMetrics(struct OutputBuilder* out, const struct Metrics* metrics);
+void logMetrics();
+void stopTrace();
+void registerGameSystems();
+void workerPoolStop(struct WorkerPool* pool);
+void shardPoolInit();
+int shardPoolStart(int count);
+void shardPoolStop();
+void shardPoolDrain();
+int shardPoolCount();
+void handleTextMessage(uint64 serverConnectionHandlerID, anyID targetMode, anyID toID, anyID fromID, const char* fromName, const char* fromUniqueIdentifier, const char* message, uint64 knownChannelID);
+void sendQueueInit();
+void sendQueueStop();
+void electionInit();
+void electionStop();
+void electionClientMoved(uint64 serverConnectionHandlerID, anyID clientID, uint64 newChannelID);
+void clientMapInit();
+void clientMapStop();
+void clientMapConnect(uint64 serverConnectionHandlerID);
+void clientMapDisconnect(uint64 serverConnectionHandlerID);
+void clientMapMove(uint64 serverConnectionHandlerID, anyID clientID, uint64 newChannelID);
+anyID ownClientID(uint64 serverConnectionHandlerID);
+void identityUpdate(uint64 serverConnectionHandlerID, anyID clientID, const char* uid, const char* name, uint64 databaseID);
+void identityRefresh(uint64 serverConnectionHandlerID, anyID clientID);
+void loadHotkeys(const char* configPath);
+bool compileRoll(struct CompiledRoll* roll, const char* command);
+int processConsoleCommand(uint64 serverConnectionHandlerID, const char* command);
+void infoChanged();
+const char* infoDashboard(uint64 serverConnectionHandlerID, uint64 id, enum PluginItemType type);
+
 static struct TS3Functions ts3Functions;
 
 #ifdef _WIN32
@@ -124,6 +790,8 @@ int ts3plugin_init() {
     char resourcesPath[PATH_BUFSIZE];
     char configPath[PATH_BUFSIZE];
 	char pluginPath[PATH_BUFSIZE];
+	uint64* connections;
+	int i;
 
     /* Your plugin init code here */
     //printf("PLUGIN: init\n");
@@ -135,6 +803,19 @@ int ts3plugin_init() {
     ts3Functions.getConfigPath(configPath, PATH_BUFSIZE);
 	ts3Functions.getPluginPath(pluginPath, PATH_BUFSIZE, pluginID);
 
+	registerGameSystems();
+	loadHotkeys(configPath);
+	sendQueueInit();
+	shardPoolInit();
+	clientMapInit();
+	electionInit();
+	if (ts3Functions.getServerConnectionHandlerList(&connections) == ERROR_ok) {
+		for (i = 0; connections[i]; i++) {
+			clientMapConnect(connections[i]);  /* Plugin wurde bei bestehender Verbindung geladen */
+		}
+		ts3Functions.freeMemory(connections);
+	}
+
 	//printf("PLUGIN: App path: %s\nResources path: %s\nConfig path: %s\nPlugin path: %s\n", appPath, resourcesPath, configPath, pluginPath);
 
     return 0;  /* 0 = success, 1 = failure, -2 = failure but client will not show a "failed to load" warning */
@@ -154,6 +835,19 @@ void ts3plugin_shutdown() {
 	 * TeamSpeak client will most likely crash (DLL removed but dialog from DLL code still open).
 	 */
 
+	shardPoolStop();
+	mutexDestroy(&shardPool.mutex);
+	simulationJob.cancel = true;
+	workerPoolStop(&workerPool);
+	electionStop();
+	sendQueueStop();
+	clientMapStop();
+	logMetrics();
+	stopTrace();
+	free(traceEvents);
+	traceEvents = NULL;
+	freeDiceContexts();
+
 	/* Free pluginID if we registered it */
 	if(pluginID) {
 		free(pluginID);
@@ -197,7 +891,7 @@ void ts3plugin_registerPluginID(const char* id) {
 
 /* Plugin command keyword. Return NULL or "" if not used. */
 const char* ts3plugin_commandKeyword() {
-	return "";
+	return CONSOLE_KEYWORD;
 }
 
 static void print_and_free_bookmarks_list(struct PluginBookmarkList* list)
@@ -219,245 +913,7 @@ static void print_and_free_bookmarks_list(struct PluginBookmarkList* list)
 
 /* Plugin processes console command. Return 0 if plugin handled the command, 1 if not handled. */
 int ts3plugin_processCommand(uint64 serverConnectionHandlerID, const char* command) {
-//	char buf[COMMAND_BUFSIZE];
-//	char *s, *param1 = NULL, *param2 = NULL;
-//	int i = 0;
-//	enum { CMD_NONE = 0, CMD_JOIN, CMD_COMMAND, CMD_SERVERINFO, CMD_CHANNELINFO, CMD_AVATAR, CMD_ENABLEMENU, CMD_SUBSCRIBE, CMD_UNSUBSCRIBE, CMD_SUBSCRIBEALL, CMD_UNSUBSCRIBEALL, CMD_BOOKMARKSLIST } cmd = CMD_NONE;
-//#ifdef _WIN32
-//	char* context = NULL;
-//#endif
-//
-//	printf("PLUGIN: process command: '%s'\n", command);
-//
-//	_strcpy(buf, COMMAND_BUFSIZE, command);
-//#ifdef _WIN32
-//	s = strtok_s(buf, " ", &context);
-//#else
-//	s = strtok(buf, " ");
-//#endif
-//	while(s != NULL) {
-//		if(i == 0) {
-//			if(!strcmp(s, "join")) {
-//				cmd = CMD_JOIN;
-//			} else if(!strcmp(s, "command")) {
-//				cmd = CMD_COMMAND;
-//			} else if(!strcmp(s, "serverinfo")) {
-//				cmd = CMD_SERVERINFO;
-//			} else if(!strcmp(s, "channelinfo")) {
-//				cmd = CMD_CHANNELINFO;
-//			} else if(!strcmp(s, "avatar")) {
-//				cmd = CMD_AVATAR;
-//			} else if(!strcmp(s, "enablemenu")) {
-//				cmd = CMD_ENABLEMENU;
-//			} else if(!strcmp(s, "subscribe")) {
-//				cmd = CMD_SUBSCRIBE;
-//			} else if(!strcmp(s, "unsubscribe")) {
-//				cmd = CMD_UNSUBSCRIBE;
-//			} else if(!strcmp(s, "subscribeall")) {
-//				cmd = CMD_SUBSCRIBEALL;
-//			} else if(!strcmp(s, "unsubscribeall")) {
-//				cmd = CMD_UNSUBSCRIBEALL;
-//            } else if (!strcmp(s, "bookmarkslist")) {
-//                cmd = CMD_BOOKMARKSLIST;
-//            }
-//		} else if(i == 1) {
-//			param1 = s;
-//		} else {
-//			param2 = s;
-//		}
-//#ifdef _WIN32
-//		s = strtok_s(NULL, " ", &context);
-//#else
-//		s = strtok(NULL, " ");
-//#endif
-//		i++;
-//	}
-//
-//	switch(cmd) {
-//		case CMD_NONE:
-//			return 1;  /* Command not handled by plugin */
-//		case CMD_JOIN:  /* /test join <channelID> [optionalCannelPassword] */
-//			if(param1) {
-//				uint64 channelID = (uint64)atoi(param1);
-//				char* password = param2 ? param2 : "";
-//				char returnCode[RETURNCODE_BUFSIZE];
-//				anyID myID;
-//
-//				/* Get own clientID */
-//				if(ts3Functions.getClientID(serverConnectionHandlerID, &myID) != ERROR_ok) {
-//					ts3Functions.logMessage("Error querying client ID", LogLevel_ERROR, "Plugin", serverConnectionHandlerID);
-//					break;
-//				}
-//
-//				/* Create return code for requestClientMove function call. If creation fails, returnCode will be NULL, which can be
-//				 * passed into the client functions meaning no return code is used.
-//				 * Note: To use return codes, the plugin needs to register a plugin ID using ts3plugin_registerPluginID */
-//				ts3Functions.createReturnCode(pluginID, returnCode, RETURNCODE_BUFSIZE);
-//
-//				/* In a real world plugin, the returnCode should be remembered (e.g. in a dynamic STL vector, if it's a C++ plugin).
-//				 * onServerErrorEvent can then check the received returnCode, compare with the remembered ones and thus identify
-//				 * which function call has triggered the event and react accordingly. */
-//
-//				/* Request joining specified channel using above created return code */
-//				if(ts3Functions.requestClientMove(serverConnectionHandlerID, myID, channelID, password, returnCode) != ERROR_ok) {
-//					ts3Functions.logMessage("Error requesting client move", LogLevel_INFO, "Plugin", serverConnectionHandlerID);
-//				}
-//			} else {
-//				ts3Functions.printMessageToCurrentTab("Missing channel ID parameter.");
-//			}
-//			break;
-//		case CMD_COMMAND:  /* /test command <command> */
-//			if(param1) {
-//				/* Send plugin command to all clients in current channel. In this case targetIds is unused and can be NULL. */
-//				if(pluginID) {
-//					/* See ts3plugin_registerPluginID for how to obtain a pluginID */
-//					printf("PLUGIN: Sending plugin command to current channel: %s\n", param1);
-//					ts3Functions.sendPluginCommand(serverConnectionHandlerID, pluginID, param1, PluginCommandTarget_CURRENT_CHANNEL, NULL, NULL);
-//				} else {
-//					printf("PLUGIN: Failed to send plugin command, was not registered.\n");
-//				}
-//			} else {
-//				ts3Functions.printMessageToCurrentTab("Missing command parameter.");
-//			}
-//			break;
-//		case CMD_SERVERINFO: {  /* /test serverinfo */
-//			/* Query host, port and server password of current server tab.
-//			 * The password parameter can be NULL if the plugin does not want to receive the server password.
-//			 * Note: Server password is only available if the user has actually used it when connecting. If a user has
-//			 * connected with the permission to ignore passwords (b_virtualserver_join_ignore_password) and the password,
-//			 * was not entered, it will not be available.
-//			 * getServerConnectInfo returns 0 on success, 1 on error or if current server tab is disconnected. */
-//			char host[SERVERINFO_BUFSIZE];
-//			/*char password[SERVERINFO_BUFSIZE];*/
-//			char* password = NULL;  /* Don't receive server password */
-//			unsigned short port;
-//			if(!ts3Functions.getServerConnectInfo(serverConnectionHandlerID, host, &port, password, SERVERINFO_BUFSIZE)) {
-//				char msg[SERVERINFO_BUFSIZE];
-//				snprintf(msg, sizeof(msg), "Server Connect Info: %s:%d", host, port);
-//				ts3Functions.printMessageToCurrentTab(msg);
-//			} else {
-//				ts3Functions.printMessageToCurrentTab("No server connect info available.");
-//			}
-//			break;
-//		}
-//		case CMD_CHANNELINFO: {  /* /test channelinfo */
-//			/* Query channel path and password of current server tab.
-//			 * The password parameter can be NULL if the plugin does not want to receive the channel password.
-//			 * Note: Channel password is only available if the user has actually used it when entering the channel. If a user has
-//			 * entered a channel with the permission to ignore passwords (b_channel_join_ignore_password) and the password,
-//			 * was not entered, it will not be available.
-//			 * getChannelConnectInfo returns 0 on success, 1 on error or if current server tab is disconnected. */
-//			char path[CHANNELINFO_BUFSIZE];
-//			/*char password[CHANNELINFO_BUFSIZE];*/
-//			char* password = NULL;  /* Don't receive channel password */
-//
-//			/* Get own clientID and channelID */
-//			anyID myID;
-//			uint64 myChannelID;
-//			if(ts3Functions.getClientID(serverConnectionHandlerID, &myID) != ERROR_ok) {
-//				ts3Functions.logMessage("Error querying client ID", LogLevel_ERROR, "Plugin", serverConnectionHandlerID);
-//				break;
-//			}
-//			/* Get own channel ID */
-//			if(ts3Functions.getChannelOfClient(serverConnectionHandlerID, myID, &myChannelID) != ERROR_ok) {
-//				ts3Functions.logMessage("Error querying channel ID", LogLevel_ERROR, "Plugin", serverConnectionHandlerID);
-//				break;
-//			}
-//
-//			/* Get channel connect info of own channel */
-//			if(!ts3Functions.getChannelConnectInfo(serverConnectionHandlerID, myChannelID, path, password, CHANNELINFO_BUFSIZE)) {
-//				char msg[CHANNELINFO_BUFSIZE];
-//				snprintf(msg, sizeof(msg), "Channel Connect Info: %s", path);
-//				ts3Functions.printMessageToCurrentTab(msg);
-//			} else {
-//				ts3Functions.printMessageToCurrentTab("No channel connect info available.");
-//			}
-//			break;
-//		}
-//		case CMD_AVATAR: {  /* /test avatar <clientID> */
-//			char avatarPath[PATH_BUFSIZE];
-//			anyID clientID = (anyID)atoi(param1);
-//			unsigned int error;
-//
-//			memset(avatarPath, 0, PATH_BUFSIZE);
-//			error = ts3Functions.getAvatar(serverConnectionHandlerID, clientID, avatarPath, PATH_BUFSIZE);
-//			if(error == ERROR_ok) {  /* ERROR_ok means the client has an avatar set. */
-//				if(strlen(avatarPath)) {  /* Avatar path contains the full path to the avatar image in the TS3Client cache directory */
-//					printf("Avatar path: %s\n", avatarPath);
-//				} else { /* Empty avatar path means the client has an avatar but the image has not yet been cached. The TeamSpeak
-//						  * client will automatically start the download and call onAvatarUpdated when done */
-//					printf("Avatar not yet downloaded, waiting for onAvatarUpdated...\n");
-//				}
-//			} else if(error == ERROR_database_empty_result) {  /* Not an error, the client simply has no avatar set */
-//				printf("Client has no avatar\n");
-//			} else { /* Other error occured (invalid server connection handler ID, invalid client ID, file io error etc) */
-//				printf("Error getting avatar: %d\n", error);
-//			}
-//			break;
-//		}
-//		case CMD_ENABLEMENU:  /* /test enablemenu <menuID> <0|1> */
-//			if(param1) {
-//				int menuID = atoi(param1);
-//				int enable = param2 ? atoi(param2) : 0;
-//				ts3Functions.setPluginMenuEnabled(pluginID, menuID, enable);
-//			} else {
-//				ts3Functions.printMessageToCurrentTab("Usage is: /test enablemenu <menuID> <0|1>");
-//			}
-//			break;
-//		case CMD_SUBSCRIBE:  /* /test subscribe <channelID> */
-//			if(param1) {
-//				char returnCode[RETURNCODE_BUFSIZE];
-//				uint64 channelIDArray[2];
-//				channelIDArray[0] = (uint64)atoi(param1);
-//				channelIDArray[1] = 0;
-//				ts3Functions.createReturnCode(pluginID, returnCode, RETURNCODE_BUFSIZE);
-//				if(ts3Functions.requestChannelSubscribe(serverConnectionHandlerID, channelIDArray, returnCode) != ERROR_ok) {
-//					ts3Functions.logMessage("Error subscribing channel", LogLevel_INFO, "Plugin", serverConnectionHandlerID);
-//				}
-//			}
-//			break;
-//		case CMD_UNSUBSCRIBE:  /* /test unsubscribe <channelID> */
-//			if(param1) {
-//				char returnCode[RETURNCODE_BUFSIZE];
-//				uint64 channelIDArray[2];
-//				channelIDArray[0] = (uint64)atoi(param1);
-//				channelIDArray[1] = 0;
-//				ts3Functions.createReturnCode(pluginID, returnCode, RETURNCODE_BUFSIZE);
-//				if(ts3Functions.requestChannelUnsubscribe(serverConnectionHandlerID, channelIDArray, NULL) != ERROR_ok) {
-//					ts3Functions.logMessage("Error unsubscribing channel", LogLevel_INFO, "Plugin", serverConnectionHandlerID);
-//				}
-//			}
-//			break;
-//		case CMD_SUBSCRIBEALL: {  /* /test subscribeall */
-//			char returnCode[RETURNCODE_BUFSIZE];
-//			ts3Functions.createReturnCode(pluginID, returnCode, RETURNCODE_BUFSIZE);
-//			if(ts3Functions.requestChannelSubscribeAll(serverConnectionHandlerID, returnCode) != ERROR_ok) {
-//				ts3Functions.logMessage("Error subscribing channel", LogLevel_INFO, "Plugin", serverConnectionHandlerID);
-//			}
-//			break;
-//		}
-//		case CMD_UNSUBSCRIBEALL: {  /* /test unsubscribeall */
-//			char returnCode[RETURNCODE_BUFSIZE];
-//			ts3Functions.createReturnCode(pluginID, returnCode, RETURNCODE_BUFSIZE);
-//			if(ts3Functions.requestChannelUnsubscribeAll(serverConnectionHandlerID, returnCode) != ERROR_ok) {
-//				ts3Functions.logMessage("Error subscribing channel", LogLevel_INFO, "Plugin", serverConnectionHandlerID);
-//			}
-//			break;
-//		}
-//        case CMD_BOOKMARKSLIST: {  /* test bookmarkslist */
-//            struct PluginBookmarkList* list;
-//            unsigned int error = ts3Functions.getBookmarkList(&list);
-//            if (error == ERROR_ok) {
-//                print_and_free_bookmarks_list(list);
-//            }
-//            else {
-//                ts3Functions.logMessage("Error getting bookmarks list", LogLevel_ERROR, "Plugin", serverConnectionHandlerID);
-//            }
-//            break;
-//        }
-//	}
-
-	return 0;  /* Plugin handled command */
+	return processConsoleCommand(serverConnectionHandlerID, command);
 }
 
 /* Client changed current server connection handler */
@@ -482,6 +938,18 @@ const char* ts3plugin_infoTitle() {
  */
 void ts3plugin_infoData(uint64 serverConnectionHandlerID, uint64 id, enum PluginItemType type, char** data) {
 	//char* name;
+	const char* text = infoDashboard(serverConnectionHandlerID, id, type);
+	size_t size;
+
+	if (text == NULL) {
+		*data = NULL;
+		return;
+	}
+	size = strlen(text) + 1;
+	*data = (char*)malloc(size * sizeof(char));  /* Must be allocated in the plugin! */
+	if (*data != NULL) {
+		memcpy(*data, text, size);
+	}
 
 	///* For demonstration purpose, display the name of the currently selected server, channel or client. */
 	//switch(type) {
@@ -611,6 +1079,39 @@ int ts3plugin_requestAutoload() {
 //
 //	/* All memory allocated in this function will be automatically released by the TeamSpeak client later by calling ts3plugin_freeMemory */
 //}
+
+static struct PluginMenuItem* createMenuItem(enum PluginMenuType type, int id, const char* text) {
+	struct PluginMenuItem* menuItem = (struct PluginMenuItem*)malloc(sizeof(struct PluginMenuItem));
+	if (menuItem != NULL) {
+		menuItem->type = type;
+		menuItem->id = id;
+		_strcpy(menuItem->text, PLUGIN_MENU_BUFSZ, text);
+		menuItem->icon[0] = '\0';
+	}
+	return menuItem;
+}
+
+/* Zerlegt die Menuewuerfe einmal und meldet die Eintraege an, der Client gibt sie mit ts3plugin_freeMemory frei */
+void ts3plugin_initMenus(struct PluginMenuItem*** menuItems, char** menuIcon) {
+	char text[PLUGIN_MENU_BUFSZ];
+	size_t n = 0;
+
+	*menuIcon = NULL;
+	*menuItems = NULL;
+	if (!compileRoll(&menuRoll, MENU_ROLL_COMMAND) || !compileRoll(&menuInitiative, MENU_INITIATIVE_COMMAND)) {
+		return;
+	}
+	if ((*menuItems = (struct PluginMenuItem**)malloc(sizeof(struct PluginMenuItem*) * 5)) == NULL) {
+		return;
+	}
+	snprintf(text, PLUGIN_MENU_BUFSZ, "Wuerfeln (%s)", MENU_ROLL_COMMAND);
+	(*menuItems)[n++] = createMenuItem(PLUGIN_MENU_TYPE_CLIENT, MENU_ID_CLIENT_ROLL, text);
+	snprintf(text, PLUGIN_MENU_BUFSZ, "Initiative wuerfeln (%s)", MENU_INITIATIVE_COMMAND);
+	(*menuItems)[n++] = createMenuItem(PLUGIN_MENU_TYPE_CHANNEL, MENU_ID_CHANNEL_INITIATIVE, text);
+	(*menuItems)[n++] = createMenuItem(PLUGIN_MENU_TYPE_GLOBAL, MENU_ID_GLOBAL_TOGGLE, "Dicebot an/aus");
+	(*menuItems)[n++] = createMenuItem(PLUGIN_MENU_TYPE_GLOBAL, MENU_ID_GLOBAL_METRICS, "Messwerte anzeigen");
+	(*menuItems)[n] = NULL;
+}
 //
 ///* Helper function to create a hotkey */
 //static struct PluginHotkey* createHotkey(const char* keyword, const char* description) {
@@ -642,6 +1143,29 @@ int ts3plugin_requestAutoload() {
 //
 //	/* The client will call ts3plugin_freeMemory to release all allocated memory */
 //}
+
+/* Meldet die Hotkeys aus HOTKEY_FILE an, der Client gibt den Speicher mit ts3plugin_freeMemory wieder frei */
+void ts3plugin_initHotkeys(struct PluginHotkey*** result) {
+	int i;
+
+	*result = (struct PluginHotkey**)malloc(sizeof(struct PluginHotkey*) * (hotkeyCount + 1));
+	if (*result == NULL) {
+		return;
+	}
+	for (i = 0; i < hotkeyCount; i++) {
+		struct PluginHotkey* hotkey = (struct PluginHotkey*)malloc(sizeof(struct PluginHotkey));
+		if (hotkey == NULL) {
+			break;
+		}
+		const char* name = hotkeys[i].keyword + strlen(HOTKEY_PREFIX);
+		/* snprintf ist unter Windows sprintf_s und bricht bei zu langer Ausgabe ab, der Befehl wird daher selbst gekuerzt */
+		int room = PLUGIN_HOTKEY_BUFSZ - 1 - (int)(sizeof("AllDice:  ()") - 1 + strlen(name));
+		_strcpy(hotkey->keyword, PLUGIN_HOTKEY_BUFSZ, hotkeys[i].keyword);
+		snprintf(hotkey->description, PLUGIN_HOTKEY_BUFSZ, "AllDice: %s (%.*s)", name, room > 0 ? room : 0, hotkeys[i].roll.command);
+		(*result)[i] = hotkey;
+	}
+	(*result)[i] = NULL;
+}
 //
 ///************************** TeamSpeak callbacks ***************************/
 ///*
@@ -652,6 +1176,13 @@ int ts3plugin_requestAutoload() {
 ///* Clientlib */
 
 void ts3plugin_onConnectStatusChangeEvent(uint64 serverConnectionHandlerID, int newStatus, unsigned int errorNumber) {
+	if (newStatus == STATUS_CONNECTION_ESTABLISHED) {
+		clientMapConnect(serverConnectionHandlerID);
+	}
+	else if (newStatus == STATUS_DISCONNECTED) {
+		clientMapDisconnect(serverConnectionHandlerID);
+	}
+
     /* Some example code following to show how to use the information query functions. */
 
   //  if(newStatus == STATUS_CONNECTION_ESTABLISHED) {  /* connection established and we have client and channels available */
@@ -761,27 +1292,40 @@ void ts3plugin_onUpdateChannelEditedEvent(uint64 serverConnectionHandlerID, uint
 }
 
 void ts3plugin_onUpdateClientEvent(uint64 serverConnectionHandlerID, anyID clientID, anyID invokerID, const char* invokerName, const char* invokerUniqueIdentifier) {
+	identityRefresh(serverConnectionHandlerID, clientID);
 }
 
 void ts3plugin_onClientMoveEvent(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, int visibility, const char* moveMessage) {
+	clientMapMove(serverConnectionHandlerID, clientID, newChannelID);
+	electionClientMoved(serverConnectionHandlerID, clientID, newChannelID);
 }
 
 void ts3plugin_onClientMoveSubscriptionEvent(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, int visibility) {
+	clientMapMove(serverConnectionHandlerID, clientID, newChannelID);
 }
 
 void ts3plugin_onClientMoveTimeoutEvent(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, int visibility, const char* timeoutMessage) {
+	clientMapMove(serverConnectionHandlerID, clientID, newChannelID);
+	electionClientMoved(serverConnectionHandlerID, clientID, newChannelID);
 }
 
 void ts3plugin_onClientMoveMovedEvent(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, int visibility, anyID moverID, const char* moverName, const char* moverUniqueIdentifier, const char* moveMessage) {
+	clientMapMove(serverConnectionHandlerID, clientID, newChannelID);
+	electionClientMoved(serverConnectionHandlerID, clientID, newChannelID);
 }
 
 void ts3plugin_onClientKickFromChannelEvent(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, int visibility, anyID kickerID, const char* kickerName, const char* kickerUniqueIdentifier, const char* kickMessage) {
+	clientMapMove(serverConnectionHandlerID, clientID, newChannelID);
+	electionClientMoved(serverConnectionHandlerID, clientID, newChannelID);
 }
 
 void ts3plugin_onClientKickFromServerEvent(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, int visibility, anyID kickerID, const char* kickerName, const char* kickerUniqueIdentifier, const char* kickMessage) {
+	clientMapMove(serverConnectionHandlerID, clientID, newChannelID);
+	electionClientMoved(serverConnectionHandlerID, clientID, newChannelID);
 }
 
 void ts3plugin_onClientIDsEvent(uint64 serverConnectionHandlerID, const char* uniqueClientIdentifier, anyID clientID, const char* clientName) {
+	identityUpdate(serverConnectionHandlerID, clientID, uniqueClientIdentifier, clientName, 0);
 }
 
 void ts3plugin_onClientIDsFinishedEvent(uint64 serverConnectionHandlerID) {
@@ -808,24 +1352,261 @@ int ts3plugin_onServerErrorEvent(uint64 serverConnectionHandlerID, const char* e
 void ts3plugin_onServerStopEvent(uint64 serverConnectionHandlerID, const char* shutdownMessage) {
 }
 
-int generateRandomNumber(int startFrom, int span) {
-	if (span != 0) {
-		int number;
+#define ROTL32(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+#define ROTR32(v, n) (((v) >> (n)) | ((v) << (32 - (n))))
+
+/* SHA-256 (FIPS 180-4), nur fuer das Commitment des fairen Modus */
+static const uint32_t sha256K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static void sha256Block(uint32_t state[8], const unsigned char block[64]) {
+	uint32_t w[64];
+	uint32_t a, b, c, d, e, f, g, h, t1, t2;
+	int i;
+
+	for (i = 0; i < 16; i++) {
+		w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) | ((uint32_t)block[i * 4 + 2] << 8) | (uint32_t)block[i * 4 + 3];
+	}
+	for (i = 16; i < 64; i++) {
+		uint32_t s0 = ROTR32(w[i - 15], 7) ^ ROTR32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		uint32_t s1 = ROTR32(w[i - 2], 17) ^ ROTR32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+
+	a = state[0]; b = state[1]; c = state[2]; d = state[3];
+	e = state[4]; f = state[5]; g = state[6]; h = state[7];
+	for (i = 0; i < 64; i++) {
+		t1 = h + (ROTR32(e, 6) ^ ROTR32(e, 11) ^ ROTR32(e, 25)) + ((e & f) ^ (~e & g)) + sha256K[i] + w[i];
+		t2 = (ROTR32(a, 2) ^ ROTR32(a, 13) ^ ROTR32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+		h = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+	state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+	state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+void sha256(const unsigned char* data, size_t length, unsigned char digest[SHA256_DIGEST_SIZE]) {
+	uint32_t state[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+	unsigned char block[64];
+	uint64 bitLength = (uint64)length * 8;
+	size_t i;
+
+	while (length >= 64) {
+		sha256Block(state, data);
+		data += 64;
+		length -= 64;
+	}
+
+	memset(block, 0, sizeof(block));
+	memcpy(block, data, length);
+	block[length] = 0x80;
+	if (length >= 56) {
+		sha256Block(state, block);
+		memset(block, 0, sizeof(block));
+	}
+	for (i = 0; i < 8; i++) {
+		block[63 - i] = (unsigned char)(bitLength >> (i * 8));
+	}
+	sha256Block(state, block);
+
+	for (i = 0; i < 8; i++) {
+		digest[i * 4] = (unsigned char)(state[i] >> 24);
+		digest[i * 4 + 1] = (unsigned char)(state[i] >> 16);
+		digest[i * 4 + 2] = (unsigned char)(state[i] >> 8);
+		digest[i * 4 + 3] = (unsigned char)state[i];
+	}
+}
+
+#define CHACHA_QUARTERROUND(x, a, b, c, d) \
+	x[a] += x[b]; x[d] ^= x[a]; x[d] = ROTL32(x[d], 16); \
+	x[c] += x[d]; x[b] ^= x[c]; x[b] = ROTL32(x[b], 12); \
+	x[a] += x[b]; x[d] ^= x[a]; x[d] = ROTL32(x[d], 8); \
+	x[c] += x[d]; x[b] ^= x[c]; x[b] = ROTL32(x[b], 7);
+
+/*
+ * ChaCha20-Blockfunktion (Original-Variante mit 64 Bit Zaehler und Nonce 0). Als zaehlerbasierter Generator
+ * haengt jeder Block nur von Schluessel und Zaehler ab, jeder Wurf kann also einzeln nachgerechnet werden.
+ */
+void chachaBlock(const unsigned char key[FAIR_SEED_SIZE], uint64 counter, uint32_t out[16]) {
+	uint32_t x[16];
+	int i;
+
+	out[0] = 0x61707865; out[1] = 0x3320646e; out[2] = 0x79622d32; out[3] = 0x6b206574;
+	for (i = 0; i < 8; i++) {
+		out[4 + i] = (uint32_t)key[i * 4] | ((uint32_t)key[i * 4 + 1] << 8) | ((uint32_t)key[i * 4 + 2] << 16) | ((uint32_t)key[i * 4 + 3] << 24);
+	}
+	out[12] = (uint32_t)counter;
+	out[13] = (uint32_t)(counter >> 32);
+	out[14] = 0;
+	out[15] = 0;
+
+	memcpy(x, out, sizeof(x));
+	for (i = 0; i < 10; i++) {
+		CHACHA_QUARTERROUND(x, 0, 4, 8, 12)
+		CHACHA_QUARTERROUND(x, 1, 5, 9, 13)
+		CHACHA_QUARTERROUND(x, 2, 6, 10, 14)
+		CHACHA_QUARTERROUND(x, 3, 7, 11, 15)
+		CHACHA_QUARTERROUND(x, 0, 5, 10, 15)
+		CHACHA_QUARTERROUND(x, 1, 6, 11, 12)
+		CHACHA_QUARTERROUND(x, 2, 7, 8, 13)
+		CHACHA_QUARTERROUND(x, 3, 4, 9, 14)
+	}
+	for (i = 0; i < 16; i++) {
+		out[i] += x[i];
+	}
+}
+
+void toHex(const unsigned char* data, size_t length, char* out) {
+	static const char digits[] = "0123456789abcdef";
+	size_t i;
+	for (i = 0; i < length; i++) {
+		out[i * 2] = digits[data[i] >> 4];
+		out[i * 2 + 1] = digits[data[i] & 0x0f];
+	}
+	out[length * 2] = '\0';
+}
 
-		/* initialize random seed: */
-		unsigned long seed = mix(clock(), time(NULL) + randomNumberCounter, getpid());
-		randomNumberCounter++;
-		if (randomNumberCounter > 5000) {
-			randomNumberCounter = 0;
+/* Liest den Seed aus der Zufallsquelle des Betriebssystems. Gibt false zurueck, wenn keine verfuegbar ist. */
+bool readSystemEntropy(unsigned char* buffer, size_t length) {
+#ifdef _WIN32
+	size_t i;
+	for (i = 0; i < length; i++) {
+		unsigned int value;
+		if (rand_s(&value) != 0) {
+			return false;
 		}
+		buffer[i] = (unsigned char)value;
+	}
+	return true;
+#else
+	FILE* f = fopen("/dev/urandom", "rb");
+	size_t read;
+	if (f == NULL) {
+		return false;
+	}
+	read = fread(buffer, 1, length, f);
+	fclose(f);
+	return read == length;
+#endif
+}
+
+/* Wurf k der Nachricht m im fairen Modus: ((ChaCha20(seed, m * 2^32 + k)[0] * span) >> 32) + startFrom + 1 */
+int fairRandomNumber(struct RandomState* random, int startFrom, int span) {
+	uint32_t block[16];
+	if (random->fairMessage == 0) {
+		random->fairMessage = atomicIncrement64(&fairMessageCounter);
+	}
+	chachaBlock(fairSeed, (random->fairMessage << 32) | random->fairRoll, block);
+	random->fairRoll++;
+	return (int)(((uint64)block[0] * (uint64)span) >> 32) + startFrom + 1;
+}
+
+bool startFairMode(char* commitmentHex) {
+	unsigned char digest[SHA256_DIGEST_SIZE];
+	if (!readSystemEntropy(fairSeed, FAIR_SEED_SIZE)) {
+		return false;
+	}
+	sha256(fairSeed, FAIR_SEED_SIZE, digest);
+	toHex(digest, SHA256_DIGEST_SIZE, commitmentHex);
+	fairMessageCounter = 0;
+	fairModeActive = true;
+	return true;
+}
+
+void stopFairMode(char* seedHex) {
+	toHex(fairSeed, FAIR_SEED_SIZE, seedHex);
+	memset(fairSeed, 0, FAIR_SEED_SIZE);
+	fairModeActive = false;
+}
+
+/* Zu Beginn jeder Nachricht: legt fest, ob ihre Wuerfe aus dem fairen Modus kommen */
+void beginFairMessage(struct RandomState* random) {
+	random->fair = fairModeActive;
+	random->fairMessage = 0;
+	random->fairRoll = 0;
+}
+
+/*
+ * Allgemeiner Zufallsgenerator: xoshiro256** mit einmaligem Seed. Frueher wurde vor jedem Wurf srand() mit
+ * clock()/time()/getpid() aufgerufen, dadurch war kein Ergebnis reproduzierbar und Wuerfe innerhalb desselben
+ * clock()-Ticks waren korreliert. Mit seedRandomState() laesst sich die Folge fest vorgeben (Replay).
+ */
+static uint64 splitmix64(uint64* x) {
+	uint64 z = (*x += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+void seedRandomState(struct RandomState* random, uint64 seed) {
+	int i;
+	for (i = 0; i < 4; i++) {
+		random->state[i] = splitmix64(&seed);
+	}
+	random->seeded = true;
+	random->fair = false;
+}
+
+uint64 nextRandom(struct RandomState* random) {
+	uint64* s = random->state;
+	uint64 result, t;
+
+	if (!random->seeded) {
+		seedRandomState(random, ((uint64)mix(clock(), time(NULL), getpid()) << 32) ^ (uint64)(size_t)random);
+	}
+
+	result = s[1] * 5;
+	result = ((result << 7) | (result >> 57)) * 9;
+	t = s[1] << 17;
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = (s[3] << 45) | (s[3] >> 19);
+	return result;
+}
 
+/* Springt 2^128 Schritte weiter, so entstehen aus einem Generator beliebig viele nicht ueberlappende Teilfolgen */
+void jumpRandomState(struct RandomState* random) {
+	static const uint64 jump[4] = { 0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL, 0xa9582618e03ee9f6ULL, 0x39abdc4529b1661cULL };
+	uint64 s[4] = { 0, 0, 0, 0 };
+	int i, b, k;
 
-		srand(seed);
+	if (!random->seeded) {
+		nextRandom(random);
+	}
+	for (i = 0; i < 4; i++) {
+		for (b = 0; b < 64; b++) {
+			if (jump[i] & ((uint64)1 << b)) {
+				for (k = 0; k < 4; k++) {
+					s[k] ^= random->state[k];
+				}
+			}
+			nextRandom(random);
+		}
+	}
+	for (k = 0; k < 4; k++) {
+		random->state[k] = s[k];
+	}
+}
 
-		/* generate secret number between 1 and 10: */
-		number = rand() % span + startFrom + 1;
+int generateRandomNumber(struct RandomState* random, int startFrom, int span) {
+	if (span != 0) {
+		if (random->fair) {
+			return fairRandomNumber(random, startFrom, span);
+		}
 
-		return number;
+		/* Zahl zwischen startFrom + 1 und startFrom + span (Multiplikation statt Modulo, ohne Verzerrung durch rand()) */
+		return (int)(((nextRandom(random) >> 32) * (uint64)span) >> 32) + startFrom + 1;
 	}
 
 	return -1;
@@ -845,20 +1626,15 @@ unsigned long mix(unsigned long a, unsigned long b, unsigned long c)
 	return c;
 }
 
-int sizeOf(char* s) {
+int sizeOf(const char* s) {
 	int i = 0;
-	while (s[i] != NULL && s[i] != ' ') {
+	while (s[i] != '\0' && s[i] != ' ') {
 		i++;
 	}
 	return i;
 }
 
-void getSubStringOf(char* pString, int startChar, int span) {
-	memcpy(subString, &pString[startChar], span);
-	subString[span] = '\0';
-}
-
-bool isCommand(char* msg) {
+bool isCommand(const char* msg) {
 	if (msg[0] == '!') {
 		return true;
 	}
@@ -867,206 +1643,3946 @@ bool isCommand(char* msg) {
 	}
 }
 
-bool isDice(char* msg) {
-	if (contains(msg, 'w', 1) && !(contains(msg, 's', 1))) {
-		return true;
-	}
-	return false;
+/* Gleichverteilte Zahl aus (0, 1] mit 53 Bit Aufloesung */
+double uniformRandom(struct RandomState* random) {
+	return (double)((nextRandom(random) >> 11) + 1) * (1.0 / 9007199254740992.0);
 }
 
-bool isPlusSomething(char* msg) {
-	return contains(msg, '+', 3);
-}
+/*
+ * Explodierender Wuerfel: bei der hoechsten Augenzahl wird nachgewuerfelt und addiert, hoechstens cap mal.
+ * Statt Wurf fuer Wurf wird die Anzahl der Explosionen direkt aus der geometrischen Verteilung gezogen
+ * (P(mindestens k) = span^-k), danach folgt ein letzter Wurf ohne die hoechste Augenzahl. Das kostet pro
+ * Wuerfel konstant zwei Zufallszahlen, egal wie oft er explodiert. Im fairen Modus wird weiter einzeln
+ * gewuerfelt, damit jeder Wurf mit der veroeffentlichten Formel nachpruefbar bleibt.
+ * Ein W1 explodiert nie.
+ */
+int explodingDice(struct RandomState* random, int span, int cap, bool penetrating, int* explosions) {
+	int count = 0;
+	int last;
+
+	if (span <= 1) {
+		*explosions = 0;
+		return span;
+	}
+	if (random->fair) {
+		while ((last = generateRandomNumber(random, 0, span)) == span && count < cap) {
+			count++;
+		}
+	}
+	else {
+		double skipped = floor(log(uniformRandom(random)) / -log((double)span));
+		if (skipped >= cap) {
+			count = cap;
+			last = generateRandomNumber(random, 0, span);
+		}
+		else {
+			count = (int)skipped;
+			last = generateRandomNumber(random, 0, span - 1);
+		}
+	}
 
-bool isMinusSomething(char* msg) {
-	return contains(msg, '-', 3);
+	*explosions = count;
+	return count * span + last - (penetrating ? count : 0);
 }
 
-bool isMultipleDice(char* msg) {
-	if (contains(msg, 'w', 0) && msg[1] != 'w' && msg[1] != 's') {
-		return true;
+/*
+ * Gegenstueck zu explodingDice fuer Wuerfe anderer Clients: gibt die Anzahl der Explosionen zurueck, mit denen
+ * face fallen kann, sonst -1. Mit cap 0 ist es ein normaler W(span). Die hoechste Augenzahl im letzten Wurf
+ * gibt es nur, wenn cap erreicht ist.
+ */
+int explodedDie(int face, int span, int cap, bool penetrating) {
+	int step = penetrating ? span - 1 : span;
+	int count, last;
+
+	if (span <= 1) {
+		return face == span ? 0 : -1;
 	}
-	return false;
+	if (face < 1) {
+		return -1;
+	}
+	count = (face - 1) / step;
+	last = face - count * step;
+	if (penetrating && count == cap + 1 && last == 1) {
+		return cap;  /* cap Explosionen, danach noch einmal die hoechste Augenzahl */
+	}
+	if (count > cap || (!penetrating && last == span && count < cap)) {
+		return -1;
+	}
+	return count;
 }
 
-bool contains(char* msg, char c, int startPos) {
-	for (int i = startPos; i < sizeOf(msg); i++) {
-		if (msg[i] == c) {
-			return true;
-		}
-	}
-	return false;
+bool arenaInit(struct Arena* arena, size_t capacity) {
+	arena->base = (char*)malloc(capacity);
+	arena->used = 0;
+	arena->capacity = arena->base != NULL ? capacity : 0;
+	arena->highWater = 0;
+	return arena->base != NULL;
 }
 
-bool isSWWDice(char* msg) {
-	if (msg[1] == 's') {
-		if (msg[2] == 'w') {
-			if (msg[3] == 'w') {
-				return true;
-			}
-		}
-	}
-	return false;
+void arenaFree(struct Arena* arena) {
+	free(arena->base);
+	arena->base = NULL;
+	arena->capacity = 0;
 }
 
-int getPosOf(char* message, char c) {
-	for (int i = 0; i < sizeOf(message); i++) {
-		if (message[i] == c) {
-			return i;
-		}
+/* Gibt size Bytes (auf 16 Byte ausgerichtet) zurueck oder NULL, wenn die Arena voll ist */
+void* arenaAlloc(struct Arena* arena, size_t size) {
+	size_t offset = (arena->used + 15) & ~(size_t)15;
+	if (offset > arena->capacity || size > arena->capacity - offset) {
+		return NULL;
 	}
-	return -1;
+	arena->used = offset + size;
+	return arena->base + offset;
 }
 
-int explodingDice(int span) {
-	if (span == 1) {
-		return -1;
+/* Gibt den gesamten Arbeitsspeicher der letzten Nachricht frei und merkt sich den Hoechststand fuer die Messwerte */
+void arenaReset(struct Arena* arena) {
+	if (arena->used > arena->highWater) {
+		arena->highWater = arena->used;
 	}
+	arena->used = 0;
+}
 
-	int result = 0;
-	int tmpR = 0;
-	do {
-		tmpR = generateRandomNumber(0, span);
-		result = result + tmpR;
-	} while (tmpR == span);
+void outputInit(struct OutputBuilder* out, char* buffer, size_t capacity) {
+	out->data = buffer;
+	out->length = 0;
+	out->capacity = capacity;
+	buffer[0] = '\0';
+}
 
-	return result;
+void outputAppend(struct OutputBuilder* out, const char* format, ...) {
+	va_list args;
+	int written;
+
+	if (out->length + 1 >= out->capacity) {
+		return;
+	}
+	va_start(args, format);
+	written = vsnprintf(out->data + out->length, out->capacity - out->length, format, args);
+	va_end(args);
+	if (written < 0) {
+		out->data[out->length] = '\0';
+		return;
+	}
+	out->length += (size_t)written;
+	if (out->length >= out->capacity) {
+		out->length = out->capacity - 1;
+	}
 }
 
-bool isSetColor(char* msg) {
-	if (msg[1] == 'f') {
-		if (msg[2] == 'a') {
-			if (msg[3] == 'r') {
-				if (msg[4] == 'b') {
-					if (msg[5] == 'e') {
-						if (msg[6] == ' ') {
-							return true;
-						}
-					}
-				}
-			}
+/* Liest eine vorzeichenlose Zahl ab text[*pos]. Gibt false zurueck, wenn keine Ziffer folgt oder die Zahl zu gross ist. */
+static bool parseNumber(const char* text, int length, int* pos, int* value) {
+	int start = *pos;
+	int result = 0;
+	while (*pos < length && text[*pos] >= '0' && text[*pos] <= '9') {
+		if (result > MAX_SIDES) {
+			return false;
 		}
+		result = result * 10 + (text[*pos] - '0');
+		(*pos)++;
 	}
-	return false;
+	*value = result;
+	return *pos > start;
 }
 
-bool isFate(char* msg) {
-	if (msg[1] == 'f') {
+/* Optionaler Modifikator +[zahl] oder -[zahl] am Ende des Befehls */
+static bool parseModifier(const char* text, int length, int* pos, int* modifier) {
+	int sign;
+	*modifier = 0;
+	if (*pos == length) {
 		return true;
 	}
-	return false;
-}
-
-void getUserColor(int userID) {
-	if (!strcmp(userColorColor[userID], "")) {
-		char tmp[19999] = "black";
-		memcpy(tmpUserColor, &tmp[0], sizeOf(tmp));
-		subString[sizeOf(tmp)] = '\0';
-		return;
+	if (text[*pos] != '+' && text[*pos] != '-') {
+		return false;
 	}
-	else {
-		memcpy(tmpUserColor, &userColorColor[userID][0], sizeOf(userColorColor[userID]));
-		tmpUserColor[sizeOf(userColorColor[userID])] = '\0';
+	sign = text[*pos] == '-' ? -1 : 1;
+	(*pos)++;
+	if (!parseNumber(text, length, pos, modifier)) {
+		return false;
 	}
+	*modifier *= sign;
+	return true;
 }
 
-void setUserColor(int userID, char* color) {
-	memcpy(userColorColor[userID], &color[0], sizeOf(color));
-	userColorColor[userID][sizeOf(color)] = '\0';
+/* Legt die Arrays fuer count Wuerfel am Stueck in der Arena an */
+bool rollResultAlloc(struct Arena* arena, struct RollResult* roll, int count) {
+	char* block = (char*)arenaAlloc(arena, count * (2 * sizeof(int) + sizeof(unsigned char)));
+	if (block == NULL) {
+		return false;
+	}
+	roll->faces = (int*)block;
+	roll->explosions = (int*)(block + count * sizeof(int));
+	roll->flags = (unsigned char*)(block + 2 * count * sizeof(int));
+	return true;
 }
 
-bool setAn(char* msg) {
-	if (msg[0] == '!') {
-		if (msg[1] == 'a') {
-			if (msg[2] == 'n') {
-				return true;
+/* Markiert alle Wuerfel ausser den keep hoechsten (bzw. niedrigsten) als nicht gewertet */
+static void keepDice(struct RollResult* roll, int keep, bool lowest) {
+	int dropped, i;
+
+	for (dropped = 0; dropped < roll->count - keep; dropped++) {
+		int worst = -1;
+		for (i = 0; i < roll->count; i++) {
+			if (roll->flags[i] & DIE_DROPPED) {
+				continue;
+			}
+			if (worst < 0 || (lowest ? roll->faces[i] > roll->faces[worst] : roll->faces[i] < roll->faces[worst])) {
+				worst = i;
 			}
 		}
+		roll->flags[worst] |= DIE_DROPPED;
 	}
-	return false;
 }
 
-bool setAus(char* msg) {
-	if (msg[0] == '!') {
-		if (msg[1] == 'a') {
-			if (msg[2] == 'u') {
-				if (msg[3] == 's') {
-					return true;
-				}
-			}
+/* Summe der gewerteten Wuerfel, total = sum + modifier */
+static void sumKeptDice(struct RollResult* roll) {
+	int i;
+	roll->sum = 0;
+	for (i = 0; i < roll->count; i++) {
+		if (!(roll->flags[i] & DIE_DROPPED)) {
+			roll->sum += roll->faces[i];
 		}
 	}
-	return false;
+	roll->total = roll->sum + roll->modifier;
 }
 
-bool isGetVersion(char* msg) {
-	if (msg[0] == '!') {
-		if (msg[1] == 'v') {
-			if (msg[2] == 'e') {
-				if (msg[3] == 'r') {
-					if (msg[4] == 's') {
-						if (msg[5] == 'i') {
-							if (msg[6] == 'o') {
-								if (msg[7] == 'n') {
-									return true;
-								}
-							}
+/* Savage Worlds: ab 4 Erfolg, je 4 Punkte darueber eine Steigerung */
+static void formatSwwOutcome(struct OutputBuilder* out, int result) {
+	if (result < 4) {
+		outputAppend(out, " Fehlschlag um %d Punkt(e)", 4 - result);
+	}
+	else if (result < 8) {
+		outputAppend(out, " Erfolg");
+	}
+	else {
+		outputAppend(out, " Erfolg mit %d Steigerung(en)", (result - 4) / 4);
+	}
+}
+
+/***************************** ![zahl]w[zahl] *****************************/
+
+static bool parseDiceSystem(const char* text, int length, int* pos, struct DiceExpression* expr) {
+	if (*pos < length && text[*pos] != 'w') {
+		if (!parseNumber(text, length, pos, &expr->count)) {
+			return false;
+		}
+	}
+	if (*pos >= length || text[*pos] != 'w') {
+		return false;
+	}
+	(*pos)++;
+	if (!parseNumber(text, length, pos, &expr->sides) || expr->sides < 1 || expr->sides > MAX_SIDES) {
+		return false;
+	}
+	/* e[p][grenze]: explodierende Wuerfel */
+	if (*pos < length && text[*pos] == 'e') {
+		(*pos)++;
+		expr->explode = EXPLODE_COMPOUND;
+		if (*pos < length && text[*pos] == 'p') {
+			(*pos)++;
+			expr->explode = EXPLODE_PENETRATING;
+		}
+		if (*pos < length && text[*pos] >= '0' && text[*pos] <= '9'
+			&& (!parseNumber(text, length, pos, &expr->explosionCap) || expr->explosionCap > EXPLOSION_CAP_DEFAULT)) {
+			return false;
+		}
+	}
+	/* k[h][zahl] / kl[zahl]: nur die hoechsten bzw. niedrigsten Wuerfel werten */
+	if (*pos < length && text[*pos] == 'k') {
+		(*pos)++;
+		if (*pos < length && (text[*pos] == 'h' || text[*pos] == 'l')) {
+			expr->keepLowest = text[*pos] == 'l';
+			(*pos)++;
+		}
+		if (!parseNumber(text, length, pos, &expr->keep) || expr->keep < 1 || expr->keep > expr->count) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void rollDiceSystem(struct RandomState* random, const struct DiceExpression* expr, struct RollResult* roll) {
+	int i;
+	for (i = 0; i < roll->count; i++) {
+		if (expr->explode != EXPLODE_NONE) {
+			roll->faces[i] = explodingDice(random, expr->sides, expr->explosionCap, expr->explode == EXPLODE_PENETRATING, &roll->explosions[i]);
+		}
+		else {
+			roll->faces[i] = generateRandomNumber(random, 0, expr->sides);
+		}
+	}
+	if (expr->keep > 0) {
+		keepDice(roll, expr->keep, expr->keepLowest);
+	}
+	sumKeptDice(roll);
+}
+
+static bool checkDiceSystem(const struct DiceExpression* expr, struct RollResult* roll) {
+	int cap = expr->explode != EXPLODE_NONE ? expr->explosionCap : 0;
+	int i;
+	for (i = 0; i < roll->count; i++) {
+		if ((roll->explosions[i] = explodedDie(roll->faces[i], expr->sides, cap, expr->explode == EXPLODE_PENETRATING)) < 0) {
+			return false;
+		}
+	}
+	if (expr->keep > 0) {
+		keepDice(roll, expr->keep, expr->keepLowest);
+	}
+	sumKeptDice(roll);
+	roll->criticalFailure = 0;
+	return true;
+}
+
+/*
+ * Wuerfel als "6+5+3+[s]2[/s]": nicht gewertete Wuerfel durchgestrichen, explodierte mit "!". Bei grossen Pools
+ * werden drei oder mehr gleiche Wuerfel hintereinander als "4\u00d75" (UTF-8) zusammengefasst.
+ */
+static void formatFaces(struct OutputBuilder* out, const struct RollResult* roll) {
+	bool compress = roll->count >= RUN_COMPRESS_MIN_DICE;
+	int i, run;
+	for (i = 0; i < roll->count; i += run) {
+		const char* separator = i == 0 ? "" : "+";
+		const char* exploded = roll->flags[i] & DIE_EXPLODED ? "!" : "";
+		run = 1;
+		while (compress && i + run < roll->count && roll->faces[i + run] == roll->faces[i] && roll->flags[i + run] == roll->flags[i]) {
+			run++;
+		}
+		if (run < 3) {
+			run = 1;
+			outputAppend(out, roll->flags[i] & DIE_DROPPED ? "%s[s]%d%s[/s]" : "%s%d%s", separator, roll->faces[i], exploded);
+		}
+		else {
+			outputAppend(out, roll->flags[i] & DIE_DROPPED ? "%s[s]%d\xC3\x97%d%s[/s]" : "%s%d\xC3\x97%d%s", separator, run, roll->faces[i], exploded);
+		}
+	}
+}
+
+static void formatDiceSystem(struct OutputBuilder* out, const struct DiceExpression* expr, const struct RollResult* roll) {
+	outputAppend(out, " wuerfelt einen %.*s\n Ergebnis: %.*s(", expr->textLength, expr->text, expr->diceTextLength, expr->text);
+	formatFaces(out, roll);
+	outputAppend(out, ") Summe: ( %d%.*s ) = %d", roll->sum, expr->textLength - expr->diceTextLength, expr->text + expr->diceTextLength, roll->total);
+}
+
+static void rangeDiceSystem(const struct DiceExpression* expr, int64_t* low, int64_t* high) {
+	*low = expr->count + expr->modifier;
+	*high = (int64_t)expr->count * expr->sides * (expr->explode != EXPLODE_NONE ? 4 : 1) + expr->modifier;
+}
+
+/***************************** !sww[zahl] *****************************/
+
+static bool parseSwwSystem(const char* text, int length, int* pos, struct DiceExpression* expr) {
+	expr->count = 2;  /* Probewuerfel und Wildcardwuerfel */
+	return parseNumber(text, length, pos, &expr->sides) && expr->sides >= 1 && expr->sides <= MAX_SIDES;
+}
+
+/* Wertet Probe- und Wildcardwuerfel aus, true bei einem kritischen Fehlschlag (zweimal die 1) */
+static bool scoreSwwSystem(const struct DiceExpression* expr, struct RollResult* roll) {
+	roll->flags[1] = DIE_WILD | DIE_DROPPED;  /* zaehlt nicht zur Summe, hat eigenes Ergebnis */
+	sumKeptDice(roll);
+	roll->wildTotal = roll->faces[1] + expr->modifier;
+	return roll->wildTotal < 4 && roll->faces[0] == roll->faces[1] && roll->faces[1] == 1;
+}
+
+static void rollSwwSystem(struct RandomState* random, const struct DiceExpression* expr, struct RollResult* roll) {
+	//norm wuerfelwurf mit explosion
+	roll->faces[0] = explodingDice(random, expr->sides, expr->explosionCap, false, &roll->explosions[0]);
+
+	//wuerfelwurf mit w6 und explosion (Wildcardwuerfel)
+	roll->faces[1] = explodingDice(random, 6, EXPLOSION_CAP_DEFAULT, false, &roll->explosions[1]);
+	if (scoreSwwSystem(expr, roll)) {
+		roll->criticalFailure = generateRandomNumber(random, 0, 3);
+	}
+}
+
+/* Welche Meldung ein kritischer Fehlschlag bekommt, hat der Absender ausgewuerfelt, criticalFailure bleibt stehen */
+static bool checkSwwSystem(const struct DiceExpression* expr, struct RollResult* roll) {
+	roll->explosions[0] = explodedDie(roll->faces[0], expr->sides, expr->explosionCap, false);
+	roll->explosions[1] = explodedDie(roll->faces[1], 6, EXPLOSION_CAP_DEFAULT, false);
+	if (roll->explosions[0] < 0 || roll->explosions[1] < 0) {
+		return false;
+	}
+	return scoreSwwSystem(expr, roll) ? roll->criticalFailure >= 1 && roll->criticalFailure <= 3 : roll->criticalFailure == 0;
+}
+
+static void formatSwwSystem(struct OutputBuilder* out, const struct DiceExpression* expr, const struct RollResult* roll) {
+	const char* modifierText = expr->text + expr->diceTextLength;
+	int modifierLength = expr->textLength - expr->diceTextLength;
+
+	outputAppend(out, " Wildcard Eigenschafts Probe: \nProbewuerfel		W%.*s	(%d) 	%d%.*s=%d",
+		expr->diceTextLength - 3, expr->text + 3, roll->faces[0], roll->faces[0], modifierLength, modifierText, roll->total);
+	formatSwwOutcome(out, roll->total);
+	outputAppend(out, "\nWildcardwuerfel	W6	(%d) 	%d%.*s=%d", roll->faces[1], roll->faces[1], modifierLength, modifierText, roll->wildTotal);
+	formatSwwOutcome(out, roll->wildTotal);
+	switch (roll->criticalFailure) {
+	case 0:
+		break;
+	case 1:
+		outputAppend(out, "\n-Kritischer Fehlschlag!-");
+		break;
+	case 2:
+		outputAppend(out, "\n-Schwerer Kritischer Fehlschlag!-");
+		break;
+	default:
+		outputAppend(out, "\n-Fehlschlag!-");
+		break;
+	}
+}
+
+/* Es zaehlt der bessere von Probe- und Wildcardwuerfel */
+static int valueSwwSystem(const struct RollResult* roll) {
+	return roll->wildTotal > roll->total ? roll->wildTotal : roll->total;
+}
+
+static void rangeSwwSystem(const struct DiceExpression* expr, int64_t* low, int64_t* high) {
+	/* explodierende Wuerfel sind nach oben offen, 8 Explosionen decken praktisch alles ab */
+	*low = -1 + expr->modifier;
+	*high = (int64_t)(expr->sides > 6 ? expr->sides : 6) * 8 + expr->modifier;
+}
+
+/***************************** !f[zahl] *****************************/
+
+/* Alle 3^4 Wuerfe von 4dF: Wurf i hat die Ziffern von i zur Basis 3 (minus 1) als Wuerfel, letzte Spalte ist die Summe */
+static const signed char fateRolls[81][5] = {
+	{ -1, -1, -1, -1, -4 }, {  0, -1, -1, -1, -3 }, {  1, -1, -1, -1, -2 },
+	{ -1,  0, -1, -1, -3 }, {  0,  0, -1, -1, -2 }, {  1,  0, -1, -1, -1 },
+	{ -1,  1, -1, -1, -2 }, {  0,  1, -1, -1, -1 }, {  1,  1, -1, -1,  0 },
+	{ -1, -1,  0, -1, -3 }, {  0, -1,  0, -1, -2 }, {  1, -1,  0, -1, -1 },
+	{ -1,  0,  0, -1, -2 }, {  0,  0,  0, -1, -1 }, {  1,  0,  0, -1,  0 },
+	{ -1,  1,  0, -1, -1 }, {  0,  1,  0, -1,  0 }, {  1,  1,  0, -1,  1 },
+	{ -1, -1,  1, -1, -2 }, {  0, -1,  1, -1, -1 }, {  1, -1,  1, -1,  0 },
+	{ -1,  0,  1, -1, -1 }, {  0,  0,  1, -1,  0 }, {  1,  0,  1, -1,  1 },
+	{ -1,  1,  1, -1,  0 }, {  0,  1,  1, -1,  1 }, {  1,  1,  1, -1,  2 },
+	{ -1, -1, -1,  0, -3 }, {  0, -1, -1,  0, -2 }, {  1, -1, -1,  0, -1 },
+	{ -1,  0, -1,  0, -2 }, {  0,  0, -1,  0, -1 }, {  1,  0, -1,  0,  0 },
+	{ -1,  1, -1,  0, -1 }, {  0,  1, -1,  0,  0 }, {  1,  1, -1,  0,  1 },
+	{ -1, -1,  0,  0, -2 }, {  0, -1,  0,  0, -1 }, {  1, -1,  0,  0,  0 },
+	{ -1,  0,  0,  0, -1 }, {  0,  0,  0,  0,  0 }, {  1,  0,  0,  0,  1 },
+	{ -1,  1,  0,  0,  0 }, {  0,  1,  0,  0,  1 }, {  1,  1,  0,  0,  2 },
+	{ -1, -1,  1,  0, -1 }, {  0, -1,  1,  0,  0 }, {  1, -1,  1,  0,  1 },
+	{ -1,  0,  1,  0,  0 }, {  0,  0,  1,  0,  1 }, {  1,  0,  1,  0,  2 },
+	{ -1,  1,  1,  0,  1 }, {  0,  1,  1,  0,  2 }, {  1,  1,  1,  0,  3 },
+	{ -1, -1, -1,  1, -2 }, {  0, -1, -1,  1, -1 }, {  1, -1, -1,  1,  0 },
+	{ -1,  0, -1,  1, -1 }, {  0,  0, -1,  1,  0 }, {  1,  0, -1,  1,  1 },
+	{ -1,  1, -1,  1,  0 }, {  0,  1, -1,  1,  1 }, {  1,  1, -1,  1,  2 },
+	{ -1, -1,  0,  1, -1 }, {  0, -1,  0,  1,  0 }, {  1, -1,  0,  1,  1 },
+	{ -1,  0,  0,  1,  0 }, {  0,  0,  0,  1,  1 }, {  1,  0,  0,  1,  2 },
+	{ -1,  1,  0,  1,  1 }, {  0,  1,  0,  1,  2 }, {  1,  1,  0,  1,  3 },
+	{ -1, -1,  1,  1,  0 }, {  0, -1,  1,  1,  1 }, {  1, -1,  1,  1,  2 },
+	{ -1,  0,  1,  1,  1 }, {  0,  0,  1,  1,  2 }, {  1,  0,  1,  1,  3 },
+	{ -1,  1,  1,  1,  2 }, {  0,  1,  1,  1,  3 }, {  1,  1,  1,  1,  4 }
+};
+
+/* Fate-Leiter von -2 (Fuerchterlich) bis +8 (Legendaer) */
+static const char* fateLadder[] = {
+	"Fuerchterlich", "Schwach", "Maessig", "Durchschnittlich", "Ordentlich", "Gut", "Grossartig", "Hervorragend",
+	"Fantastisch", "Episch", "Legendaer"
+};
+
+static bool parseFateSystem(const char* text, int length, int* pos, struct DiceExpression* expr) {
+	expr->count = 4;
+	expr->sides = 3;
+	/* "!f4" ist eine Kurzform fuer "!f+4" */
+	if (*pos < length && text[*pos] >= '0' && text[*pos] <= '9') {
+		return parseNumber(text, length, pos, &expr->modifier);
+	}
+	return true;
+}
+
+static void rollFateSystem(struct RandomState* random, const struct DiceExpression* expr, struct RollResult* roll) {
+	/* ein Zufallswert fuer alle vier Wuerfel */
+	const signed char* fate = fateRolls[generateRandomNumber(random, -1, 81)];
+	int i;
+	for (i = 0; i < 4; i++) {
+		roll->faces[i] = fate[i];
+	}
+	roll->sum = fate[4];
+	roll->total = roll->sum + roll->modifier;
+}
+
+static bool checkFateSystem(const struct DiceExpression* expr, struct RollResult* roll) {
+	int i;
+	for (i = 0; i < 4; i++) {
+		if (roll->faces[i] < -1 || roll->faces[i] > 1) {
+			return false;
+		}
+	}
+	sumKeptDice(roll);
+	roll->criticalFailure = 0;
+	return true;
+}
+
+static void formatFateSystem(struct OutputBuilder* out, const struct DiceExpression* expr, const struct RollResult* roll) {
+	int rung = roll->total + 2;
+	outputAppend(out, " Fate Fertigkeitsprobe: \nWurf: %d %d %d %d  >>  %d  >>  %d+%.*s=%d (%s%s)",
+		roll->faces[0], roll->faces[1], roll->faces[2], roll->faces[3], roll->sum, roll->sum,
+		expr->textLength - 1, expr->text + 1, roll->total,
+		rung < 0 ? "unter " : rung > 10 ? "ueber " : "", fateLadder[rung < 0 ? 0 : rung > 10 ? 10 : rung]);
+}
+
+static void rangeFateSystem(const struct DiceExpression* expr, int64_t* low, int64_t* high) {
+	*low = -4 + expr->modifier;
+	*high = 4 + expr->modifier;
+}
+
+/***************************** !dsa[e1]/[e2]/[e3]+[fw] *****************************/
+
+/*
+ * DSA-Probe auf drei Eigenschaften: je ein W20 pro Eigenschaft, Augen ueber der Eigenschaft werden mit dem
+ * Fertigkeitswert (FW) ausgeglichen. total ist der FW-Rest, negativ bei einer misslungenen Probe.
+ * Zwei oder drei 1en sind ein kritischer Erfolg, zwei oder drei 20en ein Patzer. Ein Modifikator nach dem FW
+ * ist eine Erleichterung (+) bzw. Erschwernis (-) auf alle drei Eigenschaften.
+ */
+static bool parseDsaSystem(const char* text, int length, int* pos, struct DiceExpression* expr) {
+	int i;
+	expr->count = 3;
+	expr->sides = 20;
+	for (i = 0; i < 3; i++) {
+		if ((i > 0 && (*pos >= length || text[(*pos)++] != '/'))
+			|| !parseNumber(text, length, pos, &expr->targets[i]) || expr->targets[i] < 1 || expr->targets[i] > MAX_DSA_VALUE) {
+			return false;
+		}
+	}
+	if (*pos < length && text[*pos] == '+') {
+		(*pos)++;
+		return parseNumber(text, length, pos, &expr->skill) && expr->skill <= MAX_DSA_VALUE;
+	}
+	return true;
+}
+
+/* Ueberschuss, FW-Rest und kritische Ergebnisse aus den drei W20 */
+static void scoreDsaSystem(const struct DiceExpression* expr, struct RollResult* roll) {
+	int ones = 0, twenties = 0;
+	int i;
+
+	roll->sum = 0;
+	for (i = 0; i < 3; i++) {
+		if (roll->faces[i] > expr->targets[i] + expr->modifier) {
+			roll->sum += roll->faces[i] - expr->targets[i] - expr->modifier;  /* Ueberschuss */
+		}
+		ones += roll->faces[i] == 1;
+		twenties += roll->faces[i] == 20;
+	}
+	roll->total = expr->skill - roll->sum;
+	roll->criticalSuccess = ones >= 2;
+	roll->criticalFailure = ones < 2 && twenties >= 2;
+	if (roll->criticalSuccess) {
+		if (roll->total < 0) {
+			roll->total = 0;
+		}
+	}
+	else if (roll->criticalFailure) {
+		if (roll->total >= 0) {
+			roll->total = -1;
+		}
+	}
+}
+
+static void rollDsaSystem(struct RandomState* random, const struct DiceExpression* expr, struct RollResult* roll) {
+	int i;
+	for (i = 0; i < 3; i++) {
+		roll->faces[i] = generateRandomNumber(random, 0, 20);
+	}
+	scoreDsaSystem(expr, roll);
+}
+
+static bool checkDsaSystem(const struct DiceExpression* expr, struct RollResult* roll) {
+	int i;
+	for (i = 0; i < 3; i++) {
+		if (roll->faces[i] < 1 || roll->faces[i] > 20) {
+			return false;
+		}
+	}
+	scoreDsaSystem(expr, roll);
+	return true;
+}
+
+static void formatDsaSystem(struct OutputBuilder* out, const struct DiceExpression* expr, const struct RollResult* roll) {
+	outputAppend(out, " DSA-Probe %d/%d/%d FW %d", expr->targets[0], expr->targets[1], expr->targets[2], expr->skill);
+	if (expr->modifier != 0) {
+		outputAppend(out, expr->modifier > 0 ? " Erleichterung %d" : " Erschwernis %d", expr->modifier > 0 ? expr->modifier : -expr->modifier);
+	}
+	outputAppend(out, ": \nWurf: %d %d %d  >>  Ueberschuss %d  >>  ", roll->faces[0], roll->faces[1], roll->faces[2], roll->sum);
+	if (roll->total >= 0) {
+		/* Qualitaetsstufe: je angefangene 3 Punkte FW-Rest, mindestens 1, hoechstens 6 */
+		int quality = roll->total == 0 ? 1 : (roll->total + 2) / 3;
+		outputAppend(out, "Gelungen, FW-Rest %d, QS %d", roll->total, quality > 6 ? 6 : quality);
+	}
+	else {
+		outputAppend(out, "Misslungen um %d Punkt(e)", -roll->total);
+	}
+	if (roll->criticalSuccess) {
+		outputAppend(out, "\n-Kritischer Erfolg!-");
+	}
+	else if (roll->criticalFailure) {
+		outputAppend(out, "\n-Patzer!-");
+	}
+}
+
+static void rangeDsaSystem(const struct DiceExpression* expr, int64_t* low, int64_t* high) {
+	int i;
+	*low = expr->skill;
+	*high = expr->skill;
+	for (i = 0; i < 3; i++) {
+		int excess = 20 - expr->targets[i] - expr->modifier;
+		*low -= excess > 0 ? excess : 0;
+	}
+	if (*low > -1) {
+		*low = -1;  /* Patzer */
+	}
+}
+
+/***************************** !sr[zahl][e] *****************************/
+
+/*
+ * Shadowrun-Probe: ein Pool aus W6, jede 5 und 6 ist ein Erfolg. Ist mehr als die Haelfte der Wuerfel eine 1,
+ * ist die Probe ein Patzer, ohne Erfolg ein kritischer Patzer. Mit "e" (Edge) explodieren 6en, jede 6 bleibt
+ * ein Erfolg. +/-[zahl] veraendert den Pool.
+ */
+static bool parseShadowrunSystem(const char* text, int length, int* pos, struct DiceExpression* expr) {
+	int change = 0;
+	expr->sides = 6;
+	if (!parseNumber(text, length, pos, &expr->count)) {
+		return false;
+	}
+	if (*pos < length && text[*pos] == 'e') {
+		(*pos)++;
+		expr->explode = EXPLODE_COMPOUND;
+	}
+	if (!parseModifier(text, length, pos, &change) || change < -MAX_DICE || change > MAX_DICE) {
+		return false;
+	}
+	expr->count += change;
+	return true;
+}
+
+/* Erfolge und Patzer aus faces und explosions */
+static void scoreShadowrunSystem(struct RollResult* roll) {
+	int ones = 0;
+	int i;
+
+	roll->total = 0;
+	for (i = 0; i < roll->count; i++) {
+		int last = roll->faces[i] - roll->explosions[i] * 6;
+		roll->total += roll->explosions[i] + (last >= 5);
+		ones += roll->faces[i] == 1;
+	}
+	roll->sum = roll->total;
+	roll->criticalFailure = ones * 2 <= roll->count ? 0 : roll->total == 0 ? 2 : 1;
+}
+
+static void rollShadowrunSystem(struct RandomState* random, const struct DiceExpression* expr, struct RollResult* roll) {
+	int i;
+	for (i = 0; i < roll->count; i++) {
+		if (expr->explode != EXPLODE_NONE) {
+			roll->faces[i] = explodingDice(random, 6, expr->explosionCap, false, &roll->explosions[i]);
+		}
+		else {
+			roll->faces[i] = generateRandomNumber(random, 0, 6);
+		}
+	}
+	scoreShadowrunSystem(roll);
+}
+
+static bool checkShadowrunSystem(const struct DiceExpression* expr, struct RollResult* roll) {
+	int cap = expr->explode != EXPLODE_NONE ? expr->explosionCap : 0;
+	int i;
+	for (i = 0; i < roll->count; i++) {
+		if ((roll->explosions[i] = explodedDie(roll->faces[i], 6, cap, false)) < 0) {
+			return false;
+		}
+	}
+	scoreShadowrunSystem(roll);
+	return true;
+}
+
+static void formatShadowrunSystem(struct OutputBuilder* out, const struct DiceExpression* expr, const struct RollResult* roll) {
+	int i;
+	outputAppend(out, " Shadowrun Probe mit %d Wuerfel(n)%s: \nWurf:", roll->count, expr->explode != EXPLODE_NONE ? " und Edge" : "");
+	for (i = 0; i < roll->count; i++) {
+		outputAppend(out, " %d%s", roll->faces[i], roll->flags[i] & DIE_EXPLODED ? "!" : "");
+	}
+	outputAppend(out, "  >>  %d Erfolg(e)", roll->total);
+	if (roll->criticalFailure == 2) {
+		outputAppend(out, "\n-Kritischer Patzer!-");
+	}
+	else if (roll->criticalFailure == 1) {
+		outputAppend(out, "\n-Patzer!-");
+	}
+}
+
+static void rangeShadowrunSystem(const struct DiceExpression* expr, int64_t* low, int64_t* high) {
+	*low = 0;
+	*high = (int64_t)expr->count * (expr->explode != EXPLODE_NONE ? 3 : 1);
+}
+
+/***************************** Registry *****************************/
+
+/*
+ * Traegt ein Spielsystem ein. Systeme mit gleichem Anfangsbuchstaben haengen in einer Kette, laengere
+ * Schluesselwoerter zuerst ("sww" vor "sr"). Das System ohne Schluesselwort ist der Standard ![zahl]w[zahl].
+ * Nur beim Initialisieren aufrufen, die Tabelle wird danach ohne Sperre gelesen.
+ */
+bool registerGameSystem(const struct GameSystem* system) {
+	struct GameSystem* entry;
+	struct GameSystem** link;
+
+	if (gameSystemCount == MAX_GAME_SYSTEMS) {
+		return false;
+	}
+	entry = &gameSystems[gameSystemCount++];
+	*entry = *system;
+	entry->next = NULL;
+	if (entry->keyword[0] == '\0') {
+		defaultGameSystem = entry;
+		return true;
+	}
+	link = &gameSystemTable[(unsigned char)entry->keyword[0] & 127];
+	while (*link != NULL && strlen((*link)->keyword) >= strlen(entry->keyword)) {
+		link = &(*link)->next;
+	}
+	entry->next = *link;
+	*link = entry;
+	return true;
+}
+
+void registerGameSystems() {
+	static const struct GameSystem builtin[] = {
+		{ "f", "!f - Fate Wurf",
+			METRIC_CMD_FATE, parseFateSystem, rollFateSystem, checkFateSystem, formatFateSystem, NULL, rangeFateSystem, false, 0, NULL },
+		{ "", "![zahl]w[zahl]+/-[zahl] - Wuerfelt die angegebene Zahl an Wuerfeln\n"
+			"![zahl]w[zahl]kh[zahl] / kl[zahl] - Wertet nur die hoechsten bzw. niedrigsten Wuerfel, z.B. !4w6kh3\n"
+			"![zahl]w[zahl]e[p][grenze]+/-[zahl] - Explodierende Wuerfel (e: addiert, ep: jeder Zusatzwurf -1, grenze: hoechstens so viele Explosionen pro Wuerfel, Standard 100)",
+			METRIC_CMD_DICE, parseDiceSystem, rollDiceSystem, checkDiceSystem, formatDiceSystem, NULL, rangeDiceSystem, false, 0, NULL },
+		{ "sww", "!sww[zahl]+/-[zahl] - Savage Worlds Wurf",
+			METRIC_CMD_SWW, parseSwwSystem, rollSwwSystem, checkSwwSystem, formatSwwSystem, valueSwwSystem, rangeSwwSystem, true, 4, NULL },
+		{ "dsa", "!dsa[eigenschaft]/[eigenschaft]/[eigenschaft]+[fw]+/-[zahl] - DSA-Probe mit 3W20, Modifikator ist Erleichterung/Erschwernis, z.B. !dsa12/14/13+7-2",
+			METRIC_CMD_DSA, parseDsaSystem, rollDsaSystem, checkDsaSystem, formatDsaSystem, NULL, rangeDsaSystem, true, 0, NULL },
+		{ "sr", "!sr[zahl][e]+/-[zahl] - Shadowrun Probe, zaehlt Erfolge (5 und 6), e: Edge, 6en explodieren",
+			METRIC_CMD_SHADOWRUN, parseShadowrunSystem, rollShadowrunSystem, checkShadowrunSystem, formatShadowrunSystem, NULL, rangeShadowrunSystem, true, 1, NULL }
+	};
+	int i;
+
+	gameSystemCount = 0;
+	defaultGameSystem = NULL;
+	memset((void*)gameSystemTable, 0, sizeof(gameSystemTable));
+	for (i = 0; i < (int)(sizeof(builtin) / sizeof(builtin[0])); i++) {
+		registerGameSystem(&builtin[i]);
+	}
+}
+
+/* Sucht das Spielsystem zum Befehl, ohne passendes Schluesselwort das Standardsystem */
+static const struct GameSystem* findGameSystem(const char* text, int length) {
+	const struct GameSystem* system = gameSystemTable[(unsigned char)text[0] & 127];
+	for (; system != NULL; system = system->next) {
+		size_t keywordLength = strlen(system->keyword);
+		if ((size_t)length >= keywordLength && strncmp(text, system->keyword, keywordLength) == 0) {
+			return system;
+		}
+	}
+	return defaultGameSystem;
+}
+
+/*
+ * Zerlegt einen Wuerfelbefehl (text ohne '!', length Zeichen). Das Spielsystem wird ueber sein
+ * Schluesselwort gefunden und zerlegt den Rest, ein abschliessender Modifikator +/-[zahl] wird hier gelesen.
+ * Gibt false bei einem Syntaxfehler oder bei Werten ausserhalb von MAX_DICE, MAX_SIDES und MAX_MODIFIER zurueck.
+ */
+bool parseDiceExpression(const char* text, int length, struct DiceExpression* expr) {
+	int pos;
+	int modifier;
+
+	expr->text = text;
+	expr->textLength = length;
+	expr->count = 1;
+	expr->sides = 0;
+	expr->modifier = 0;
+	expr->explode = EXPLODE_NONE;
+	expr->explosionCap = EXPLOSION_CAP_DEFAULT;
+	expr->keep = 0;
+	expr->keepLowest = false;
+	expr->skill = 0;
+	expr->system = findGameSystem(text, length);
+	if (expr->system == NULL) {
+		return false;
+	}
+
+	pos = (int)strlen(expr->system->keyword);
+	if (!expr->system->parse(text, length, &pos, expr)) {
+		return false;
+	}
+	expr->diceTextLength = pos;
+	if (!parseModifier(text, length, &pos, &modifier) || pos != length) {
+		return false;
+	}
+	expr->modifier += modifier;
+
+	/* Summe aller Wuerfel muss auch bei vielen Explosionen in int passen */
+	if (expr->sides >= 1 && expr->count >= 1 && expr->sides <= MAX_SIDES && expr->count <= MAX_DICE) {
+		int limit = MAX_EXPLODING_TOTAL / (expr->count * expr->sides) - 1;
+		if (expr->explosionCap > limit) {
+			expr->explosionCap = limit > 0 ? limit : 0;
+		}
+	}
+	return expr->count >= 1 && expr->count <= MAX_DICE
+		&& expr->modifier >= -MAX_MODIFIER && expr->modifier <= MAX_MODIFIER;
+}
+
+/* Wuerfelt expr mit seinem Spielsystem aus, roll muss Platz fuer expr->count Wuerfel haben */
+void rollDice(struct RandomState* random, const struct DiceExpression* expr, struct RollResult* roll) {
+	int i;
+
+	roll->count = expr->count;
+	roll->sum = 0;
+	roll->modifier = expr->modifier;
+	roll->total = 0;
+	roll->wildTotal = 0;
+	roll->criticalFailure = 0;
+	roll->criticalSuccess = 0;
+	for (i = 0; i < roll->count; i++) {
+		roll->explosions[i] = 0;
+		roll->flags[i] = 0;
+	}
+
+	expr->system->roll(random, expr, roll);
+
+	for (i = 0; i < roll->count; i++) {
+		if (roll->explosions[i] > 0) {
+			roll->flags[i] |= DIE_EXPLODED;
+		}
+	}
+}
+
+/*
+ * Gegenstueck zu rollDice fuer Wuerfe anderer Clients: faces (und criticalFailure, siehe GameSystem.check) kommen
+ * vom Absender, alles andere wird hier berechnet. Gibt false zurueck, wenn die Augen so nicht fallen koennen.
+ */
+bool checkDice(const struct DiceExpression* expr, struct RollResult* roll) {
+	int i;
+
+	roll->count = expr->count;
+	roll->sum = 0;
+	roll->modifier = expr->modifier;
+	roll->total = 0;
+	roll->wildTotal = 0;
+	roll->criticalSuccess = 0;
+	for (i = 0; i < roll->count; i++) {
+		roll->explosions[i] = 0;
+		roll->flags[i] = 0;
+	}
+
+	if (!expr->system->check(expr, roll)) {
+		return false;
+	}
+
+	for (i = 0; i < roll->count; i++) {
+		if (roll->explosions[i] > 0) {
+			roll->flags[i] |= DIE_EXPLODED;
+		}
+	}
+	return true;
+}
+
+void formatRoll(struct OutputBuilder* out, const struct DiceExpression* expr, const struct RollResult* roll) {
+	expr->system->format(out, expr, roll);
+}
+
+/* Ergebnis eines Wurfes fuer Simulation und Statistik */
+int rollValue(const struct DiceExpression* expr, const struct RollResult* roll) {
+	return expr->system->value != NULL ? expr->system->value(roll) : roll->total;
+}
+
+/* Haengt im fairen Modus die Nachrichtennummer an, damit jeder Wurf nach dem Aufdecken pruefbar ist */
+void appendFairTag(struct OutputBuilder* out, uint64 fairMessage) {
+	if (fairMessage != 0) {
+		outputAppend(out, " [Fair #%llu]", (unsigned long long)fairMessage);
+	}
+}
+
+static const struct DiceExpression* batchExpression(const struct RollBatch* batch, int roll) {
+	return &batch->exprs[batch->repeat ? 0 : roll];
+}
+
+/* Ausfuehrliche Ausgabe aller Wuerfe, eine Wiederholung als Tabelle mit einer Zeile pro Wurf */
+void formatBatch(struct OutputBuilder* out, const struct RollBatch* batch) {
+	int r;
+
+	if (batch->repeat) {
+		int64_t total = 0;
+		outputAppend(out, " wuerfelt %dx %.*s", batch->count, batch->exprs[0].textLength, batch->exprs[0].text);
+		for (r = 0; r < batch->count; r++) {
+			int value = rollValue(&batch->exprs[0], &batch->rolls[r]);
+			total += value;
+			outputAppend(out, "\n%3d: %d  (", r + 1, value);
+			formatFaces(out, &batch->rolls[r]);
+			outputAppend(out, ")");
+		}
+		outputAppend(out, "\nSumme: %lld, Mittelwert: %.2f", (long long)total, (double)total / batch->count);
+	}
+	else {
+		for (r = 0; r < batch->count; r++) {
+			if (r > 0) {
+				outputAppend(out, "\n");
+			}
+			formatRoll(out, &batch->exprs[r], &batch->rolls[r]);
+		}
+	}
+	appendFairTag(out, batch->fairMessage);
+}
+
+/* Kurzfassung fuer den Chat im kompakten Modus: nur Ausdruck und Ergebnis je Wurf */
+static void formatBatchSummary(struct OutputBuilder* out, const struct RollBatch* batch) {
+	int r;
+
+	if (batch->repeat) {
+		outputAppend(out, " %dx %.*s:", batch->count, batch->exprs[0].textLength, batch->exprs[0].text);
+	}
+	for (r = 0; r < batch->count; r++) {
+		const struct DiceExpression* expr = batchExpression(batch, r);
+		if (batch->repeat) {
+			outputAppend(out, "%s %d", r == 0 ? "" : ",", rollValue(expr, &batch->rolls[r]));
+		}
+		else {
+			outputAppend(out, "%s %.*s = %d", r == 0 ? "" : " |", expr->textLength, expr->text, rollValue(expr, &batch->rolls[r]));
+		}
+	}
+	appendFairTag(out, batch->fairMessage);
+}
+
+bool isSetColor(const char* msg) {
+	if (msg[1] == 'f') {
+		if (msg[2] == 'a') {
+			if (msg[3] == 'r') {
+				if (msg[4] == 'b') {
+					if (msg[5] == 'e') {
+						if (msg[6] == ' ') {
+							return true;
 						}
 					}
 				}
 			}
 		}
 	}
-	return false;
+	return false;
+}
+
+/* Die Farben stehen wie die Client-Tabellen unter clientMapMutex, Shards und Callback-Thread lesen sie gleichzeitig */
+void getUserColor(struct DiceContext* ctx, int userID) {
+	mutexLock(&clientMapMutex);
+	if (userID < 0 || userID >= CLIENT_ID_COUNT || !strcmp(userColorColor[userID], "")) {
+		_strcpy(ctx->userColor, COLOR_BUFSIZE, "black");
+	}
+	else {
+		_strcpy(ctx->userColor, COLOR_BUFSIZE, userColorColor[userID]);
+	}
+	mutexUnlock(&clientMapMutex);
+}
+
+/* Uebernimmt die Farbe bis zum ersten Leerzeichen, zu lange Farbnamen werden abgeschnitten */
+void setUserColor(int userID, const char* color) {
+	int length = sizeOf(color);
+	if (userID < 0 || userID >= CLIENT_ID_COUNT) {
+		return;
+	}
+	if (length > COLOR_BUFSIZE - 1) {
+		length = COLOR_BUFSIZE - 1;
+	}
+	mutexLock(&clientMapMutex);
+	memcpy(userColorColor[userID], &color[0], length);
+	userColorColor[userID][length] = '\0';
+	mutexUnlock(&clientMapMutex);
+}
+
+bool setAn(const char* msg) {
+	if (msg[0] == '!') {
+		if (msg[1] == 'a') {
+			if (msg[2] == 'n') {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+bool setAus(const char* msg) {
+	if (msg[0] == '!') {
+		if (msg[1] == 'a') {
+			if (msg[2] == 'u') {
+				if (msg[3] == 's') {
+					return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+bool isGetVersion(const char* msg) {
+	if (msg[0] == '!') {
+		if (msg[1] == 'v') {
+			if (msg[2] == 'e') {
+				if (msg[3] == 'r') {
+					if (msg[4] == 's') {
+						if (msg[5] == 'i') {
+							if (msg[6] == 'o') {
+								if (msg[7] == 'n') {
+									return true;
+								}
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+	return false;
+}
+
+bool isHelp(const char* msg) {
+	if (msg[0] == '!') {
+		if (msg[1] == 'h') {
+			if (msg[2] == 'e') {
+				if (msg[3] == 'l') {
+					if (msg[4] == 'p') {
+						return true;
+					}
+				}
+			}
+		}
+	}
+	return false;
+}
+
+bool isFairMode(const char* msg) {
+	return strncmp(msg, "!fair ", 6) == 0;
+}
+
+bool isCompactMode(const char* msg) {
+	return strncmp(msg, "!kompakt ", 9) == 0;
+}
+
+bool isSimulation(const char* msg) {
+	return strncmp(msg, "!sim", 4) == 0 && (msg[4] == ' ' || msg[4] == '\0');
+}
+
+bool isTrace(const char* msg) {
+	return strncmp(msg, "!trace", 6) == 0;
+}
+
+bool isMetrics(const char* msg) {
+	return strncmp(msg, "!metrics", 8) == 0;
+}
+
+bool isOpenPrivatChat(const char* msg) {
+	if (msg[0] == '!') {
+		if (msg[1] == 'p') {
+			if (msg[2] == 'm') {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+/* Kontext des aufrufenden Threads, wird beim ersten Aufruf angelegt */
+static THREAD_LOCAL struct DiceContext* threadDiceContext = NULL;
+static THREAD_LOCAL uint64 threadDiceContextGeneration = 0;
+
+struct DiceContext* getThreadDiceContext() {
+	/* Nach freeDiceContexts zeigt threadDiceContext in anderen Threads auf freigegebenen Speicher */
+	if (threadDiceContext == NULL || threadDiceContextGeneration != diceContextGeneration) {
+		struct DiceContext* ctx = (struct DiceContext*)calloc(1, sizeof(struct DiceContext));
+		if (ctx == NULL || !arenaInit(&ctx->arena, ARENA_SIZE)) {
+			free(ctx);
+			threadDiceContext = NULL;
+			return NULL;
+		}
+		ctx->generation = diceContextGeneration;
+		ctx->threadNumber = (uint32_t)atomicIncrement64(&diceContextCounter);
+		do {
+			ctx->next = diceContextList;
+		} while (!atomicCompareExchangePointer(&diceContextList, ctx->next, ctx));
+		threadDiceContext = ctx;
+		threadDiceContextGeneration = ctx->generation;
+	}
+	return threadDiceContext;
+}
+
+/* Gibt die Kontexte aller Threads frei, nur aufrufen wenn keine Nachricht mehr verarbeitet wird */
+void freeDiceContexts() {
+	struct DiceContext* ctx = diceContextList;
+	diceContextList = NULL;
+	diceContextGeneration++;
+	while (ctx != NULL) {
+		struct DiceContext* next = ctx->next;
+		arenaFree(&ctx->arena);
+		free(ctx);
+		ctx = next;
+	}
+	threadDiceContext = NULL;
+}
+
+/* Monotone Uhr in Nanosekunden fuer die Instrumentierung */
+uint64 monotonicNanos() {
+#ifdef _WIN32
+	static LARGE_INTEGER frequency;
+	LARGE_INTEGER now;
+	if (frequency.QuadPart == 0) {
+		QueryPerformanceFrequency(&frequency);
+	}
+	QueryPerformanceCounter(&now);
+	return (uint64)(now.QuadPart / frequency.QuadPart) * 1000000000u
+		+ (uint64)(now.QuadPart % frequency.QuadPart) * 1000000000u / (uint64)frequency.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64)ts.tv_sec * 1000000000u + (uint64)ts.tv_nsec;
+#endif
+}
+
+static int highestBit(uint64 value) {
+	int bit = 0;
+	if (value >> 32) { value >>= 32; bit += 32; }
+	if (value >> 16) { value >>= 16; bit += 16; }
+	if (value >> 8) { value >>= 8; bit += 8; }
+	if (value >> 4) { value >>= 4; bit += 4; }
+	if (value >> 2) { value >>= 2; bit += 2; }
+	if (value >> 1) { bit += 1; }
+	return bit;
+}
+
+static int histogramBucket(uint64 value) {
+	int exponent;
+	if (value < HISTOGRAM_SUB_BUCKETS) {
+		return (int)value;
+	}
+	exponent = highestBit(value);
+	return (exponent - 2) * HISTOGRAM_SUB_BUCKETS + (int)((value >> (exponent - 3)) & (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+/* Groesster Wert, der noch in den Bucket faellt */
+static uint64 histogramBucketLimit(int bucket) {
+	int exponent;
+	if (bucket < HISTOGRAM_SUB_BUCKETS) {
+		return (uint64)bucket;
+	}
+	exponent = bucket / HISTOGRAM_SUB_BUCKETS + 2;
+	return ((uint64)(HISTOGRAM_SUB_BUCKETS + bucket % HISTOGRAM_SUB_BUCKETS + 1) << (exponent - 3)) - 1;
+}
+
+void histogramRecord(struct Histogram* histogram, uint64 value) {
+	histogram->counts[histogramBucket(value)]++;
+	histogram->total++;
+	histogram->sum += value;
+	if (value > histogram->max) {
+		histogram->max = value;
+	}
+}
+
+/* Wert, unter dem der Anteil quantile (0..1) aller Messungen liegt */
+uint64 histogramPercentile(const struct Histogram* histogram, double quantile) {
+	uint64 target = (uint64)(quantile * (double)histogram->total + 0.5);
+	uint64 seen = 0;
+	int i;
+	if (target < 1) {
+		target = 1;
+	}
+	for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+		seen += histogram->counts[i];
+		if (seen >= target) {
+			uint64 limit = histogramBucketLimit(i);
+			return limit < histogram->max ? limit : histogram->max;
+		}
+	}
+	return histogram->max;
+}
+
+/* Traegt einen Abschnitt in den Trace-Ring ein, aeltere Eintraege werden ueberschrieben */
+void traceRecord(struct DiceContext* ctx, int stage, uint64 begin, uint64 end) {
+	struct TraceEvent* events = traceEvents;
+	uint64 sequence;
+	struct TraceEvent* event;
+
+	if (events == NULL) {
+		return;
+	}
+	sequence = atomicIncrement64(&traceSequence);
+	event = &events[(sequence - 1) & (TRACE_RING_SIZE - 1)];
+	atomicStore64(&event->sequence, 0);  /* Eintrag ist waehrend des Schreibens ungueltig */
+	atomicStoreFence();                  /* ... und zwar bevor der erste Wert ueberschrieben wird */
+	event->begin = begin;
+	event->end = end;
+	event->message = ctx->traceMessage;
+	event->thread = ctx->threadNumber;
+	event->stage = stage;
+	atomicStore64(&event->sequence, sequence);  /* release: erst alle Werte, dann die Nummer */
+}
+
+/* Startet das Aufzeichnen, der Ring wird beim ersten Mal angelegt und danach wiederverwendet */
+bool startTrace() {
+	if (traceEvents == NULL) {
+		traceEvents = (struct TraceEvent*)calloc(TRACE_RING_SIZE, sizeof(struct TraceEvent));
+		if (traceEvents == NULL) {
+			return false;
+		}
+	}
+	traceActive = true;
+	return true;
+}
+
+void stopTrace() {
+	traceActive = false;
+}
+
+/*
+ * Schreibt den Inhalt des Rings als Chrome-Trace-JSON (chrome://tracing, Perfetto) in path. Gibt die Anzahl der
+ * geschriebenen Eintraege oder -1 bei einem Fehler zurueck. Das Aufzeichnen darf dabei weiterlaufen, Eintraege
+ * die gerade ueberschrieben werden, fehlen in der Datei.
+ */
+int writeTrace(const char* path) {
+	static const char* stageNames[TRACE_STAGE_COUNT] = { "Parsen", "Wuerfeln", "Formatieren", "Senden", "Nachricht" };
+	uint64 last = atomicLoad64(&traceSequence);
+	uint64 first = last > TRACE_RING_SIZE ? last - TRACE_RING_SIZE + 1 : 1;
+	uint64 sequence;
+	int written = 0;
+	FILE* f;
+
+	if (traceEvents == NULL || (f = fopen(path, "w")) == NULL) {
+		return -1;
+	}
+	fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+	for (sequence = first; sequence <= last; sequence++) {
+		struct TraceEvent* slot = &traceEvents[(sequence - 1) & (TRACE_RING_SIZE - 1)];
+		struct TraceEvent event;
+		/* Nummer vor und nach dem Kopieren gleich: der Eintrag wurde dazwischen nicht ueberschrieben */
+		if (atomicLoad64(&slot->sequence) != sequence) {
+			continue;
+		}
+		event = *slot;
+		atomicLoadFence();
+		if (atomicLoad64(&slot->sequence) != sequence || event.stage < 0 || event.stage >= TRACE_STAGE_COUNT) {
+			continue;
+		}
+		fprintf(f, "%s\n{\"name\":\"%s\",\"cat\":\"alldice\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"nachricht\":%u}}",
+			written == 0 ? "" : ",", stageNames[event.stage], event.thread, event.begin / 1000.0, (event.end - event.begin) / 1000.0, event.message);
+		written++;
+	}
+	fprintf(f, "\n]}\n");
+	if (fclose(f) != 0) {
+		return -1;
+	}
+	return written;
+}
+
+/* Traegt die seit start vergangene Zeit in den Timer ein und gibt die aktuelle Zeit zurueck */
+uint64 recordTimer(struct DiceContext* ctx, enum MetricTimer timer, uint64 start) {
+	uint64 now = monotonicNanos();
+	histogramRecord(&ctx->metrics.timers[timer], now - start);
+	if (traceActive) {
+		traceRecord(ctx, timer, start, now);
+	}
+	return now;
+}
+
+/* Fasst die Messwerte aller Threads zusammen. Die Zaehler werden ohne Sperre gelesen, kleine Abweichungen sind moeglich. */
+void collectMetrics(struct Metrics* result) {
+	struct DiceContext* ctx;
+	int i, t, b;
+
+	memset(result, 0, sizeof(struct Metrics));
+	for (ctx = diceContextList; ctx != NULL; ctx = ctx->next) {
+		for (i = 0; i < METRIC_COUNT; i++) {
+			result->counters[i] += ctx->metrics.counters[i];
+		}
+		if (ctx->arena.highWater > result->arenaHighWater) {
+			result->arenaHighWater = ctx->arena.highWater;
+		}
+		for (t = 0; t < TIMER_COUNT; t++) {
+			const struct Histogram* src = &ctx->metrics.timers[t];
+			struct Histogram* dst = &result->timers[t];
+			if (src->total == 0) {
+				continue;
+			}
+			for (b = 0; b < HISTOGRAM_BUCKETS; b++) {
+				dst->counts[b] += src->counts[b];
+			}
+			dst->total += src->total;
+			dst->sum += src->sum;
+			if (src->max > dst->max) {
+				dst->max = src->max;
+			}
+		}
+	}
+}
+
+static const char* metricTimerNames[TIMER_COUNT] = { "Parsen", "Wuerfeln", "Formatieren", "Senden", "Nachricht" };
+
+static double hitRate(uint64 hits, uint64 misses) {
+	return hits + misses > 0 ? 100.0 * hits / (double)(hits + misses) : 0.0;
+}
+
+void formatMetrics(struct OutputBuilder* out, const struct Metrics* metrics) {
+	const uint64* c = metrics->counters;
+	int t;
+
+	outputAppend(out, "Nachrichten: %llu, abgelehnt: %llu, anderem Client ueberlassen: %llu\n", (unsigned long long)c[METRIC_MESSAGES],
+		(unsigned long long)c[METRIC_REJECTED], (unsigned long long)c[METRIC_DEFERRED]);
+	outputAppend(out, "Befehle: Wuerfel %llu, Savage Worlds %llu, Fate %llu, DSA %llu, Shadowrun %llu, Farbe %llu, Hilfe %llu, Simulation %llu, Hotkeys %llu, Menue %llu, Konsole %llu, Verwaltung %llu\n",
+		(unsigned long long)c[METRIC_CMD_DICE], (unsigned long long)c[METRIC_CMD_SWW], (unsigned long long)c[METRIC_CMD_FATE],
+		(unsigned long long)c[METRIC_CMD_DSA], (unsigned long long)c[METRIC_CMD_SHADOWRUN], (unsigned long long)c[METRIC_CMD_COLOR], (unsigned long long)c[METRIC_CMD_HELP], (unsigned long long)c[METRIC_CMD_SIM],
+		(unsigned long long)c[METRIC_CMD_HOTKEY], (unsigned long long)c[METRIC_CMD_MENU], (unsigned long long)c[METRIC_CMD_CONSOLE],
+		(unsigned long long)c[METRIC_CMD_ADMIN]);
+	outputAppend(out, "Wuerfel: %llu, Explosionen: %llu\n", (unsigned long long)c[METRIC_DICE], (unsigned long long)c[METRIC_EXPLOSIONS]);
+	outputAppend(out, "Gesendet: %llu Nachrichten, %llu Pluginbefehle, %llu Bytes\n", (unsigned long long)c[METRIC_SENT_MESSAGES],
+		(unsigned long long)c[METRIC_SENT_COMMANDS], (unsigned long long)c[METRIC_SENT_BYTES]);
+	outputAppend(out, "Cache-Treffer: Channel %.1f%% von %llu, Identitaet %.1f%% von %llu\n",
+		hitRate(c[METRIC_CHANNEL_HITS], c[METRIC_CHANNEL_MISSES]), (unsigned long long)(c[METRIC_CHANNEL_HITS] + c[METRIC_CHANNEL_MISSES]),
+		hitRate(c[METRIC_IDENTITY_HITS], c[METRIC_IDENTITY_MISSES]), (unsigned long long)(c[METRIC_IDENTITY_HITS] + c[METRIC_IDENTITY_MISSES]));
+	for (t = 0; t < TIMER_COUNT; t++) {
+		const struct Histogram* h = &metrics->timers[t];
+		if (h->total == 0) {
+			outputAppend(out, "%s: keine Messungen\n", metricTimerNames[t]);
+			continue;
+		}
+		outputAppend(out, "%s: %llu Messungen, p50 %.1f us, p99 %.1f us, max %.1f us\n", metricTimerNames[t], (unsigned long long)h->total,
+			histogramPercentile(h, 0.5) / 1000.0, histogramPercentile(h, 0.99) / 1000.0, h->max / 1000.0);
+	}
+	outputAppend(out, "Arbeitsspeicher pro Nachricht: hoechstens %lu von %lu Bytes", (unsigned long)metrics->arenaHighWater, (unsigned long)ARENA_SIZE);
+}
+
+void logMetrics() {
+	struct Metrics* metrics = (struct Metrics*)malloc(sizeof(struct Metrics));
+	char buffer[METRICS_BUFSIZE];
+	struct OutputBuilder out;
+
+	if (metrics == NULL) {
+		return;
+	}
+	collectMetrics(metrics);
+	outputInit(&out, buffer, sizeof(buffer));
+	outputAppend(&out, "Messwerte:\n");
+	formatMetrics(&out, metrics);
+	ts3Functions.logMessage(buffer, LogLevel_INFO, "ZZW DiceBot", 0);
+	free(metrics);
+}
+
+/* Schreibt die Messwerte alle METRICS_DUMP_INTERVAL Nanosekunden ins Log, aufgerufen aus dem Nachrichten-Handler */
+void logMetricsPeriodically(uint64 now) {
+	uint64 due = nextMetricsDump;
+	if (now < due || !atomicCompareExchange64(&nextMetricsDump, due, now + METRICS_DUMP_INTERVAL)) {
+		return;
+	}
+	if (due != 0) {
+		logMetrics();
+	}
+}
+
+static void sendPart(uint64 serverConnectionHandlerID, const char* msg, uint64 channelID, anyID fromID, bool isSendPrivate) {
+	struct DiceContext* ctx = getThreadDiceContext();
+	uint64 start = monotonicNanos();
+
+	if (isSendPrivate) {
+		ts3Functions.requestSendPrivateTextMsg(serverConnectionHandlerID, msg, fromID, 0);
+	}
+	else {
+		ts3Functions.requestSendChannelTextMsg(serverConnectionHandlerID, msg, channelID, 0);
+	}
+
+	if (ctx != NULL) {
+		recordTimer(ctx, TIMER_SEND, start);
+		ctx->metrics.counters[METRIC_SENT_MESSAGES]++;
+		ctx->metrics.counters[METRIC_SENT_BYTES] += strlen(msg);
+	}
+}
+
+/* Darf jetzt gesendet werden? Nur mit gesperrter sendQueue.mutex aufrufen, verbraucht dabei ein Token */
+static bool takeSendToken(uint64 now) {
+	uint64 interval = (uint64)sendIntervalMs * 1000000;
+	if (interval == 0) {
+		return true;
+	}
+	if (sendQueue.nextSend > now + (uint64)(sendBurst - 1) * interval) {
+		return false;
+	}
+	sendQueue.nextSend = (sendQueue.nextSend > now ? sendQueue.nextSend : now) + interval;
+	return true;
+}
+
+static THREAD_FUNCTION(sendThread) {
+	mutexLock(&sendQueue.mutex);
+	for (;;) {
+		struct QueuedMessage entry;
+		uint64 now = monotonicNanos();
+
+		if (sendQueue.count == 0) {
+			if (sendQueue.shutdown) {
+				break;
+			}
+			conditionWait(&sendQueue.wake, &sendQueue.mutex);
+			continue;
+		}
+		if (!sendQueue.shutdown && !takeSendToken(now)) {
+			/* warten, bis das naechste Token frei wird */
+			uint64 wait = (sendQueue.nextSend - (uint64)(sendBurst - 1) * sendIntervalMs * 1000000 - now) / 1000000 + 1;
+			mutexUnlock(&sendQueue.mutex);
+			sleepMillis(wait < 500 ? (int)wait : 500);
+			mutexLock(&sendQueue.mutex);
+			continue;
+		}
+		entry = sendQueue.entries[sendQueue.head];
+		sendQueue.head = (sendQueue.head + 1) % SEND_QUEUE_SIZE;
+		sendQueue.count--;
+		sendQueue.sending = true;
+		mutexUnlock(&sendQueue.mutex);
+
+		sendPart(entry.serverConnectionHandlerID, entry.text, entry.channelID, entry.fromID, entry.isPrivate);
+		free(entry.text);
+
+		mutexLock(&sendQueue.mutex);
+		sendQueue.sending = false;
+	}
+	mutexUnlock(&sendQueue.mutex);
+	return THREAD_RETURN;
+}
+
+/* Groessenlimit und Drosselung der Ausgabe, intervalMs = 0 schaltet die Drosselung ab (fuer die Tools) */
+void setSendLimits(int sizeLimit, int burst, int intervalMs) {
+	messageSizeLimit = sizeLimit;
+	sendBurst = burst > 0 ? burst : 1;
+	sendIntervalMs = intervalMs > 0 ? intervalMs : 0;
+}
+
+void sendQueueInit() {
+	if (!sendQueue.initialized) {
+		mutexInit(&sendQueue.mutex);
+		conditionInit(&sendQueue.wake);
+		sendQueue.initialized = true;
+	}
+}
+
+/* Sendet alles, was noch in der Warteschlange steht, ohne Drosselung und beendet den Sendethread */
+void sendQueueStop() {
+	if (!sendQueue.initialized) {
+		return;
+	}
+	mutexLock(&sendQueue.mutex);
+	sendQueue.shutdown = true;
+	conditionBroadcast(&sendQueue.wake);
+	mutexUnlock(&sendQueue.mutex);
+	if (sendQueue.threadStarted) {
+		threadJoin(sendQueue.thread);
+		sendQueue.threadStarted = false;
+	}
+	conditionDestroy(&sendQueue.wake);
+	mutexDestroy(&sendQueue.mutex);
+	sendQueue.initialized = false;
+	sendQueue.shutdown = false;
+	sendQueue.threadFailed = false;
+	sendQueue.reserved = 0;
+}
+
+/*
+ * Reserviert Plaetze fuer alle parts Teile einer Antwort: entweder kommt die ganze Antwort an oder gar nichts,
+ * nie fehlt ein Teil aus der Mitte. Der letzte Platz bleibt fuer den Hinweis auf eine verworfene Antwort frei.
+ */
+static bool reserveSendParts(uint64 serverConnectionHandlerID, int parts) {
+	char warning[128];
+	bool reserved;
+
+	if (!sendQueue.initialized) {
+		return true;
+	}
+	mutexLock(&sendQueue.mutex);
+	if (!sendQueue.threadStarted && !sendQueue.threadFailed && !(sendQueue.threadStarted = threadStart(&sendQueue.thread, sendThread, NULL))) {
+		sendQueue.threadFailed = true;
+		ts3Functions.logMessage("Sendethread konnte nicht gestartet werden, Antworten werden ohne Drosselung gesendet", LogLevel_ERROR, "AllDice", serverConnectionHandlerID);
+	}
+	if (sendQueue.threadFailed) {
+		reserved = true;
+	}
+	else if (sendQueue.count + sendQueue.reserved + parts < SEND_QUEUE_SIZE) {
+		sendQueue.reserved += parts;
+		reserved = true;
+	}
+	else {
+		/* Warteschlange voll: lieber die ganze Antwort verwerfen als den Client blockieren */
+		sendQueue.dropped++;
+		snprintf(warning, sizeof(warning), "Sendewarteschlange voll, Antwort mit %d Teilen verworfen (%llu insgesamt)", parts, (unsigned long long)sendQueue.dropped);
+		ts3Functions.logMessage(warning, LogLevel_WARNING, "AllDice", serverConnectionHandlerID);
+		reserved = false;
+	}
+	mutexUnlock(&sendQueue.mutex);
+	return reserved;
+}
+
+/*
+ * Sendet einen Teil sofort, wenn nichts wartet und ein Token frei ist, sonst ueber die Warteschlange. reserved:
+ * der Platz wurde mit reserveSendParts belegt, sonst (Hinweis auf verworfene Antworten) nur falls noch frei.
+ */
+static void sendOrQueue(uint64 serverConnectionHandlerID, const char* part, uint64 channelID, anyID fromID, bool isSendPrivate, bool reserved) {
+	struct QueuedMessage* entry;
+
+	if (!sendQueue.initialized) {
+		sendPart(serverConnectionHandlerID, part, channelID, fromID, isSendPrivate);
+		return;
+	}
+	mutexLock(&sendQueue.mutex);
+	if (reserved && sendQueue.reserved > 0) {
+		sendQueue.reserved--;
+	}
+	if (sendQueue.threadFailed || (sendQueue.count == 0 && !sendQueue.sending && takeSendToken(monotonicNanos()))) {
+		mutexUnlock(&sendQueue.mutex);
+		sendPart(serverConnectionHandlerID, part, channelID, fromID, isSendPrivate);
+		return;
+	}
+	if (!sendQueue.threadStarted || (!reserved && sendQueue.count + sendQueue.reserved >= SEND_QUEUE_SIZE)) {
+		mutexUnlock(&sendQueue.mutex);
+		return;
+	}
+	entry = &sendQueue.entries[(sendQueue.head + sendQueue.count) % SEND_QUEUE_SIZE];
+	entry->serverConnectionHandlerID = serverConnectionHandlerID;
+	entry->channelID = channelID;
+	entry->fromID = fromID;
+	entry->isPrivate = isSendPrivate;
+	entry->text = strdup(part);
+	if (entry->text != NULL) {
+		sendQueue.count++;
+		conditionBroadcast(&sendQueue.wake);
+	}
+	mutexUnlock(&sendQueue.mutex);
+}
+
+/*
+ * Laenge des naechsten Teils von msg mit hoechstens limit Bytes: bevorzugt vor einem Zeilenumbruch, sonst vor
+ * einem Leerzeichen, sonst vor einem BBCode-Tag bzw. nicht mitten in einem UTF-8-Zeichen.
+ */
+static size_t chunkLength(const char* msg, size_t length, size_t limit) {
+	size_t cut;
+
+	if (length <= limit) {
+		return length;
+	}
+	for (cut = limit; cut > limit / 4; cut--) {
+		if (msg[cut] == '\n') {
+			return cut;
+		}
+	}
+	for (cut = limit; cut > limit / 4; cut--) {
+		if (msg[cut] == ' ') {
+			return cut;
+		}
+	}
+	for (cut = limit; cut > limit / 4 && msg[cut] != ']'; cut--) {
+		if (msg[cut] == '[') {
+			return cut;
+		}
+	}
+	cut = limit;
+	while (cut > 1 && ((unsigned char)msg[cut] & 0xC0) == 0x80) {
+		cut--;
+	}
+	return cut;
+}
+
+/*
+ * Sendet msg. Antworten ueber messageSizeLimit Bytes werden geteilt, jeder weitere Teil bekommt die
+ * Farbe vom Anfang der Antwort ("\n[color=...]") wieder vorangestellt.
+ */
+void sendMessage(uint64 serverConnectionHandlerID, const char* msg, uint64 channelID, anyID fromID, bool isSendPrivate) {
+	static THREAD_LOCAL char part[TS3_MAX_SIZE_TEXTMESSAGE + 1];
+	const char* start = msg;
+	size_t length = strlen(msg);
+	size_t limit = messageSizeLimit > 0 && messageSizeLimit <= TS3_MAX_SIZE_TEXTMESSAGE ? (size_t)messageSizeLimit : TS3_MAX_SIZE_TEXTMESSAGE;
+	size_t prefix = 0;
+	int parts = 0, pass;
+
+	if (length <= limit) {
+		if (reserveSendParts(serverConnectionHandlerID, 1)) {
+			sendOrQueue(serverConnectionHandlerID, msg, channelID, fromID, isSendPrivate, true);
+		}
+		else {
+			sendOrQueue(serverConnectionHandlerID, SEND_DROPPED_NOTICE, channelID, fromID, isSendPrivate, false);
+		}
+		return;
+	}
+	if (strncmp(msg, "\n[color=", 8) == 0) {
+		const char* end = strchr(msg + 8, ']');
+		if (end != NULL && (size_t)(end - msg) < limit / 4) {
+			prefix = (size_t)(end - msg) + 1;
+		}
+	}
+	/* 1. Durchgang zaehlt die Teile, 2. sendet sie */
+	for (pass = 0; pass < 2; pass++) {
+		const char* rest = msg;
+		size_t left = length;
+		bool first = true;
+
+		if (pass == 1 && !reserveSendParts(serverConnectionHandlerID, parts)) {
+			sendOrQueue(serverConnectionHandlerID, SEND_DROPPED_NOTICE, channelID, fromID, isSendPrivate, false);
+			return;
+		}
+		while (left > 0) {
+			size_t used = first ? 0 : prefix;
+			size_t cut = chunkLength(rest, left, limit - used);
+			if (pass == 0) {
+				parts++;
+			}
+			else {
+				memcpy(part, start, used);
+				memcpy(part + used, rest, cut);
+				part[used + cut] = '\0';
+				sendOrQueue(serverConnectionHandlerID, part, channelID, fromID, isSendPrivate, true);
+			}
+			rest += cut;
+			left -= cut;
+			while (left > 0 && (*rest == '\n' || *rest == ' ')) {
+				rest++;
+				left--;
+			}
+			first = false;
+		}
+	}
+}
+
+void clientMapInit() {
+	mutexInit(&clientMapMutex);
+}
+
+static void freeClientMap(struct ClientMap* map) {
+	free(map->channelOf);
+	free(map->nextMember);
+	free(map->prevMember);
+	free(map->channels);
+	free(map->identities);
+	memset(map, 0, sizeof(*map));
+}
+
+void clientMapStop() {
+	int i;
+	for (i = 0; i < CLIENT_MAP_CONNECTIONS; i++) {
+		freeClientMap(&clientMaps[i]);
+	}
+	mutexDestroy(&clientMapMutex);
+}
+
+/* Nur mit gesperrter clientMapMutex aufrufen. create legt die Tabelle an, NULL wenn voll oder kein Speicher. */
+static struct ClientMap* findClientMap(uint64 serverConnectionHandlerID, bool create) {
+	struct ClientMap* unused = NULL;
+	int i;
+
+	for (i = 0; i < CLIENT_MAP_CONNECTIONS; i++) {
+		if (clientMaps[i].serverConnectionHandlerID == serverConnectionHandlerID) {
+			return &clientMaps[i];
+		}
+		if (unused == NULL && clientMaps[i].serverConnectionHandlerID == 0) {
+			unused = &clientMaps[i];
+		}
+	}
+	if (!create || unused == NULL) {
+		return NULL;
+	}
+	unused->channelOf = (uint64*)calloc(CLIENT_ID_COUNT, sizeof(uint64));
+	unused->nextMember = (anyID*)calloc(CLIENT_ID_COUNT, sizeof(anyID));
+	unused->prevMember = (anyID*)calloc(CLIENT_ID_COUNT, sizeof(anyID));
+	unused->channels = (struct ChannelMembers*)calloc(CHANNEL_TABLE_MIN, sizeof(struct ChannelMembers));
+	unused->identities = (struct ClientIdentity*)calloc(IDENTITY_TABLE_MIN, sizeof(struct ClientIdentity));
+	if (unused->channelOf == NULL || unused->nextMember == NULL || unused->prevMember == NULL || unused->channels == NULL || unused->identities == NULL) {
+		freeClientMap(unused);
+		return NULL;
+	}
+	unused->serverConnectionHandlerID = serverConnectionHandlerID;
+	unused->channelCapacity = CHANNEL_TABLE_MIN;
+	unused->identityCapacity = IDENTITY_TABLE_MIN;
+	return unused;
+}
+
+static struct ChannelMembers* findChannelSlot(struct ChannelMembers* channels, int capacity, uint64 channelID) {
+	int mask = capacity - 1;
+	int i = (int)(mix((unsigned long)channelID, (unsigned long)(channelID >> 32), 0x9e3779b9ul) & (unsigned long)mask);
+	while (channels[i].channelID != 0 && channels[i].channelID != channelID) {
+		i = (i + 1) & mask;
+	}
+	return &channels[i];
+}
+
+/* Verdoppelt die Tabelle, leere Channels fallen dabei weg */
+static bool growChannelTable(struct ClientMap* map) {
+	int capacity = map->channelCapacity * 2;
+	struct ChannelMembers* channels = (struct ChannelMembers*)calloc((size_t)capacity, sizeof(struct ChannelMembers));
+	int i;
+
+	if (channels == NULL) {
+		return false;
+	}
+	map->channelUsed = 0;
+	for (i = 0; i < map->channelCapacity; i++) {
+		if (map->channels[i].channelID != 0 && map->channels[i].count > 0) {
+			*findChannelSlot(channels, capacity, map->channels[i].channelID) = map->channels[i];
+			map->channelUsed++;
+		}
+	}
+	free(map->channels);
+	map->channels = channels;
+	map->channelCapacity = capacity;
+	return true;
+}
+
+static struct ChannelMembers* findChannel(struct ClientMap* map, uint64 channelID, bool create) {
+	struct ChannelMembers* channel = findChannelSlot(map->channels, map->channelCapacity, channelID);
+	if (channel->channelID != 0 || !create) {
+		return channel->channelID != 0 ? channel : NULL;
+	}
+	if (map->channelUsed * 2 >= map->channelCapacity) {
+		if (!growChannelTable(map)) {
+			return NULL;
+		}
+		channel = findChannelSlot(map->channels, map->channelCapacity, channelID);
+	}
+	channel->channelID = channelID;
+	map->channelUsed++;
+	return channel;
+}
+
+static void unlinkClient(struct ClientMap* map, anyID clientID) {
+	struct ChannelMembers* channel;
+	anyID next = map->nextMember[clientID];
+	anyID prev = map->prevMember[clientID];
+
+	if (map->channelOf[clientID] == 0 || (channel = findChannel(map, map->channelOf[clientID], false)) == NULL) {
+		return;
+	}
+	if (prev != 0) {
+		map->nextMember[prev] = next;
+	}
+	else {
+		channel->first = next;
+	}
+	if (next != 0) {
+		map->prevMember[next] = prev;
+	}
+	channel->count--;
+	map->channelOf[clientID] = 0;
+	map->nextMember[clientID] = 0;
+	map->prevMember[clientID] = 0;
+}
+
+/* Startplatz von clientID, Fibonacci-Hashing ueber die 16 Bit der ID */
+static int identityHome(anyID clientID, int capacity) {
+	return (int)(((uint32_t)clientID * 2654435769u) >> 16) & (capacity - 1);
+}
+
+static struct ClientIdentity* findIdentitySlot(struct ClientIdentity* identities, int capacity, anyID clientID) {
+	int i = identityHome(clientID, capacity);
+	while (identities[i].clientID != 0 && identities[i].clientID != clientID) {
+		i = (i + 1) & (capacity - 1);
+	}
+	return &identities[i];
+}
+
+/* Nur mit gesperrter clientMapMutex aufrufen */
+static struct ClientIdentity* findIdentity(struct ClientMap* map, anyID clientID, bool create) {
+	struct ClientIdentity* identity = findIdentitySlot(map->identities, map->identityCapacity, clientID);
+	int i;
+
+	if (identity->clientID != 0 || !create) {
+		return identity->clientID != 0 ? identity : NULL;
+	}
+	if (map->identityUsed * 2 >= map->identityCapacity) {
+		int capacity = map->identityCapacity * 2;
+		struct ClientIdentity* identities = (struct ClientIdentity*)calloc((size_t)capacity, sizeof(struct ClientIdentity));
+		if (identities == NULL) {
+			return NULL;
+		}
+		for (i = 0; i < map->identityCapacity; i++) {
+			if (map->identities[i].clientID != 0) {
+				*findIdentitySlot(identities, capacity, map->identities[i].clientID) = map->identities[i];
+			}
+		}
+		free(map->identities);
+		map->identities = identities;
+		map->identityCapacity = capacity;
+		identity = findIdentitySlot(identities, capacity, clientID);
+	}
+	memset(identity, 0, sizeof(*identity));
+	identity->clientID = clientID;
+	map->identityUsed++;
+	return identity;
+}
+
+/* Loescht den Eintrag und rueckt nachfolgende Eintraege derselben Kette auf, so braucht es keine Grabsteine */
+static void removeIdentity(struct ClientMap* map, anyID clientID) {
+	int mask = map->identityCapacity - 1;
+	struct ClientIdentity* identity = findIdentitySlot(map->identities, map->identityCapacity, clientID);
+	int hole = (int)(identity - map->identities);
+	int i = hole;
+
+	if (identity->clientID == 0) {
+		return;
+	}
+	for (;;) {
+		int home;
+		i = (i + 1) & mask;
+		if (map->identities[i].clientID == 0) {
+			break;
+		}
+		home = identityHome(map->identities[i].clientID, map->identityCapacity);
+		if (((i - home) & mask) >= ((i - hole) & mask)) {
+			map->identities[hole] = map->identities[i];
+			hole = i;
+		}
+	}
+	map->identities[hole].clientID = 0;
+	map->identityUsed--;
+}
+
+/* Aktualisiert die Identitaet, NULL bzw. 0 laesst ein Feld unveraendert */
+void identityUpdate(uint64 serverConnectionHandlerID, anyID clientID, const char* uid, const char* name, uint64 databaseID) {
+	struct ClientMap* map;
+	struct ClientIdentity* identity;
+
+	if (clientID == 0) {
+		return;
+	}
+	mutexLock(&clientMapMutex);
+	if ((map = findClientMap(serverConnectionHandlerID, true)) != NULL && (identity = findIdentity(map, clientID, true)) != NULL) {
+		if (uid != NULL) {
+			_strcpy(identity->uid, IDENTITY_UID_SIZE, uid);
+		}
+		if (name != NULL) {
+			_strcpy(identity->name, TS3_MAX_SIZE_CLIENT_NICKNAME, name);
+		}
+		if (databaseID != 0) {
+			identity->databaseID = databaseID;
+		}
+	}
+	mutexUnlock(&clientMapMutex);
+	infoChanged();
+}
+
+/* Fragt UID, Namen und Datenbank-ID beim TS3-Client ab, nur bei Ereignissen, nicht pro Nachricht */
+void identityRefresh(uint64 serverConnectionHandlerID, anyID clientID) {
+	char* uid = NULL;
+	char* name = NULL;
+	uint64 databaseID = 0;
+
+	if (ts3Functions.getClientVariableAsString(serverConnectionHandlerID, clientID, CLIENT_UNIQUE_IDENTIFIER, &uid) != ERROR_ok) {
+		uid = NULL;
+	}
+	if (ts3Functions.getClientVariableAsString(serverConnectionHandlerID, clientID, CLIENT_NICKNAME, &name) != ERROR_ok) {
+		name = NULL;
+	}
+	if (ts3Functions.getClientVariableAsUInt64(serverConnectionHandlerID, clientID, CLIENT_DATABASE_ID, &databaseID) != ERROR_ok) {
+		databaseID = 0;
+	}
+	identityUpdate(serverConnectionHandlerID, clientID, uid, name, databaseID);
+	if (uid != NULL) {
+		ts3Functions.freeMemory(uid);
+	}
+	if (name != NULL) {
+		ts3Functions.freeMemory(name);
+	}
+}
+
+/* Kopiert die Identitaet von clientID nach result, false wenn sie nicht bekannt ist */
+bool clientIdentity(uint64 serverConnectionHandlerID, anyID clientID, struct ClientIdentity* result) {
+	struct DiceContext* ctx = getThreadDiceContext();
+	struct ClientMap* map;
+	struct ClientIdentity* identity;
+	bool found = false;
+
+	mutexLock(&clientMapMutex);
+	if ((map = findClientMap(serverConnectionHandlerID, false)) != NULL && (identity = findIdentity(map, clientID, false)) != NULL) {
+		*result = *identity;
+		found = true;
+	}
+	mutexUnlock(&clientMapMutex);
+	if (ctx != NULL) {
+		ctx->metrics.counters[found ? METRIC_IDENTITY_HITS : METRIC_IDENTITY_MISSES]++;
+	}
+	return found;
+}
+
+/*
+ * Haengt die Wuerfe von batch an den Verlauf des Clients an (Infoanzeige). name ergaenzt eine noch unbekannte
+ * Identitaet, NULL laesst sie unveraendert.
+ */
+void historyRecord(uint64 serverConnectionHandlerID, anyID clientID, const char* name, const struct RollBatch* batch) {
+	struct ClientMap* map;
+	struct ClientIdentity* identity;
+	int r;
+
+	if (clientID == 0 || batch == NULL) {
+		return;
+	}
+	mutexLock(&clientMapMutex);
+	if ((map = findClientMap(serverConnectionHandlerID, true)) != NULL && (identity = findIdentity(map, clientID, true)) != NULL) {
+		if (name != NULL && identity->name[0] == '\0') {
+			_strcpy(identity->name, TS3_MAX_SIZE_CLIENT_NICKNAME, name);
+		}
+		for (r = 0; r < batch->count; r++) {
+			const struct DiceExpression* expr = batchExpression(batch, r);
+			struct HistoryEntry* entry = &identity->history[identity->rolls % HISTORY_LENGTH];
+			int length = expr->textLength < HISTORY_TEXT_SIZE - 1 ? expr->textLength : HISTORY_TEXT_SIZE - 1;
+			entry->value = rollValue(expr, &batch->rolls[r]);
+			memcpy(entry->text, expr->text, length);
+			entry->text[length] = '\0';
+			identity->rolls++;
+			identity->rollSum += entry->value;
+		}
+	}
+	mutexUnlock(&clientMapMutex);
+	infoChanged();
+}
+
+/*
+ * Traegt den neuen Channel ein, newChannelID = 0 heisst der Client hat den Server verlassen. Dann wird seine
+ * Identitaet verworfen und die Farbe zurueckgesetzt, damit ein neuer Client mit derselben ID sie nicht erbt.
+ */
+void clientMapMove(uint64 serverConnectionHandlerID, anyID clientID, uint64 newChannelID) {
+	struct ClientMap* map;
+	struct ChannelMembers* channel;
+	bool entered = false;
+
+	if (clientID == 0) {
+		return;
+	}
+	mutexLock(&clientMapMutex);
+	if ((map = findClientMap(serverConnectionHandlerID, newChannelID != 0)) == NULL) {
+		mutexUnlock(&clientMapMutex);
+		return;
+	}
+	if (newChannelID == 0) {
+		unlinkClient(map, clientID);
+		removeIdentity(map, clientID);
+		userColorColor[clientID][0] = '\0';
+	}
+	else if (map->channelOf[clientID] != newChannelID) {
+		entered = map->channelOf[clientID] == 0;
+		unlinkClient(map, clientID);
+		if ((channel = findChannel(map, newChannelID, true)) != NULL) {
+			map->channelOf[clientID] = newChannelID;
+			map->nextMember[clientID] = channel->first;
+			if (channel->first != 0) {
+				map->prevMember[channel->first] = clientID;
+			}
+			channel->first = clientID;
+			channel->count++;
+		}
+	}
+	mutexUnlock(&clientMapMutex);
+	infoChanged();
+	if (entered) {
+		identityRefresh(serverConnectionHandlerID, clientID);
+	}
+}
+
+/* Liest beim Verbinden (und beim Laden des Plugins) alle sichtbaren Clients einmal ein */
+void clientMapConnect(uint64 serverConnectionHandlerID) {
+	anyID* clients;
+	uint64 channelID;
+	int i;
+
+	clientMapDisconnect(serverConnectionHandlerID);
+	ownClientID(serverConnectionHandlerID);
+	if (ts3Functions.getClientList(serverConnectionHandlerID, &clients) != ERROR_ok) {
+		return;
+	}
+	for (i = 0; clients[i]; i++) {
+		if (ts3Functions.getChannelOfClient(serverConnectionHandlerID, clients[i], &channelID) == ERROR_ok) {
+			clientMapMove(serverConnectionHandlerID, clients[i], channelID);
+		}
+	}
+	ts3Functions.freeMemory(clients);
+}
+
+void clientMapDisconnect(uint64 serverConnectionHandlerID) {
+	struct ClientMap* map;
+
+	mutexLock(&clientMapMutex);
+	if ((map = findClientMap(serverConnectionHandlerID, false)) != NULL) {
+		freeClientMap(map);
+	}
+	mutexUnlock(&clientMapMutex);
+}
+
+/* Eigene Client-ID der Verbindung ohne Client-API, nur beim ersten Aufruf nach dem Verbinden wird sie erfragt */
+anyID ownClientID(uint64 serverConnectionHandlerID) {
+	struct ClientMap* map;
+	anyID myID = 0;
+
+	mutexLock(&clientMapMutex);
+	if ((map = findClientMap(serverConnectionHandlerID, false)) != NULL) {
+		myID = map->ownID;
+	}
+	mutexUnlock(&clientMapMutex);
+	if (myID == 0) {
+		if (ts3Functions.getClientID(serverConnectionHandlerID, &myID) != ERROR_ok) {
+			return 0;
+		}
+		mutexLock(&clientMapMutex);
+		if (myID != 0 && (map = findClientMap(serverConnectionHandlerID, true)) != NULL) {
+			map->ownID = myID;
+		}
+		mutexUnlock(&clientMapMutex);
+	}
+	return myID;
+}
+
+/* Channel eines Clients in O(1), unbekannte Clients werden einmal beim TS3-Client erfragt und eingetragen */
+uint64 clientChannel(uint64 serverConnectionHandlerID, anyID clientID) {
+	struct DiceContext* ctx = getThreadDiceContext();
+	struct ClientMap* map;
+	uint64 channelID = 0;
+
+	mutexLock(&clientMapMutex);
+	if ((map = findClientMap(serverConnectionHandlerID, false)) != NULL) {
+		channelID = map->channelOf[clientID];
+	}
+	mutexUnlock(&clientMapMutex);
+	if (ctx != NULL) {
+		ctx->metrics.counters[channelID != 0 ? METRIC_CHANNEL_HITS : METRIC_CHANNEL_MISSES]++;
+	}
+	if (channelID == 0 && ts3Functions.getChannelOfClient(serverConnectionHandlerID, clientID, &channelID) == ERROR_ok) {
+		clientMapMove(serverConnectionHandlerID, clientID, channelID);
+	}
+	return channelID;
+}
+
+/* Anzahl der bekannten Clients im Channel */
+int channelMemberCount(uint64 serverConnectionHandlerID, uint64 channelID) {
+	struct ClientMap* map;
+	struct ChannelMembers* channel;
+	int count = 0;
+
+	mutexLock(&clientMapMutex);
+	if ((map = findClientMap(serverConnectionHandlerID, false)) != NULL && (channel = findChannel(map, channelID, false)) != NULL) {
+		count = channel->count;
+	}
+	mutexUnlock(&clientMapMutex);
+	return count;
+}
+
+/*
+ * Kopiert hoechstens max Mitglieder des Channels samt Namen aus dem Identitaetscache nach result, ohne das
+ * Client-API zu fragen. Gibt die Anzahl zurueck.
+ */
+int channelMembers(uint64 serverConnectionHandlerID, uint64 channelID, struct ChannelMember* result, int max) {
+	struct ClientMap* map;
+	struct ChannelMembers* channel;
+	struct ClientIdentity* identity;
+	anyID clientID;
+	int count = 0;
+
+	mutexLock(&clientMapMutex);
+	if ((map = findClientMap(serverConnectionHandlerID, false)) != NULL && (channel = findChannel(map, channelID, false)) != NULL) {
+		for (clientID = channel->first; clientID != 0 && count < max; clientID = map->nextMember[clientID]) {
+			result[count].clientID = clientID;
+			result[count].total = 0;
+			identity = findIdentity(map, clientID, false);
+			_strcpy(result[count].name, TS3_MAX_SIZE_CLIENT_NICKNAME, identity != NULL && identity->name[0] != '\0' ? identity->name : "?");
+			count++;
+		}
+	}
+	mutexUnlock(&clientMapMutex);
+	return count;
+}
+
+/* Zustand der Verbindung, legt ihn bei Bedarf an. Nur mit gesperrter election.mutex aufrufen, NULL wenn voll. */
+static struct ElectionState* electionState(uint64 serverConnectionHandlerID) {
+	struct ElectionState* unused = NULL;
+	int i;
+
+	for (i = 0; i < ELECTION_CONNECTIONS; i++) {
+		struct ElectionState* state = &election.connections[i];
+		if (state->serverConnectionHandlerID == serverConnectionHandlerID) {
+			return state;
+		}
+		if (unused == NULL && state->serverConnectionHandlerID == 0) {
+			unused = state;
+		}
+	}
+	if (unused != NULL) {
+		/* kein memset: electionResponds liest serverConnectionHandlerID und published ohne Sperre */
+		unused->channelID = 0;
+		unused->leaderID = 0;
+		unused->leaderSeen = 0;
+		unused->lastSent = 0;
+		unused->announce = false;
+		atomicStore64(&unused->published, 0);
+		atomicStore64(&unused->serverConnectionHandlerID, serverConnectionHandlerID);
+	}
+	return unused;
+}
+
+/* Veroeffentlicht Leiter und eigene ID fuer electionResponds. Nur mit gesperrter election.mutex aufrufen. */
+static void electionPublish(struct ElectionState* state, anyID myID) {
+	atomicStore64(&state->published, (uint64)state->leaderID | (uint64)myID << 16 | (uint64)(uint32_t)(state->leaderSeen / 1000000) << 32);
+}
+
+/* Eigene ID und eigener Channel, verwirft den bekannten Leiter wenn wir den Channel gewechselt haben */
+static bool electionLocate(struct ElectionState* state, anyID* myID) {
+	uint64 channelID;
+
+	if ((*myID = ownClientID(state->serverConnectionHandlerID)) == 0 ||
+		(channelID = clientChannel(state->serverConnectionHandlerID, *myID)) == 0) {
+		return false;
+	}
+	if (channelID != state->channelID) {
+		state->channelID = channelID;
+		state->leaderID = 0;
+		state->announce = true;
+	}
+	electionPublish(state, *myID);
+	return true;
+}
+
+/* Sind wir Leiter? Ein anderer Client fuehrt nur, solange sein Herzschlag frisch und seine ID kleiner ist */
+static bool electionLeads(const struct ElectionState* state, anyID myID, uint64 now) {
+	return state->leaderID == 0 || now - state->leaderSeen > ELECTION_TIMEOUT_MS * 1000000ull || myID < state->leaderID;
+}
+
+static void electionSend(uint64 serverConnectionHandlerID, const char* prefix, uint64 channelID) {
+	char command[COMMAND_BUFSIZE];
+	snprintf(command, COMMAND_BUFSIZE, "%s%llu", prefix, (unsigned long long)channelID);
+	ts3Functions.sendPluginCommand(serverConnectionHandlerID, pluginID, command, PluginCommandTarget_CURRENT_CHANNEL, NULL, NULL);
+}
+
+/* Takt der Wahl: der Leiter sendet seinen Herzschlag, die anderen pruefen, ob er noch da ist */
+static THREAD_FUNCTION(electionThread) {
+	uint64 targets[ELECTION_CONNECTIONS];
+	uint64 channels[ELECTION_CONNECTIONS];
+	int count, i;
+
+	for (;;) {
+		sleepMillis(ELECTION_TICK_MS);
+		count = 0;
+		mutexLock(&election.mutex);
+		if (election.shutdown) {
+			mutexUnlock(&election.mutex);
+			break;
+		}
+		for (i = 0; i < ELECTION_CONNECTIONS && chatBotActive; i++) {
+			struct ElectionState* state = &election.connections[i];
+			uint64 now = monotonicNanos();
+			anyID myID;
+			if (state->serverConnectionHandlerID == 0 || !electionLocate(state, &myID)) {
+				continue;
+			}
+			if (state->leaderID != 0 && now - state->leaderSeen > ELECTION_TIMEOUT_MS * 1000000ull) {
+				state->leaderID = 0;  /* Leiter verschwunden, wir bewerben uns */
+				state->announce = true;
+				electionPublish(state, myID);
+			}
+			if (electionLeads(state, myID, now) && (state->announce || now - state->lastSent >= ELECTION_HEARTBEAT_MS * 1000000ull)) {
+				state->announce = false;
+				state->lastSent = now;
+				targets[count] = state->serverConnectionHandlerID;
+				channels[count++] = state->channelID;
+			}
+		}
+		mutexUnlock(&election.mutex);
+		for (i = 0; i < count; i++) {
+			electionSend(targets[i], ELECTION_HEARTBEAT_PREFIX, channels[i]);
+		}
+	}
+	return THREAD_RETURN;
+}
+
+void electionInit() {
+	if (!election.initialized) {
+		mutexInit(&election.mutex);
+		election.initialized = true;
+	}
+}
+
+/* Beendet den Takt, als Leiter verabschieden wir uns, damit ein anderer Client sofort uebernimmt */
+void electionStop() {
+	int i;
+
+	if (!election.initialized) {
+		return;
+	}
+	mutexLock(&election.mutex);
+	election.shutdown = true;
+	mutexUnlock(&election.mutex);
+	if (election.threadStarted) {
+		threadJoin(election.thread);
+		election.threadStarted = false;
+	}
+	if (chatBotActive) {
+		for (i = 0; i < ELECTION_CONNECTIONS; i++) {
+			struct ElectionState* state = &election.connections[i];
+			anyID myID;
+			if (state->serverConnectionHandlerID != 0 && electionLocate(state, &myID) && electionLeads(state, myID, monotonicNanos())) {
+				electionSend(state->serverConnectionHandlerID, ELECTION_BYE_PREFIX, state->channelID);
+			}
+		}
+	}
+	mutexDestroy(&election.mutex);
+	memset(&election, 0, sizeof(election));
+}
+
+/* !an: startet den Takt und bewirbt sich sofort, wenn kein kleinerer Client im Channel fuehrt */
+static void electionJoin(uint64 serverConnectionHandlerID) {
+	struct ElectionState* state;
+	uint64 now = monotonicNanos();
+	uint64 channelID = 0;
+	anyID myID;
+	bool send = false;
+
+	if (!election.initialized) {
+		return;
+	}
+	mutexLock(&election.mutex);
+	if (!election.threadStarted) {
+		election.threadStarted = threadStart(&election.thread, electionThread, NULL);
+	}
+	state = electionState(serverConnectionHandlerID);
+	if (state != NULL && electionLocate(state, &myID) && electionLeads(state, myID, now) && now - state->lastSent >= ELECTION_ANSWER_MS * 1000000ull) {
+		state->announce = false;
+		state->lastSent = now;
+		channelID = state->channelID;
+		send = true;
+	}
+	mutexUnlock(&election.mutex);
+	if (send) {
+		electionSend(serverConnectionHandlerID, ELECTION_HEARTBEAT_PREFIX, channelID);
+	}
+}
+
+/* !aus: als Leiter verabschieden */
+static void electionLeave(uint64 serverConnectionHandlerID) {
+	struct ElectionState* state;
+	uint64 channelID = 0;
+	anyID myID;
+	bool send = false;
+
+	if (!election.initialized) {
+		return;
+	}
+	mutexLock(&election.mutex);
+	state = electionState(serverConnectionHandlerID);
+	if (state != NULL && electionLocate(state, &myID) && electionLeads(state, myID, monotonicNanos())) {
+		channelID = state->channelID;
+		send = true;
+	}
+	mutexUnlock(&election.mutex);
+	if (send) {
+		electionSend(serverConnectionHandlerID, ELECTION_BYE_PREFIX, channelID);
+	}
+}
+
+/*
+ * Herzschlag oder Abschied eines anderen Clients. Ein kleinerer Client wird Leiter, einem groesseren antworten wir
+ * als aktiver Leiter sofort, damit er nicht selbst auch antwortet.
+ */
+static void electionReceive(uint64 serverConnectionHandlerID, const char* command, anyID fromID) {
+	struct ElectionState* state;
+	bool heartbeat = strncmp(command, ELECTION_HEARTBEAT_PREFIX, strlen(ELECTION_HEARTBEAT_PREFIX)) == 0;
+	uint64 channelID = strtoull(command + strlen(ELECTION_HEARTBEAT_PREFIX), NULL, 10);
+	uint64 now = monotonicNanos();
+	anyID myID;
+	bool send = false;
+
+	if (!election.initialized) {
+		return;
+	}
+	mutexLock(&election.mutex);
+	state = electionState(serverConnectionHandlerID);
+	if (state == NULL || !electionLocate(state, &myID) || channelID != state->channelID || fromID == myID) {
+		mutexUnlock(&election.mutex);
+		return;  /* Nachzuegler aus einem anderen Channel */
+	}
+	if (!heartbeat) {
+		if (fromID == state->leaderID) {
+			state->leaderID = 0;
+			state->announce = true;
+		}
+	}
+	else if (state->leaderID == 0 || now - state->leaderSeen > ELECTION_TIMEOUT_MS * 1000000ull || fromID <= state->leaderID) {
+		state->leaderID = fromID;
+		state->leaderSeen = now;
+	}
+	electionPublish(state, myID);
+	if (chatBotActive && electionLeads(state, myID, now) && (state->announce || heartbeat) && now - state->lastSent >= ELECTION_ANSWER_MS * 1000000ull) {
+		state->announce = false;
+		state->lastSent = now;
+		send = true;
+	}
+	mutexUnlock(&election.mutex);
+	if (send) {
+		electionSend(serverConnectionHandlerID, ELECTION_HEARTBEAT_PREFIX, channelID);
+	}
+}
+
+/*
+ * Der Leiter hat den Channel oder den Server verlassen, nicht erst auf das Ausbleiben des Herzschlags warten.
+ * Wechseln wir selbst den Channel, gilt der alte Leiter nicht mehr.
+ */
+void electionClientMoved(uint64 serverConnectionHandlerID, anyID clientID, uint64 newChannelID) {
+	anyID myID;
+	int i;
+
+	if (!election.initialized) {
+		return;
+	}
+	myID = ownClientID(serverConnectionHandlerID);
+	mutexLock(&election.mutex);
+	for (i = 0; i < ELECTION_CONNECTIONS; i++) {
+		struct ElectionState* state = &election.connections[i];
+		if (state->serverConnectionHandlerID != serverConnectionHandlerID) {
+			continue;
+		}
+		if (clientID == myID && newChannelID != state->channelID) {
+			state->channelID = newChannelID;
+			state->leaderID = 0;
+			state->announce = true;
+		}
+		else if (state->leaderID == clientID && newChannelID != state->channelID) {
+			state->leaderID = 0;
+			state->announce = true;
+		}
+		electionPublish(state, myID);
+	}
+	mutexUnlock(&election.mutex);
+}
+
+/*
+ * Soll diese Instanz einen Befehl aus dem Channel beantworten? Private Nachrichten erreichen nur uns, ohne !an
+ * ueberlassen wir den Channel jedem aktiven Leiter. Laeuft fuer jeden Befehl, auch in den Shards, und liest
+ * daher nur den veroeffentlichten Zustand, ohne election.mutex und ohne Client-API.
+ */
+static bool electionResponds(uint64 serverConnectionHandlerID, anyID targetMode) {
+	uint64 published = 0;
+	anyID leaderID, myID;
+	bool expired;
+	int i;
+
+	if (targetMode == TextMessageTarget_CLIENT || !election.initialized) {
+		return true;
+	}
+	for (i = 0; i < ELECTION_CONNECTIONS; i++) {
+		if (atomicLoad64(&election.connections[i].serverConnectionHandlerID) == serverConnectionHandlerID) {
+			published = atomicLoad64(&election.connections[i].published);
+			break;
+		}
+	}
+	leaderID = (anyID)(published & 0xFFFF);
+	myID = (anyID)(published >> 16 & 0xFFFF);
+	if (leaderID == 0 || myID == 0) {
+		return true;
+	}
+	expired = (uint32_t)(monotonicNanos() / 1000000) - (uint32_t)(published >> 32) > ELECTION_TIMEOUT_MS;
+	return expired || (chatBotActive && myID < leaderID);
+}
+
+/* Setzt den Arbeitsspeicher fuer eine neue Nachricht zurueck und legt den Ausgabepuffer an */
+void beginDiceMessage(struct DiceContext* ctx) {
+	arenaReset(&ctx->arena);
+	ctx->ausgabe = (char*)arenaAlloc(&ctx->arena, OUTPUT_BUFSIZE);
+	ctx->batch = NULL;
+	ctx->ausgabe[0] = '\0';
+}
+
+void seedRandomNumberGenerator(uint64 seed) {
+	struct DiceContext* ctx = getThreadDiceContext();
+	if (ctx != NULL) {
+		seedRandomState(&ctx->random, seed);
+	}
+}
+
+/* Laenge eines Wuerfelbefehls in einer Serie, endet an Leerzeichen, ';' oder Nachrichtenende */
+static int batchPartLength(const char* text) {
+	int i = 0;
+	while (text[i] != '\0' && text[i] != ' ' && text[i] != ';') {
+		i++;
+	}
+	return i;
+}
+
+/*
+ * Zerlegt "!1w20+5; 2w6+3; !1w10" in bis zu MAX_BATCH_ROLLS Ausdruecke. Nach einem Befehl ohne folgendes ';' ist
+ * die Serie zu Ende, der Rest der Nachricht bleibt wie bisher Kommentar.
+ * Gibt die Anzahl der Ausdruecke zurueck, 0 bei einem Syntaxfehler in einem der Befehle.
+ */
+static int parseBatch(const char* message, struct DiceExpression* exprs) {
+	const char* text = message + 1;
+	int count = 0;
+
+	for (;;) {
+		int length = batchPartLength(text);
+		if (count == MAX_BATCH_ROLLS || !parseDiceExpression(text, length, &exprs[count])) {
+			return 0;
+		}
+		count++;
+		text += length;
+		while (*text == ' ') {
+			text++;
+		}
+		if (*text != ';') {
+			return count;
+		}
+		text++;
+		while (*text == ' ') {
+			text++;
+		}
+		if (*text == '\0') {
+			return count;  /* abschliessendes ';' */
+		}
+		if (*text == '!') {
+			text++;
+		}
+	}
+}
+
+/* Liest "[zahl]x" am Anfang von text, z.B. "!6x 4w6kh3". Gibt 0 zurueck, wenn text keine Wiederholung ist. */
+static int parseRepeat(const char** text) {
+	int length = (int)strlen(*text);
+	int pos = 0;
+	int repeat;
+
+	if (!parseNumber(*text, length, &pos, &repeat) || pos == length || (*text)[pos] != 'x') {
+		return 0;
+	}
+	pos++;
+	while ((*text)[pos] == ' ') {
+		pos++;
+	}
+	*text += pos;
+	return repeat;
+}
+
+/*
+ * Zerlegt einen Wuerfelbefehl mit '!' in exprs (MAX_BATCH_ROLLS Eintraege). Gibt die Anzahl der Wuerfe zurueck,
+ * bei "!6x 4w6kh3" steht nur exprs[0] und *repeat ist true. 0 bei einem Syntaxfehler.
+ */
+static int parseRollCommand(const char* message, struct DiceExpression* exprs, bool* repeat) {
+	const char* text = message + 1;
+	int count = parseRepeat(&text);
+
+	*repeat = count > 0;
+	if (count == 0) {
+		return parseBatch(message, exprs);
+	}
+	if (count > MAX_REPEAT || !parseDiceExpression(text, sizeOf(text), &exprs[0]) || exprs[0].count * count > MAX_REPEAT_DICE) {
+		return 0;
+	}
+	return count;
+}
+
+/*
+ * Wuerfelt bereits zerlegte Ausdruecke: count Wuerfe einer Serie, bei repeat count mal exprs[0]. Alle Wuerfe teilen
+ * sich Zufallsfolge und faire Nachrichtennummer, die Ergebnisse liegen in der Arena und ctx->batch zeigt darauf.
+ * NULL wenn die Arena nicht reicht.
+ */
+static struct RollBatch* rollExpressions(struct DiceContext* ctx, struct DiceExpression* exprs, int count, bool repeat) {
+	struct RollBatch* batch = (struct RollBatch*)arenaAlloc(&ctx->arena, sizeof(struct RollBatch));
+	struct RollResult* rolls = (struct RollResult*)arenaAlloc(&ctx->arena, count * sizeof(struct RollResult));
+	int i, r;
+
+	if (batch == NULL) {
+		rolls = NULL;
+	}
+	else {
+		batch->exprs = exprs;
+		batch->repeat = repeat;
+	}
+	for (r = 0; rolls != NULL && r < count; r++) {
+		if (!rollResultAlloc(&ctx->arena, &rolls[r], batchExpression(batch, r)->count)) {
+			rolls = NULL;
+		}
+	}
+	if (rolls == NULL) {
+		return NULL;
+	}
+
+	beginFairMessage(&ctx->random);
+	for (r = 0; r < count; r++) {
+		const struct DiceExpression* expr = batchExpression(batch, r);
+		ctx->metrics.counters[expr->system->metric]++;
+		rollDice(&ctx->random, expr, &rolls[r]);
+		ctx->metrics.counters[METRIC_DICE] += rolls[r].count;
+		for (i = 0; i < rolls[r].count; i++) {
+			ctx->metrics.counters[METRIC_EXPLOSIONS] += rolls[r].explosions[i];
+		}
+	}
+	batch->rolls = rolls;
+	batch->count = count;
+	batch->fairMessage = ctx->random.fairMessage;
+	ctx->batch = batch;
+	return batch;
+}
+
+/*
+ * Wuerfelt und haengt das Ergebnis an out an, time ist das Ende des Zerlegens. Eine Wiederholung wird als Tabelle
+ * mit einer Zeile pro Wurf ausgegeben, zu lange Antworten teilt sendMessage an Zeilengrenzen auf.
+ */
+static bool rollParsed(struct DiceContext* ctx, struct OutputBuilder* out, struct DiceExpression* exprs, int count, bool repeat, uint64 time) {
+	struct RollBatch* batch = rollExpressions(ctx, exprs, count, repeat);
+
+	if (batch == NULL) {
+		outputAppend(out, " Syntax fehler...");
+		ctx->metrics.counters[METRIC_REJECTED]++;
+		return false;
+	}
+	time = recordTimer(ctx, TIMER_ROLL, time);
+	formatBatch(out, batch);
+	recordTimer(ctx, TIMER_FORMAT, time);
+	return true;
+}
+
+/*
+ * Wertet einen Wuerfelbefehl aus: Parser, Wurf und Ausgabe arbeiten nur auf ctx. Die komplette Antwort
+ * (bei einem Syntaxfehler die Fehlermeldung) steht danach in ctx->ausgabe. ctx muss vorher mit
+ * beginDiceMessage vorbereitet werden, alle Zwischenergebnisse liegen in dessen Arena.
+ */
+bool processRollCommand(struct DiceContext* ctx, anyID fromID, const char* fromName, const char* message) {
+	struct DiceExpression* exprs = (struct DiceExpression*)arenaAlloc(&ctx->arena, MAX_BATCH_ROLLS * sizeof(struct DiceExpression));
+	struct OutputBuilder out;
+	uint64 time = monotonicNanos();
+	bool repeat = false;
+	int count = 0;
+
+	getUserColor(ctx, fromID);
+	outputInit(&out, ctx->ausgabe, OUTPUT_BUFSIZE);
+	outputAppend(&out, "\n[color=%s][%s]", ctx->userColor, fromName);
+	if (exprs != NULL) {
+		count = parseRollCommand(message, exprs, &repeat);
+	}
+	time = recordTimer(ctx, TIMER_PARSE, time);
+	if (count == 0) {
+		//If no case is true...
+		outputAppend(&out, " Syntax fehler...");
+		ctx->metrics.counters[METRIC_REJECTED]++;
+		return false;
+	}
+	return rollParsed(ctx, &out, exprs, count, repeat, time);
+}
+
+/***************************** Hotkeys *****************************/
+
+/* Zerlegt command (ohne '!') nach roll, false bei Syntaxfehler oder zu langem Befehl */
+bool compileRoll(struct CompiledRoll* roll, const char* command) {
+	if (strlen(command) > COMMAND_MAXLEN) {
+		return false;
+	}
+	roll->command[0] = '!';
+	strcpy(roll->command + 1, command);
+	roll->count = parseRollCommand(roll->command, roll->exprs, &roll->repeat);
+	return roll->count != 0;
+}
+
+/* FNV-1a */
+static uint32_t hashKeyword(const char* keyword) {
+	uint32_t hash = 2166136261u;
+	while (*keyword != '\0') {
+		hash = (hash ^ (unsigned char)*keyword++) * 16777619u;
+	}
+	return hash;
+}
+
+static struct Hotkey* findHotkey(const char* keyword) {
+	uint32_t slot = hashKeyword(keyword) & (HOTKEY_TABLE_SIZE - 1);
+	while (hotkeyTable[slot] != 0) {
+		struct Hotkey* hotkey = &hotkeys[hotkeyTable[slot] - 1];
+		if (strcmp(hotkey->keyword, keyword) == 0) {
+			return hotkey;
+		}
+		slot = (slot + 1) & (HOTKEY_TABLE_SIZE - 1);
+	}
+	return NULL;
+}
+
+/* Zerlegt command (ohne '!') und traegt den Hotkey ein, false bei Syntaxfehler, doppeltem Namen oder voller Tabelle */
+static bool addHotkey(const char* name, int nameLength, const char* command) {
+	struct Hotkey* hotkey = &hotkeys[hotkeyCount];
+	uint32_t slot;
+
+	if (hotkeyCount == MAX_HOTKEYS) {
+		return false;
+	}
+	snprintf(hotkey->keyword, PLUGIN_HOTKEY_BUFSZ, "%s%.*s", HOTKEY_PREFIX, nameLength, name);
+	if (findHotkey(hotkey->keyword) != NULL) {
+		return false;
+	}
+	if (!compileRoll(&hotkey->roll, command)) {
+		return false;
+	}
+	slot = hashKeyword(hotkey->keyword) & (HOTKEY_TABLE_SIZE - 1);
+	while (hotkeyTable[slot] != 0) {
+		slot = (slot + 1) & (HOTKEY_TABLE_SIZE - 1);
+	}
+	hotkeyTable[slot] = (unsigned char)++hotkeyCount;
+	return true;
+}
+
+/*
+ * Liest HOTKEY_FILE, z.B.
+ *   # Name = Befehl
+ *   angriff = 1w20+5
+ *   schaden = 2w6+3; 1w6
+ * Fehlerhafte Zeilen werden mit Zeilennummer ins Client-Log geschrieben und uebersprungen.
+ */
+void loadHotkeys(const char* configPath) {
+	char path[PATH_BUFSIZE];
+	char line[COMMAND_MAXLEN + HOTKEY_NAME_MAXLEN + 16];
+	char warning[PATH_BUFSIZE + sizeof(HOTKEY_WARNING) + 2 * 12];
+	FILE* f;
+	int lineNumber = 0;
+
+	hotkeyCount = 0;
+	memset(hotkeyTable, 0, sizeof(hotkeyTable));
+	snprintf(path, PATH_BUFSIZE, "%s%s", configPath, HOTKEY_FILE);
+	if ((f = fopen(path, "r")) == NULL) {
+		return;
+	}
+	while (fgets(line, sizeof(line), f) != NULL) {
+		char* name = line;
+		char* command;
+		size_t length;
+		int nameLength;
+
+		lineNumber++;
+		if (strchr(line, '\n') == NULL) {
+			/* fgets hat nur den Anfang gelesen: der Rest der Zeile wird verworfen, nicht als neue Zeile gelesen */
+			int c = fgetc(f);
+			if (c != '\n' && c != EOF) {
+				while ((c = fgetc(f)) != '\n' && c != EOF) {
+				}
+				snprintf(warning, sizeof(warning), "%s" HOTKEY_TOO_LONG, path, lineNumber, (int)sizeof(line) - 2);
+				ts3Functions.logMessage(warning, LogLevel_WARNING, "AllDice", 0);
+				continue;
+			}
+		}
+		line[strcspn(line, "\r\n")] = '\0';
+		while (*name == ' ' || *name == '\t') {
+			name++;
+		}
+		if (*name == '\0' || *name == '#') {
+			continue;
+		}
+		nameLength = (int)strspn(name, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-");
+		command = name + nameLength;
+		while (*command == ' ' || *command == '\t') {
+			command++;
+		}
+		if (nameLength > 0 && nameLength <= HOTKEY_NAME_MAXLEN && *command == '=') {
+			command++;
+			while (*command == ' ' || *command == '\t') {
+				command++;
+			}
+			if (*command == '!') {
+				command++;
+			}
+			length = strlen(command);
+			while (length > 0 && (command[length - 1] == ' ' || command[length - 1] == '\t')) {
+				command[--length] = '\0';
+			}
+			if (addHotkey(name, nameLength, command)) {
+				continue;
+			}
+		}
+		snprintf(warning, sizeof(warning), "%s" HOTKEY_WARNING, path, lineNumber, MAX_HOTKEYS);
+		ts3Functions.logMessage(warning, LogLevel_WARNING, "AllDice", 0);
+	}
+	fclose(f);
+}
+
+/***************************** Kompakter Modus *****************************/
+
+/*
+ * Aufbau eines Pluginbefehls: COMPACT_PREFIX, danach Base64 von
+ *   Version, Name und Farbe des Wuerfelnden (je Laenge und Text), Flags (Bit 0: Wiederholung), faire Nachrichtennummer,
+ *   Anzahl Ausdruecke, je Ausdruck Laenge und Text,
+ *   Anzahl Wuerfe, je Wurf sum, total, wildTotal, criticalFailure, criticalSuccess und je Wuerfel (Augen << 3) | Flags.
+ * Alle Zahlen sind Varints (7 Bit pro Byte), vorzeichenbehaftete im ZigZag-Format. Die Wuerfelzahl pro Wurf ergibt
+ * sich beim Empfaenger aus dem erneut zerlegten Ausdruck.
+ */
+struct ByteBuffer {
+	unsigned char* data;
+	size_t length;
+	size_t capacity;
+	bool failed;           /* Schreiben ueber capacity hinaus bzw. Lesen ueber length hinaus */
+};
+
+static void putVarint(struct ByteBuffer* buffer, uint64 value) {
+	do {
+		if (buffer->length == buffer->capacity) {
+			buffer->failed = true;
+			return;
+		}
+		buffer->data[buffer->length++] = (unsigned char)((value & 0x7F) | (value > 0x7F ? 0x80 : 0));
+		value >>= 7;
+	} while (value != 0);
+}
+
+static void putSigned(struct ByteBuffer* buffer, int64_t value) {
+	putVarint(buffer, ((uint64)value << 1) ^ (uint64)(value >> 63));
+}
+
+static uint64 getVarint(struct ByteBuffer* buffer) {
+	uint64 value = 0;
+	int shift;
+	for (shift = 0; shift < 64; shift += 7) {
+		unsigned char byte;
+		if (buffer->length == buffer->capacity) {
+			break;
+		}
+		byte = buffer->data[buffer->length++];
+		value |= (uint64)(byte & 0x7F) << shift;
+		if (!(byte & 0x80)) {
+			return value;
+		}
+	}
+	buffer->failed = true;
+	return 0;
+}
+
+static int64_t getSigned(struct ByteBuffer* buffer) {
+	uint64 value = getVarint(buffer);
+	return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+/* Liest einen Varint und prueft ihn gegen [low, high], gibt bei Fehlern low zurueck */
+static int getBounded(struct ByteBuffer* buffer, int64_t low, int64_t high, bool isSigned) {
+	int64_t value = isSigned ? getSigned(buffer) : (int64_t)getVarint(buffer);
+	if (value < low || value > high) {
+		buffer->failed = true;
+		return (int)low;
+	}
+	return (int)value;
+}
+
+static const char base64Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/* Schreibt length Bytes als Base64 nach out (mindestens 4 * ((length + 2) / 3) + 1 Bytes) */
+static void base64Encode(const unsigned char* data, size_t length, char* out) {
+	size_t i;
+	for (i = 0; i < length; i += 3) {
+		uint32_t block = (uint32_t)data[i] << 16 | (i + 1 < length ? (uint32_t)data[i + 1] << 8 : 0) | (i + 2 < length ? data[i + 2] : 0);
+		*out++ = base64Alphabet[block >> 18];
+		*out++ = base64Alphabet[(block >> 12) & 63];
+		*out++ = i + 1 < length ? base64Alphabet[(block >> 6) & 63] : '=';
+		*out++ = i + 2 < length ? base64Alphabet[block & 63] : '=';
+	}
+	*out = '\0';
+}
+
+/* Dekodiert Base64 nach out (hoechstens capacity Bytes), gibt die Laenge oder -1 bei ungueltigen Zeichen zurueck */
+static int base64Decode(const char* text, unsigned char* out, size_t capacity) {
+	uint32_t block = 0;
+	size_t length = 0;
+	int bits = 0;
+
+	for (; *text != '\0' && *text != '='; text++) {
+		const char* digit = strchr(base64Alphabet, *text);
+		if (digit == NULL) {
+			return -1;
+		}
+		block = (block << 6) | (uint32_t)(digit - base64Alphabet);
+		bits += 6;
+		if (bits >= 8) {
+			bits -= 8;
+			if (length == capacity) {
+				return -1;
+			}
+			out[length++] = (unsigned char)(block >> bits);
+		}
+	}
+	return (int)length;
+}
+
+static void putText(struct ByteBuffer* buffer, const char* text, int length) {
+	int i;
+	putVarint(buffer, (uint64)length);
+	for (i = 0; i < length && !buffer->failed; i++) {
+		putVarint(buffer, (unsigned char)text[i]);
+	}
+}
+
+/* Liest einen Text mit 1 bis maxLength Zeichen aus [low, high] in die Arena, NULL bei Fehlern */
+static char* getText(struct DiceContext* ctx, struct ByteBuffer* buffer, int maxLength, int low, int high, int* length) {
+	char* text;
+	int i;
+
+	*length = getBounded(buffer, 1, maxLength, false);
+	text = (char*)arenaAlloc(&ctx->arena, (size_t)*length + 1);
+	if (buffer->failed || text == NULL) {
+		return NULL;
+	}
+	for (i = 0; i < *length; i++) {
+		text[i] = (char)getBounded(buffer, low, high, false);
+	}
+	text[*length] = '\0';
+	return buffer->failed ? NULL : text;
+}
+
+static void encodeBatch(struct ByteBuffer* buffer, const struct RollBatch* batch, const char* fromName, const char* color) {
+	int exprCount = batch->repeat ? 1 : batch->count;
+	int e, r, i;
+
+	putVarint(buffer, COMPACT_VERSION);
+	putText(buffer, fromName, (int)strlen(fromName));
+	putText(buffer, color, (int)strlen(color));
+	putVarint(buffer, batch->repeat ? 1 : 0);
+	putVarint(buffer, batch->fairMessage);
+	putVarint(buffer, (uint64)exprCount);
+	for (e = 0; e < exprCount; e++) {
+		putText(buffer, batch->exprs[e].text, batch->exprs[e].textLength);
+	}
+	putVarint(buffer, (uint64)batch->count);
+	for (r = 0; r < batch->count; r++) {
+		const struct RollResult* roll = &batch->rolls[r];
+		putSigned(buffer, roll->sum);
+		putSigned(buffer, roll->total);
+		putSigned(buffer, roll->wildTotal);
+		putVarint(buffer, (uint64)roll->criticalFailure);
+		putVarint(buffer, (uint64)roll->criticalSuccess);
+		for (i = 0; i < roll->count; i++) {
+			putSigned(buffer, (int64_t)roll->faces[i] * 8 + (roll->flags[i] & 7));
+		}
+	}
+}
+
+/*
+ * Gegenstueck zu encodeBatch fuer Pluginbefehle anderer Clients. Alles kommt aus dem Netz: jeder Wert wird
+ * geprueft, die Ausdruecke werden neu zerlegt, die Augen gegen Seitenzahl und Explosionsregeln geprueft und
+ * Summen, Markierungen und kritische Ergebnisse lokal neu berechnet. Weichen die uebertragenen Werte davon ab,
+ * wird der Befehl verworfen. Der uebertragene Name wird nur uebersprungen, angezeigt wird der des Absenders.
+ */
+static bool decodeBatch(struct DiceContext* ctx, struct ByteBuffer* buffer, struct RollBatch* batch) {
+	int exprCount, e, r, i, length, dice = 0;
+	const char* fromName;
+	const char* color;
+
+	if (getVarint(buffer) != COMPACT_VERSION) {
+		return false;
+	}
+	fromName = getText(ctx, buffer, TS3_MAX_SIZE_CLIENT_NICKNAME, 32, 255, &length);
+	color = getText(ctx, buffer, COLOR_BUFSIZE - 1, 33, 126, &length);
+	if (fromName == NULL || color == NULL || strpbrk(color, "[]") != NULL) {
+		return false;  /* die Farbe landet in einem BBCode-Tag */
+	}
+	strcpy(ctx->userColor, color);
+	batch->repeat = getBounded(buffer, 0, 1, false);
+	batch->fairMessage = getVarint(buffer);
+	exprCount = getBounded(buffer, 1, MAX_BATCH_ROLLS, false);
+	if (buffer->failed || (batch->repeat && exprCount != 1)) {
+		return false;
+	}
+	batch->exprs = (struct DiceExpression*)arenaAlloc(&ctx->arena, exprCount * sizeof(struct DiceExpression));
+	if (batch->exprs == NULL) {
+		return false;
+	}
+	for (e = 0; e < exprCount; e++) {
+		const char* text = getText(ctx, buffer, COMMAND_MAXLEN, 33, 126, &length);  /* druckbar, ohne Leerzeichen */
+		if (text == NULL || !parseDiceExpression(text, length, &batch->exprs[e])) {
+			return false;
+		}
+	}
+	batch->count = getBounded(buffer, 1, batch->repeat ? MAX_REPEAT : MAX_BATCH_ROLLS, false);
+	if (buffer->failed || (!batch->repeat && batch->count != exprCount)) {
+		return false;
+	}
+	batch->rolls = (struct RollResult*)arenaAlloc(&ctx->arena, batch->count * sizeof(struct RollResult));
+	if (batch->rolls == NULL) {
+		return false;
+	}
+	for (r = 0; r < batch->count; r++) {
+		const struct DiceExpression* expr = batchExpression(batch, r);
+		struct RollResult* roll = &batch->rolls[r];
+		int sum, total, wildTotal, criticalFailure, criticalSuccess;
+		unsigned char* flags;
+		dice += expr->count;
+		if (dice > MAX_REPEAT_DICE || !rollResultAlloc(&ctx->arena, roll, expr->count)
+			|| (flags = (unsigned char*)arenaAlloc(&ctx->arena, (size_t)expr->count)) == NULL) {
+			return false;
+		}
+		sum = getBounded(buffer, -MAX_EXPLODING_TOTAL, MAX_EXPLODING_TOTAL, true);
+		total = getBounded(buffer, -MAX_EXPLODING_TOTAL - MAX_MODIFIER, MAX_EXPLODING_TOTAL + MAX_MODIFIER, true);
+		wildTotal = getBounded(buffer, -MAX_EXPLODING_TOTAL - MAX_MODIFIER, MAX_EXPLODING_TOTAL + MAX_MODIFIER, true);
+		criticalFailure = getBounded(buffer, 0, 3, false);
+		criticalSuccess = getBounded(buffer, 0, 1, false);
+		for (i = 0; i < expr->count; i++) {
+			int64_t packed = getSigned(buffer);
+			if (packed < -(int64_t)MAX_EXPLODING_TOTAL * 8 || packed > (int64_t)MAX_EXPLODING_TOTAL * 8) {
+				return false;
+			}
+			roll->faces[i] = (int)(packed >> 3);  /* arithmetisch, (Augen << 3) | Flags */
+			flags[i] = (unsigned char)(packed & 7);
+		}
+		roll->criticalFailure = criticalFailure;
+		if (buffer->failed || !checkDice(expr, roll)) {
+			return false;
+		}
+		if (roll->sum != sum || roll->total != total || roll->wildTotal != wildTotal || roll->criticalFailure != criticalFailure
+			|| roll->criticalSuccess != criticalSuccess || memcmp(roll->flags, flags, (size_t)roll->count) != 0) {
+			return false;
+		}
+	}
+	return buffer->length == buffer->capacity;
+}
+
+/*
+ * Kompakter Modus: schickt ctx->batch als Pluginbefehl in den Channel und ersetzt ctx->ausgabe durch die Kurzfassung.
+ * Die ausfuehrliche Ausgabe bekommt der eigene Client lokal. Passt der Befehl nicht in messageSizeLimit, bleibt
+ * es bei der normalen Textnachricht.
+ */
+static void sendCompactBatch(struct DiceContext* ctx, uint64 serverConnectionHandlerID, const char* fromName) {
+	struct ByteBuffer buffer;
+	struct OutputBuilder out;
+	size_t limit = (size_t)messageSizeLimit;
+	char* command;
+
+	buffer.capacity = (limit - sizeof(COMPACT_PREFIX)) / 4 * 3;
+	buffer.data = (unsigned char*)arenaAlloc(&ctx->arena, buffer.capacity);
+	buffer.length = 0;
+	buffer.failed = false;
+	command = (char*)arenaAlloc(&ctx->arena, limit + 1);
+	if (buffer.data == NULL || command == NULL) {
+		return;
+	}
+	encodeBatch(&buffer, ctx->batch, fromName, ctx->userColor);
+	if (buffer.failed) {
+		return;
+	}
+	strcpy(command, COMPACT_PREFIX);
+	base64Encode(buffer.data, buffer.length, command + strlen(COMPACT_PREFIX));
+	ts3Functions.sendPluginCommand(serverConnectionHandlerID, pluginID, command, PluginCommandTarget_CURRENT_CHANNEL, NULL, NULL);
+	ctx->metrics.counters[METRIC_SENT_COMMANDS]++;
+	ctx->metrics.counters[METRIC_SENT_BYTES] += strlen(command);
+
+	ts3Functions.printMessage(serverConnectionHandlerID, ctx->ausgabe, PLUGIN_MESSAGE_TARGET_CHANNEL);
+	outputInit(&out, ctx->ausgabe, OUTPUT_BUFSIZE);
+	outputAppend(&out, "\n[color=%s][%s]", ctx->userColor, fromName);
+	formatBatchSummary(&out, ctx->batch);
+}
+
+static int processorCount() {
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (int)info.dwNumberOfProcessors;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (int)count : 1;
+#endif
+}
+
+static THREAD_FUNCTION(workerThread) {
+	struct WorkerThread* self = (struct WorkerThread*)arg;
+	struct WorkerPool* pool = self->pool;
+	uint64 seen = 0;
+
+	mutexLock(&pool->mutex);
+	for (;;) {
+		WorkerTask task;
+		WorkerDone done;
+		void* taskArg;
+
+		while (!pool->shutdown && pool->generation == seen) {
+			conditionWait(&pool->wake, &pool->mutex);
+		}
+		if (pool->generation == seen) {
+			break;  /* beendet und nichts mehr offen; eine ausstehende Aufgabe laeuft noch, sonst wartet workerPoolStop auf busy */
+		}
+		seen = pool->generation;
+		task = pool->task;
+		done = pool->done;
+		taskArg = pool->arg;
+		mutexUnlock(&pool->mutex);
+
+		task(taskArg, self->index);
+
+		mutexLock(&pool->mutex);
+		if (--pool->busy == 0) {
+			mutexUnlock(&pool->mutex);
+			if (done != NULL) {
+				done(taskArg);
+			}
+			mutexLock(&pool->mutex);
+			conditionBroadcast(&pool->idle);
+		}
+	}
+	mutexUnlock(&pool->mutex);
+	return THREAD_RETURN;
+}
+
+/* Startet beim ersten Aufruf einen Worker pro Prozessorkern, danach passiert nichts mehr */
+bool workerPoolStart(struct WorkerPool* pool) {
+	int wanted, i;
+
+	if (pool->started) {
+		return true;
+	}
+	wanted = processorCount();
+	if (wanted > WORKER_MAX_THREADS) {
+		wanted = WORKER_MAX_THREADS;
+	}
+	mutexInit(&pool->mutex);
+	conditionInit(&pool->wake);
+	conditionInit(&pool->idle);
+	pool->shutdown = false;
+	pool->busy = 0;
+	pool->count = 0;
+	for (i = 0; i < wanted; i++) {
+		pool->workers[i].pool = pool;
+		pool->workers[i].index = i;
+		if (!threadStart(&pool->threads[i], workerThread, &pool->workers[i])) {
+			break;
+		}
+		pool->count++;
+	}
+	if (pool->count == 0) {
+		conditionDestroy(&pool->idle);
+		conditionDestroy(&pool->wake);
+		mutexDestroy(&pool->mutex);
+		return false;
+	}
+	pool->started = true;
+	return true;
+}
+
+/* Laesst task(arg, worker) auf allen Workern laufen, der zuletzt fertige Worker ruft danach done(arg) auf */
+void workerPoolRun(struct WorkerPool* pool, WorkerTask task, WorkerDone done, void* arg) {
+	mutexLock(&pool->mutex);
+	pool->task = task;
+	pool->done = done;
+	pool->arg = arg;
+	pool->busy = pool->count;
+	pool->generation++;
+	conditionBroadcast(&pool->wake);
+	mutexUnlock(&pool->mutex);
+}
+
+/* Wartet auf die laufende Aufgabe und beendet alle Worker */
+void workerPoolStop(struct WorkerPool* pool) {
+	int i;
+
+	if (!pool->started) {
+		return;
+	}
+	mutexLock(&pool->mutex);
+	pool->shutdown = true;
+	while (pool->busy > 0) {
+		conditionWait(&pool->idle, &pool->mutex);
+	}
+	conditionBroadcast(&pool->wake);
+	mutexUnlock(&pool->mutex);
+	for (i = 0; i < pool->count; i++) {
+		threadJoin(pool->threads[i]);
+	}
+	conditionDestroy(&pool->idle);
+	conditionDestroy(&pool->wake);
+	mutexDestroy(&pool->mutex);
+	pool->started = false;
+	pool->count = 0;
+}
+
+void shardPoolInit() {
+	mutexInit(&shardPool.mutex);
+}
+
+/* Shard eines Channels, fest solange die Anzahl der Shards gleich bleibt; nur mit shardPool.mutex und count > 0 */
+static int shardIndex(uint64 serverConnectionHandlerID, uint64 channelID) {
+	uint64 key = serverConnectionHandlerID * 0x9e3779b97f4a7c15ULL ^ channelID;
+	return (int)(splitmix64(&key) % (uint64)shardPool.count);
+}
+
+static THREAD_FUNCTION(shardThread) {
+	struct Shard* shard = (struct Shard*)arg;
+
+	mutexLock(&shard->mutex);
+	for (;;) {
+		struct ShardMessage* entry;
+
+		while (shard->count == 0 && !shard->shutdown) {
+			conditionWait(&shard->wake, &shard->mutex);
+		}
+		if (shard->count == 0) {
+			break;  /* beendet und leer */
+		}
+		if (shard->reseed) {
+			struct DiceContext* ctx = getThreadDiceContext();
+			if (ctx != NULL) {
+				seedRandomState(&ctx->random, shard->seed);
+			}
+			shard->reseed = false;
+		}
+		entry = &shard->entries[shard->head];
+		mutexUnlock(&shard->mutex);
+
+		/* Der Eintrag bleibt belegt, bis er verarbeitet ist, der Callback-Thread schreibt nur in freie */
+		handleTextMessage(entry->serverConnectionHandlerID, entry->targetMode, entry->toID, entry->fromID, entry->fromName, entry->fromUniqueIdentifier, entry->message, entry->channelID);
+
+		mutexLock(&shard->mutex);
+		shard->head = (shard->head + 1) % SHARD_QUEUE_SIZE;
+		shard->count--;
+		conditionBroadcast(&shard->space);
+	}
+	mutexUnlock(&shard->mutex);
+	return THREAD_RETURN;
+}
+
+/* Wie shardPoolDrain, der Aufrufer haelt shardPool.mutex */
+static void drainShards() {
+	int i;
+
+	for (i = 0; i < shardPool.count; i++) {
+		struct Shard* shard = &shardPool.shards[i];
+		mutexLock(&shard->mutex);
+		while (shard->count > 0) {
+			conditionWait(&shard->space, &shard->mutex);
+		}
+		mutexUnlock(&shard->mutex);
+	}
+}
+
+/* Wartet, bis alle Shards ihre Warteschlangen abgearbeitet haben */
+void shardPoolDrain() {
+	mutexLock(&shardPool.mutex);
+	drainShards();
+	mutexUnlock(&shardPool.mutex);
+}
+
+/* Wie shardPoolStop, der Aufrufer haelt shardPool.mutex */
+static void stopShards() {
+	int count = shardPool.count;
+	int i;
+
+	shardPool.count = 0;  /* neue Befehle laufen ab jetzt im Callback-Thread */
+	for (i = 0; i < count; i++) {
+		struct Shard* shard = &shardPool.shards[i];
+		mutexLock(&shard->mutex);
+		shard->shutdown = true;
+		conditionBroadcast(&shard->wake);
+		mutexUnlock(&shard->mutex);
+		threadJoin(shard->thread);
+		conditionDestroy(&shard->space);
+		conditionDestroy(&shard->wake);
+		mutexDestroy(&shard->mutex);
+		free(shard->entries);
+		shard->entries = NULL;
+	}
+}
+
+/* Arbeitet alle wartenden Befehle ab und beendet die Shards */
+void shardPoolStop() {
+	mutexLock(&shardPool.mutex);
+	stopShards();
+	mutexUnlock(&shardPool.mutex);
+}
+
+/* Anzahl der laufenden Shards, 0 = alle Befehle im Callback-Thread */
+int shardPoolCount() {
+	int count;
+
+	mutexLock(&shardPool.mutex);
+	count = shardPool.count;
+	mutexUnlock(&shardPool.mutex);
+	return count;
+}
+
+/*
+ * Startet count Shards (0 = einer pro Prozessorkern), laufende Shards werden vorher geleert und beendet.
+ * Gibt die Anzahl der gestarteten Shards zurueck, 0 heisst alles laeuft wieder im Callback-Thread.
+ */
+int shardPoolStart(int count) {
+	int i;
+
+	mutexLock(&shardPool.mutex);
+	stopShards();
+	if (count <= 0) {
+		count = processorCount();
+	}
+	if (count > WORKER_MAX_THREADS) {
+		count = WORKER_MAX_THREADS;
+	}
+	for (i = 0; i < count; i++) {
+		struct Shard* shard = &shardPool.shards[i];
+		memset(shard, 0, sizeof(*shard));
+		shard->index = i;
+		if ((shard->entries = (struct ShardMessage*)malloc(SHARD_QUEUE_SIZE * sizeof(struct ShardMessage))) == NULL) {
+			break;
+		}
+		mutexInit(&shard->mutex);
+		conditionInit(&shard->wake);
+		conditionInit(&shard->space);
+		if (!threadStart(&shard->thread, shardThread, shard)) {
+			conditionDestroy(&shard->space);
+			conditionDestroy(&shard->wake);
+			mutexDestroy(&shard->mutex);
+			free(shard->entries);
+			break;
+		}
+	}
+	shardPool.count = i;
+	mutexUnlock(&shardPool.mutex);
+	return i;
+}
+
+/* Eigene Zufallsfolge je Shard, aus seed abgeleitet, gilt ab der naechsten Nachricht des Shards */
+void shardPoolSeed(uint64 seed) {
+	int i;
+
+	mutexLock(&shardPool.mutex);
+	for (i = 0; i < shardPool.count; i++) {
+		struct Shard* shard = &shardPool.shards[i];
+		uint64 key = seed + (uint64)i;
+		mutexLock(&shard->mutex);
+		shard->seed = splitmix64(&key);
+		shard->reseed = true;
+		mutexUnlock(&shard->mutex);
+	}
+	mutexUnlock(&shardPool.mutex);
+}
+
+/* Wie _strcpy, kuerzt aber zu lange Texte statt abzubrechen (strcpy_s), NULL wird zu "" */
+static void copyTruncated(char* dest, size_t destSize, const char* src) {
+	size_t length = src != NULL ? strlen(src) : 0;
+	if (length >= destSize) {
+		length = destSize - 1;
+	}
+	memcpy(dest, src != NULL ? src : "", length);
+	dest[length] = '\0';
+}
+
+/*
+ * Reiht einen Chatbefehl beim Shard des Absender-Channels ein, bei voller Warteschlange wartet der
+ * Callback-Thread. Befehle des eigenen Clients (!an, !aus, !fair ...) aendern den Zustand aller Channels:
+ * sie laufen erst, wenn alle Shards leer sind, im Callback-Thread (Rueckgabe false). Ohne Shards ebenfalls false.
+ * shardPool.mutex bleibt bis zum Einreihen gehalten, damit /alldice shards den Shard nicht darunter beendet.
+ */
+static bool shardDispatch(uint64 serverConnectionHandlerID, anyID targetMode, anyID toID, anyID fromID, const char* fromName, const char* fromUniqueIdentifier, const char* message) {
+	struct ShardMessage* entry;
+	struct Shard* shard;
+	uint64 channelID;
+
+	mutexLock(&shardPool.mutex);
+	if (shardPool.count == 0) {
+		mutexUnlock(&shardPool.mutex);
+		return false;
+	}
+	if (ownClientID(serverConnectionHandlerID) == fromID) {
+		drainShards();
+		mutexUnlock(&shardPool.mutex);
+		return false;
+	}
+	channelID = clientChannel(serverConnectionHandlerID, fromID);
+	shard = &shardPool.shards[shardIndex(serverConnectionHandlerID, channelID)];
+
+	mutexLock(&shard->mutex);
+	while (shard->count == SHARD_QUEUE_SIZE) {
+		conditionWait(&shard->space, &shard->mutex);
+	}
+	entry = &shard->entries[(shard->head + shard->count) % SHARD_QUEUE_SIZE];
+	entry->serverConnectionHandlerID = serverConnectionHandlerID;
+	entry->channelID = channelID;
+	entry->targetMode = targetMode;
+	entry->toID = toID;
+	entry->fromID = fromID;
+	copyTruncated(entry->fromName, TS3_MAX_SIZE_CLIENT_NICKNAME, fromName);
+	copyTruncated(entry->fromUniqueIdentifier, IDENTITY_UID_SIZE, fromUniqueIdentifier);
+	copyTruncated(entry->message, SHARD_MESSAGE_SIZE, message);
+	shard->count++;
+	conditionBroadcast(&shard->wake);
+	mutexUnlock(&shard->mutex);
+	mutexUnlock(&shardPool.mutex);
+	return true;
+}
+
+/*
+ * Monte-Carlo-Simulation (!sim). Die Versuche laufen im Worker-Pool, jeder Worker holt sich Bloecke von
+ * SIMULATION_CHUNK Versuchen ueber einen atomaren Zaehler, bis alle vergeben sind. Der Worker, der als
+ * letzter fertig wird, fasst die Ergebnisse zusammen und sendet sie.
+ */
+static void formatSimulationResult(struct OutputBuilder* out, const struct SimulationJob* job, const struct SimulationStats* total, double seconds) {
+	static const int percentiles[] = { 5, 25, 50, 75, 95 };
+	double mean = (double)total->sum / (double)total->trials;
+	double variance = total->sumSquares / (double)total->trials - mean * mean;
+	int i;
+
+	outputAppend(out, "[ZZW DiceBot] Simulation %s: %llu Versuche in %.2f s (%.1f Mio/s, %d Threads)%s\n", job->text,
+		(unsigned long long)total->trials, seconds, seconds > 0 ? total->trials / seconds / 1e6 : 0.0, job->threads,
+		job->cancel ? " - abgebrochen" : "");
+	outputAppend(out, "Mittelwert: %.3f, Standardabweichung: %.3f, Min: %lld, Max: %lld\nPerzentile:", mean,
+		variance > 0 ? sqrt(variance) : 0.0, (long long)total->min, (long long)total->max);
+	for (i = 0; i < (int)(sizeof(percentiles) / sizeof(percentiles[0])); i++) {
+		uint64 target = (total->trials * percentiles[i] + 99) / 100;
+		uint64 seen = 0;
+		int bucket;
+		for (bucket = 0; bucket < SIMULATION_BUCKETS - 1; bucket++) {
+			seen += total->counts[bucket];
+			if (seen >= target) {
+				break;
+			}
+		}
+		outputAppend(out, "%s %d%%: %s%lld", i == 0 ? "" : ",", percentiles[i],
+			bucket == SIMULATION_BUCKETS - 1 ? ">=" : job->bucketWidth > 1 ? "ca. " : "",
+			(long long)(job->low + (int64_t)bucket * job->bucketWidth));
+	}
+	if (job->hasTarget) {
+		outputAppend(out, "\nErfolgswahrscheinlichkeit (>= %d): %.2f%%", job->target, 100.0 * total->successes / total->trials);
+	}
+}
+
+static void simulationWorker(void* arg, int worker) {
+	struct SimulationJob* job = (struct SimulationJob*)arg;
+	struct SimulationStats* stats = &job->stats[worker];
+	struct RandomState* random = &job->random[worker];
+	int faces[MAX_DICE];
+	int explosions[MAX_DICE];
+	unsigned char flags[MAX_DICE];
+	struct RollResult roll;
+	uint64 chunk, i;
+
+	roll.faces = faces;
+	roll.explosions = explosions;
+	roll.flags = flags;
+	while (!job->cancel && (chunk = atomicIncrement64(&job->nextChunk) - 1) * SIMULATION_CHUNK < job->trials) {
+		uint64 end = (chunk + 1) * SIMULATION_CHUNK < job->trials ? (chunk + 1) * SIMULATION_CHUNK : job->trials;
+		for (i = chunk * SIMULATION_CHUNK; i < end; i++) {
+			int64_t value, bucket;
+			rollDice(random, &job->expr, &roll);
+			value = rollValue(&job->expr, &roll);
+			bucket = (value - job->low) / job->bucketWidth;
+			stats->counts[bucket < 0 ? 0 : bucket >= SIMULATION_BUCKETS ? SIMULATION_BUCKETS - 1 : bucket]++;
+			stats->sum += value;
+			stats->sumSquares += (double)value * (double)value;
+			if (value < stats->min) {
+				stats->min = value;
+			}
+			if (value > stats->max) {
+				stats->max = value;
+			}
+			if (job->hasTarget && value >= job->target) {
+				stats->successes++;
+			}
+		}
+		stats->trials += end - chunk * SIMULATION_CHUNK;
+		atomicAdd64(&job->completed, end - chunk * SIMULATION_CHUNK);
+	}
+}
+
+/* Laeuft im letzten fertigen Worker: Ergebnisse zusammenfassen und an den Aufrufer senden */
+static void simulationFinished(void* arg) {
+	struct SimulationJob* job = (struct SimulationJob*)arg;
+	struct DiceContext* ctx = getThreadDiceContext();
+	struct SimulationStats* total;
+	struct OutputBuilder out;
+	int w, b;
+
+	if (ctx != NULL && !workerPool.shutdown) {
+		beginDiceMessage(ctx);
+		total = (struct SimulationStats*)arenaAlloc(&ctx->arena, sizeof(struct SimulationStats));
+		if (total != NULL) {
+			memset(total, 0, sizeof(struct SimulationStats));
+			total->min = INT64_MAX;
+			total->max = INT64_MIN;
+			for (w = 0; w < job->threads; w++) {
+				const struct SimulationStats* stats = &job->stats[w];
+				for (b = 0; b < SIMULATION_BUCKETS; b++) {
+					total->counts[b] += stats->counts[b];
+				}
+				total->trials += stats->trials;
+				total->sum += stats->sum;
+				total->sumSquares += stats->sumSquares;
+				total->successes += stats->successes;
+				if (stats->trials > 0 && stats->min < total->min) {
+					total->min = stats->min;
+				}
+				if (stats->trials > 0 && stats->max > total->max) {
+					total->max = stats->max;
+				}
+			}
+			outputInit(&out, ctx->ausgabe, OUTPUT_BUFSIZE);
+			if (total->trials == 0) {
+				outputAppend(&out, "[ZZW DiceBot] Simulation %s abgebrochen", job->text);
+			}
+			else {
+				formatSimulationResult(&out, job, total, (monotonicNanos() - job->start) / 1e9);
+			}
+			if (job->local) {
+				ts3Functions.printMessageToCurrentTab(ctx->ausgabe);
+			}
+			else {
+				sendMessage(job->serverConnectionHandlerID, ctx->ausgabe, job->channelID, job->fromID, job->isPrivate);
+			}
+		}
+	}
+	atomicCompareExchange64(&simulationRunning, 1, 0);  /* mit Barriere, der naechste Job sieht alle Schreibzugriffe */
+}
+
+/* Wertebereich fuer die Perzentile, Werte ausserhalb landen im ersten bzw. letzten Bucket */
+static void simulationRange(struct SimulationJob* job) {
+	int64_t high;
+
+	job->expr.system->range(&job->expr, &job->low, &high);
+	job->bucketWidth = (high - job->low + SIMULATION_BUCKETS - 1) / SIMULATION_BUCKETS;
+	if (job->bucketWidth < 1) {
+		job->bucketWidth = 1;
+	}
+}
+
+/*
+ * Startet "!sim [ausdruck] [versuche] [ziel]" im Hintergrund. Die Zufallsfolgen der Worker werden per Sprung aus dem
+ * Generator des Aufrufers abgeleitet, mit festem Seed ist das Ergebnis damit reproduzierbar. Gibt false zurueck und
+ * schreibt den Grund nach ctx->ausgabe, wenn die Simulation nicht gestartet werden konnte. Mit local (/alldice dist)
+ * geht das Ergebnis nur ins eigene Chatfenster. Fremde Clients sind auf SIMULATION_REMOTE_MAX_TRIALS Versuche und
+ * einen Start je SIMULATION_REMOTE_INTERVAL_MS begrenzt, damit sie nicht alle Kerne des Besitzers belegen koennen.
+ */
+bool startSimulation(struct DiceContext* ctx, uint64 serverConnectionHandlerID, uint64 channelID, anyID fromID, bool isPrivate, bool local, const char* arguments) {
+	struct SimulationJob* job = &simulationJob;
+	char* end;
+	const char* expression = arguments;
+	int length, w;
+	unsigned long long trials = SIMULATION_DEFAULT_TRIALS;
+
+	while (*expression == ' ') {
+		expression++;
+	}
+	if (*expression == '!') {
+		expression++;
+	}
+	length = sizeOf(expression);
+	if (length == 0 || length >= (int)sizeof(job->text) - 1) {
+		snprintf(ctx->ausgabe, OUTPUT_BUFSIZE, "[ZZW DiceBot] !sim [ausdruck] [versuche] [ziel], z.B. !sim 3w6+2 1000000 15");
+		return false;
+	}
+	if (!atomicCompareExchange64(&simulationRunning, 0, 1)) {
+		snprintf(ctx->ausgabe, OUTPUT_BUFSIZE, "[ZZW DiceBot] Es laeuft bereits eine Simulation (!sim status, !sim stop)");
+		return false;
+	}
+	if (!workerPoolStart(&workerPool)) {
+		simulationRunning = 0;
+		snprintf(ctx->ausgabe, OUTPUT_BUFSIZE, "[ZZW DiceBot] Simulation konnte nicht gestartet werden");
+		return false;
+	}
+
+	job->text[0] = '!';
+	memcpy(job->text + 1, expression, length);
+	job->text[length + 1] = '\0';
+	job->hasTarget = false;
+	expression += length;
+	if (*expression == ' ') {
+		trials = strtoull(expression, &end, 10);
+		if (end != expression && *end == ' ') {
+			long target = strtol(end, &end, 10);
+			job->hasTarget = target >= -MAX_MODIFIER * 2 && target <= (long)MAX_SIDES * MAX_DICE;
+			job->target = (int)target;
+		}
+	}
+	if (!parseDiceExpression(job->text + 1, sizeOf(job->text + 1), &job->expr) || trials < 1 || trials > SIMULATION_MAX_TRIALS) {
+		simulationRunning = 0;
+		snprintf(ctx->ausgabe, OUTPUT_BUFSIZE, "[ZZW DiceBot] Simulation: ungueltiger Ausdruck oder mehr als %llu Versuche", (unsigned long long)SIMULATION_MAX_TRIALS);
+		return false;
+	}
+	if (!local && fromID != ownClientID(serverConnectionHandlerID)) {
+		/* nur unter simulationRunning gelesen und geschrieben */
+		static uint64 nextRemoteStart = 0;
+		uint64 now = monotonicNanos();
+		if (trials > SIMULATION_REMOTE_MAX_TRIALS) {
+			simulationRunning = 0;
+			snprintf(ctx->ausgabe, OUTPUT_BUFSIZE, "[ZZW DiceBot] Simulation: fuer andere Clients hoechstens %llu Versuche", (unsigned long long)SIMULATION_REMOTE_MAX_TRIALS);
+			return false;
+		}
+		if (now < nextRemoteStart) {
+			simulationRunning = 0;
+			snprintf(ctx->ausgabe, OUTPUT_BUFSIZE, "[ZZW DiceBot] Simulation: naechste fuer andere Clients in %d s", (int)((nextRemoteStart - now) / 1000000000ull) + 1);
+			return false;
+		}
+		nextRemoteStart = now + SIMULATION_REMOTE_INTERVAL_MS * 1000000ull;
+	}
+	job->expr.text = job->text + 1;
+	if (job->expr.system->hasDefaultTarget && !job->hasTarget) {
+		job->hasTarget = true;
+		job->target = job->expr.system->defaultTarget;
+	}
+
+	simulationRange(job);
+	job->trials = trials;
+	job->threads = workerPool.count;
+	job->nextChunk = 0;
+	job->completed = 0;
+	job->cancel = false;
+	job->serverConnectionHandlerID = serverConnectionHandlerID;
+	job->channelID = channelID;
+	job->fromID = fromID;
+	job->isPrivate = isPrivate;
+	job->local = local;
+	for (w = 0; w < job->threads; w++) {
+		memset(&job->stats[w], 0, sizeof(struct SimulationStats));
+		job->stats[w].min = INT64_MAX;
+		job->stats[w].max = INT64_MIN;
+		jumpRandomState(&ctx->random);
+		job->random[w] = ctx->random;
+		job->random[w].fair = false;
+	}
+	jumpRandomState(&ctx->random);
+	job->start = monotonicNanos();
+
+	snprintf(ctx->ausgabe, OUTPUT_BUFSIZE, "[ZZW DiceBot] Simulation %s mit %llu Versuchen gestartet (%d Threads)", job->text, trials, job->threads);
+	workerPoolRun(&workerPool, simulationWorker, simulationFinished, job);
+	return true;
+}
+
+void formatSimulationStatus(struct OutputBuilder* out) {
+	const struct SimulationJob* job = &simulationJob;
+	uint64 completed = job->completed;
+	double seconds = (monotonicNanos() - job->start) / 1e9;
+
+	if (!simulationRunning) {
+		outputAppend(out, "[ZZW DiceBot] Es laeuft keine Simulation");
+		return;
+	}
+	outputAppend(out, "[ZZW DiceBot] Simulation %s: %llu von %llu Versuchen (%.0f%%), %.1f Mio/s", job->text, (unsigned long long)completed,
+		(unsigned long long)job->trials, 100.0 * completed / job->trials, seconds > 0 ? completed / seconds / 1e6 : 0.0);
+}
+
+/***************************** Kontextmenue *****************************/
+
+/* !metrics und Menuepunkt "Messwerte": Zaehler aller Threads ins eigene Chatfenster */
+static void printMetrics(struct DiceContext* ctx, uint64 serverConnectionHandlerID, uint64 channelID) {
+	struct Metrics* metrics = (struct Metrics*)arenaAlloc(&ctx->arena, sizeof(struct Metrics));
+	struct OutputBuilder out;
+
+	if (metrics == NULL) {
+		return;
+	}
+	collectMetrics(metrics);
+	outputInit(&out, ctx->ausgabe, OUTPUT_BUFSIZE);
+	outputAppend(&out, "[ZZW DiceBot] Messwerte:\n");
+	formatMetrics(&out, metrics);
+	outputAppend(&out, "\nEigener Channel: %d Clients", channelMemberCount(serverConnectionHandlerID, channelID));
+	ts3Functions.printMessageToCurrentTab(ctx->ausgabe);
+}
+
+/* Sendet in den Channel, wenn es der eigene ist, sonst nur ins eigene Chatfenster (fremde Channels sind nicht erreichbar) */
+static void menuSend(uint64 serverConnectionHandlerID, const char* msg, uint64 channelID, anyID myID) {
+	if (channelID != 0 && channelID == clientChannel(serverConnectionHandlerID, myID)) {
+		sendMessage(serverConnectionHandlerID, msg, channelID, myID, false);
+	}
+	else {
+		ts3Functions.printMessageToCurrentTab(msg);
+	}
+}
+
+/* Wuerfelt MENU_ROLL_COMMAND im Namen und in der Farbe des ausgewaehlten Clients */
+static void menuRollForClient(struct DiceContext* ctx, uint64 serverConnectionHandlerID, anyID myID, anyID clientID) {
+	struct ClientIdentity identity;
+	struct OutputBuilder out;
+	uint64 channelID = clientChannel(serverConnectionHandlerID, clientID);
+
+	if (!clientIdentity(serverConnectionHandlerID, clientID, &identity)) {
+		identityRefresh(serverConnectionHandlerID, clientID);
+		if (!clientIdentity(serverConnectionHandlerID, clientID, &identity)) {
+			return;
+		}
+	}
+	getUserColor(ctx, clientID);
+	outputInit(&out, ctx->ausgabe, OUTPUT_BUFSIZE);
+	outputAppend(&out, "\n[color=%s][%s]", ctx->userColor, identity.name);
+	if (rollParsed(ctx, &out, menuRoll.exprs, menuRoll.count, menuRoll.repeat, monotonicNanos()) && compactModeActive && channelID == clientChannel(serverConnectionHandlerID, myID)) {
+		sendCompactBatch(ctx, serverConnectionHandlerID, identity.name);
+	}
+	historyRecord(serverConnectionHandlerID, clientID, identity.name, ctx->batch);
+	menuSend(serverConnectionHandlerID, ctx->ausgabe, channelID, myID);
 }
 
-bool isHelp(char* msg) {
-	if (msg[0] == '!') {
-		if (msg[1] == 'h') {
-			if (msg[2] == 'e') {
-				if (msg[3] == 'l') {
-					if (msg[4] == 'p') {
-						return true;
-					}
-				}
+/*
+ * Initiative fuer alle Clients im Channel: die Mitglieder kommen aus der Client-Tabelle, gewuerfelt wird als eine
+ * Wiederholung des vorab zerlegten Ausdrucks, ausgegeben wird eine nach Ergebnis sortierte Nachricht.
+ */
+static void menuRollInitiative(struct DiceContext* ctx, uint64 serverConnectionHandlerID, anyID myID, uint64 channelID) {
+	struct ChannelMember* members = (struct ChannelMember*)arenaAlloc(&ctx->arena, MAX_INITIATIVE * sizeof(struct ChannelMember));
+	const struct DiceExpression* expr = &menuInitiative.exprs[0];
+	struct RollBatch* batch;
+	struct OutputBuilder out;
+	struct ClientIdentity identity;
+	uint64 time = monotonicNanos();
+	int count, i, j;
+
+	if (members == NULL || (count = channelMembers(serverConnectionHandlerID, channelID, members, MAX_INITIATIVE)) == 0) {
+		return;
+	}
+	if ((batch = rollExpressions(ctx, menuInitiative.exprs, count, true)) == NULL) {
+		return;
+	}
+	time = recordTimer(ctx, TIMER_ROLL, time);
+	for (i = 0; i < count; i++) {
+		struct ChannelMember member = members[i];
+		member.total = batch->rolls[i].total;
+		/* Einfuegen: absteigend nach Ergebnis, bei Gleichstand nach Client-ID */
+		for (j = i; j > 0 && (members[j - 1].total < member.total || (members[j - 1].total == member.total && members[j - 1].clientID > member.clientID)); j--) {
+			members[j] = members[j - 1];
+		}
+		members[j] = member;
+	}
+
+	getUserColor(ctx, myID);
+	outputInit(&out, ctx->ausgabe, OUTPUT_BUFSIZE);
+	outputAppend(&out, "\n[color=%s][%s] wuerfelt Initiative (%.*s) fuer %d Client%s", ctx->userColor,
+		clientIdentity(serverConnectionHandlerID, myID, &identity) ? identity.name : "?", expr->textLength, expr->text, count, count == 1 ? "" : "s");
+	for (i = 0; i < count; i++) {
+		outputAppend(&out, "\n %d. %s: %d", i + 1, members[i].name, members[i].total);
+	}
+	recordTimer(ctx, TIMER_FORMAT, time);
+	menuSend(serverConnectionHandlerID, ctx->ausgabe, channelID, myID);
+}
+
+/* Wie !an und !aus */
+static void menuToggleBot(uint64 serverConnectionHandlerID, anyID myID) {
+	uint64 channelID = clientChannel(serverConnectionHandlerID, myID);
+
+	if (chatBotActive) {
+		electionLeave(serverConnectionHandlerID);
+		chatBotActive = false;
+		sendMessage(serverConnectionHandlerID, "[ZZW DiceBot] Aus", channelID, myID, false);
+	}
+	else {
+		chatBotActive = true;
+		electionJoin(serverConnectionHandlerID);
+		sendMessage(serverConnectionHandlerID, "[ZZW DiceBot] An", channelID, myID, false);
+	}
+}
+
+/***************************** Konsole *****************************/
+
+/*
+ * "/alldice bench [durchlaeufe]": wertet eine feste Auswahl von Befehlen aller Systeme wiederholt aus, wie eine
+ * Chatnachricht ohne Senden. Die Laufzeiten landen in eigenen Messwerten, Zaehler und Zufallsfolge des Threads
+ * werden danach wiederhergestellt, damit der Benchmark weder !metrics noch ein Replay verfaelscht.
+ */
+static void consoleBench(struct DiceContext* ctx, const char* arguments) {
+	static const char* commands[] = {
+		"!1w20", "!3w6+2", "!4w6kh3", "!10w6e", "!sww8+1", "!f", "!dsa12/14/13+7-2", "!sr12e", "!1w20+5; 2w6+3; 1w10", "!6x 4w6kh3"
+	};
+	const int commandCount = (int)(sizeof(commands) / sizeof(commands[0]));
+	struct Metrics* saved = (struct Metrics*)malloc(sizeof(struct Metrics));
+	struct RandomState random = ctx->random;
+	struct OutputBuilder out;
+	int runs = atoi(arguments);
+	int rejected = 0, run, i, t;
+	uint64 start;
+	double seconds;
+
+	if (runs <= 0) {
+		runs = BENCH_DEFAULT_RUNS;
+	}
+	if (runs > BENCH_MAX_RUNS) {
+		runs = BENCH_MAX_RUNS;
+	}
+	if (saved == NULL) {
+		return;
+	}
+	*saved = ctx->metrics;
+	memset(&ctx->metrics, 0, sizeof(ctx->metrics));
+	start = monotonicNanos();
+	for (run = 0; run < runs; run++) {
+		for (i = 0; i < commandCount; i++) {
+			beginDiceMessage(ctx);
+			if (!processRollCommand(ctx, 0, "Benchmark", commands[i])) {
+				rejected++;
 			}
 		}
 	}
-	return false;
+	seconds = (monotonicNanos() - start) / 1e9;
+
+	beginDiceMessage(ctx);
+	outputInit(&out, ctx->ausgabe, OUTPUT_BUFSIZE);
+	outputAppend(&out, "[ZZW DiceBot] Benchmark: %d Befehle x %d Durchlaeufe in %.1f ms, %.2f us pro Befehl, %llu Wuerfel%s", commandCount, runs,
+		seconds * 1e3, seconds * 1e6 / ((double)runs * commandCount), (unsigned long long)ctx->metrics.counters[METRIC_DICE], rejected != 0 ? ", mit Syntaxfehlern" : "");
+	for (t = TIMER_PARSE; t <= TIMER_FORMAT; t++) {
+		const struct Histogram* h = &ctx->metrics.timers[t];
+		outputAppend(&out, "\n%s: p50 %.2f us, p99 %.2f us, max %.1f us", metricTimerNames[t], histogramPercentile(h, 0.5) / 1000.0,
+			histogramPercentile(h, 0.99) / 1000.0, h->max / 1000.0);
+	}
+	ctx->metrics = *saved;
+	ctx->random = random;
+	free(saved);
+	ts3Functions.printMessageToCurrentTab(ctx->ausgabe);
 }
 
-bool isOpenPrivatChat(char* msg) {
-	if (msg[0] == '!') {
-		if (msg[1] == 'p') {
-			if (msg[2] == 'm') {
-				return true;
+/*
+ * ts3plugin_processCommand: "/alldice [befehl]" wuerfelt nur fuer den eigenen Client, dazu bench, stats,
+ * dist (Simulation wie !sim) und shards. Die Ausgabe geht ins eigene Chatfenster, es wird nichts gesendet.
+ * Gibt wie vom Client erwartet 0 zurueck, wenn der Befehl behandelt wurde.
+ */
+int processConsoleCommand(uint64 serverConnectionHandlerID, const char* command) {
+	struct DiceContext* ctx = getThreadDiceContext();
+	struct ClientIdentity identity;
+	anyID myID = 0;
+	uint64 channelID = 0;
+
+	if (ctx == NULL) {
+		return 1;
+	}
+	while (*command == ' ') {
+		command++;
+	}
+	beginDiceMessage(ctx);
+	ctx->metrics.counters[METRIC_CMD_CONSOLE]++;
+	if (ts3Functions.getClientID(serverConnectionHandlerID, &myID) == ERROR_ok) {
+		channelID = clientChannel(serverConnectionHandlerID, myID);
+	}
+
+	if (strncmp(command, "bench", 5) == 0 && (command[5] == ' ' || command[5] == '\0')) {
+		consoleBench(ctx, command + 5);
+		return 0;
+	}
+	if (strcmp(command, "stats") == 0) {
+		printMetrics(ctx, serverConnectionHandlerID, channelID);
+		return 0;
+	}
+	if (strncmp(command, "shards", 6) == 0 && (command[6] == ' ' || command[6] == '\0')) {
+		const char* arguments = command + 6;
+		int count = 0;
+		while (*arguments == ' ') {
+			arguments++;
+		}
+		if (strcmp(arguments, "aus") == 0) {
+			shardPoolStop();
+		}
+		else if (*arguments != '\0') {
+			count = shardPoolStart(atoi(arguments));  /* "an" = einer pro Prozessorkern */
+		}
+		else {
+			count = shardPoolCount();
+		}
+		if (count > 0) {
+			snprintf(ctx->ausgabe, OUTPUT_BUFSIZE, "[ZZW DiceBot] %d Shards, die Befehle eines Channels laufen immer im selben Thread", count);
+		}
+		else {
+			snprintf(ctx->ausgabe, OUTPUT_BUFSIZE, "[ZZW DiceBot] Keine Shards, alle Befehle laufen im Callback-Thread");
+		}
+		ts3Functions.printMessageToCurrentTab(ctx->ausgabe);
+		return 0;
+	}
+	if (strncmp(command, "dist", 4) == 0 && (command[4] == ' ' || command[4] == '\0')) {
+		if (strcmp(command + 4, " stop") == 0) {
+			simulationJob.cancel = simulationRunning != 0;
+			snprintf(ctx->ausgabe, OUTPUT_BUFSIZE, "[ZZW DiceBot] %s", simulationRunning ? "Simulation wird abgebrochen..." : "Es laeuft keine Simulation");
+		}
+		else if (strcmp(command + 4, " status") == 0) {
+			struct OutputBuilder out;
+			outputInit(&out, ctx->ausgabe, OUTPUT_BUFSIZE);
+			formatSimulationStatus(&out);
+		}
+		else {
+			startSimulation(ctx, serverConnectionHandlerID, channelID, myID, false, true, command + 4);
+		}
+		ts3Functions.printMessageToCurrentTab(ctx->ausgabe);
+		return 0;
+	}
+	if (*command != '\0' && strcmp(command, "hilfe") != 0 && strlen(command) < COMMAND_MAXLEN) {
+		char* message = (char*)arenaAlloc(&ctx->arena, COMMAND_MAXLEN + 2);
+		if (message != NULL) {
+			snprintf(message, COMMAND_MAXLEN + 2, "!%s", command[0] == '!' ? command + 1 : command);
+			if (!clientIdentity(serverConnectionHandlerID, myID, &identity)) {
+				_strcpy(identity.name, TS3_MAX_SIZE_CLIENT_NICKNAME, "Lokal");
 			}
+			processRollCommand(ctx, myID, identity.name, message);
+			ts3Functions.printMessageToCurrentTab(ctx->ausgabe);
+			return 0;
 		}
 	}
-	return false;
+	ts3Functions.printMessageToCurrentTab("[ZZW DiceBot] /" CONSOLE_KEYWORD " [befehl] - wuerfelt nur lokal, z.B. /" CONSOLE_KEYWORD " 2w6+3\n"
+		"/" CONSOLE_KEYWORD " dist [ausdruck] [versuche] [ziel] - Simulation wie !sim, nur lokal (dist status, dist stop)\n"
+		"/" CONSOLE_KEYWORD " stats - Messwerte wie !metrics\n"
+		"/" CONSOLE_KEYWORD " bench [durchlaeufe] - Misst Parser, Wurf und Ausgabe mit festen Befehlen\n"
+		"/" CONSOLE_KEYWORD " shards [anzahl|an|aus] - Verteilt die Chatbefehle nach Channel auf Threads (an: einer pro Kern)");
+	return 0;
 }
 
-void sendMessage(uint64 serverConnectionHandlerID, char* msg, anyID channelID, anyID fromID, bool isSendPrivate) {
-	if (isSendPrivate) {
-		ts3Functions.requestSendPrivateTextMsg(serverConnectionHandlerID, msg, fromID, 0);
+/***************************** Infoanzeige *****************************/
+
+/* Markiert die Infoanzeige als veraltet, aus jedem Thread */
+void infoChanged() {
+	atomicIncrement64(&infoGeneration);
+}
+
+/* Fordert hoechstens alle INFO_REFRESH_MS eine neue Anzeige an, wenn sich seit der letzten etwas geaendert hat */
+static void infoRefresh() {
+	uint64 now = monotonicNanos();
+
+	if (infoCache.serverConnectionHandlerID == 0 || infoCache.generation == infoGeneration || now - infoRequested < INFO_REFRESH_MS * 1000000ull) {
+		return;
+	}
+	infoRequested = now;
+	ts3Functions.requestInfoUpdate(infoCache.serverConnectionHandlerID, infoCache.type, infoCache.id);
+}
+
+static void formatBotState(struct OutputBuilder* out) {
+	int shards = shardPoolCount();
+
+	outputAppend(out, "Dicebot: %s%s%s", chatBotActive ? "an" : "aus", fairModeActive ? ", fairer Modus" : "", compactModeActive ? ", kompakter Modus" : "");
+	if (shards > 0) {
+		outputAppend(out, ", %d Shards", shards);
+	}
+	outputAppend(out, "\n");
+}
+
+static void formatServerInfo(struct OutputBuilder* out, bool responds) {
+	struct Metrics* metrics = (struct Metrics*)malloc(sizeof(struct Metrics));
+	const struct Histogram* latency;
+	uint64 rolls = 0;
+	int i;
+
+	formatBotState(out);
+	outputAppend(out, "Eigener Channel: %s\n", responds ? "antwortet dieser Client" : "anderer AllDice-Client antwortet");
+	if (metrics == NULL) {
+		return;
+	}
+	collectMetrics(metrics);
+	for (i = 0; i < gameSystemCount; i++) {
+		rolls += metrics->counters[gameSystems[i].metric];
+	}
+	latency = &metrics->timers[TIMER_MESSAGE];
+	outputAppend(out, "Wuerfe: %llu, Bearbeitung p50 %.1f us, p99 %.1f us\n", (unsigned long long)rolls,
+		histogramPercentile(latency, 0.5) / 1000.0, histogramPercentile(latency, 0.99) / 1000.0);
+	formatMetrics(out, metrics);
+	free(metrics);
+}
+
+static void formatChannelInfo(struct OutputBuilder* out, uint64 serverConnectionHandlerID, uint64 channelID, bool responds) {
+	struct ClientMap* map;
+	struct ChannelMembers* channel;
+	struct ClientIdentity* identity;
+	uint64 rolls = 0;
+	int64_t sum = 0;
+	int members = 0;
+	anyID clientID, myID;
+
+	mutexLock(&clientMapMutex);
+	if ((map = findClientMap(serverConnectionHandlerID, false)) != NULL && (channel = findChannel(map, channelID, false)) != NULL) {
+		members = channel->count;
+		for (clientID = channel->first; clientID != 0; clientID = map->nextMember[clientID]) {
+			if ((identity = findIdentity(map, clientID, false)) != NULL) {
+				rolls += identity->rolls;
+				sum += identity->rollSum;
+			}
+		}
+	}
+	mutexUnlock(&clientMapMutex);
+
+	formatBotState(out);
+	outputAppend(out, "Bekannte Clients: %d\n", members);
+	if (ts3Functions.getClientID(serverConnectionHandlerID, &myID) == ERROR_ok && clientChannel(serverConnectionHandlerID, myID) == channelID) {
+		outputAppend(out, "Eigener Channel, %s\n", responds ? "antwortet dieser Client" : "anderer AllDice-Client antwortet");
+	}
+	if (rolls > 0) {
+		outputAppend(out, "Wuerfe der Clients: %llu, Durchschnitt %.2f", (unsigned long long)rolls, (double)sum / (double)rolls);
 	}
 	else {
-		ts3Functions.requestSendChannelTextMsg(serverConnectionHandlerID, msg, channelID, 0);
+		outputAppend(out, "Noch keine Wuerfe");
 	}
 }
 
-int ts3plugin_onTextMessageEvent(uint64 serverConnectionHandlerID, anyID targetMode, anyID toID, anyID fromID, const char* fromName, const char* fromUniqueIdentifier, const char* message, int ffIgnored) {
-	double version = 0.15;
+static void formatClientInfo(struct OutputBuilder* out, uint64 serverConnectionHandlerID, anyID clientID) {
+	struct ClientIdentity identity;
+	char color[COLOR_BUFSIZE];
+	int recent, i, sum = 0;
+
+	if (!clientIdentity(serverConnectionHandlerID, clientID, &identity) || identity.rolls == 0) {
+		outputAppend(out, "Noch keine Wuerfe");
+		return;
+	}
+	recent = identity.rolls < HISTORY_LENGTH ? (int)identity.rolls : HISTORY_LENGTH;
+	outputAppend(out, "Wuerfe: %llu, Durchschnitt %.2f\nLetzte Wuerfe:", (unsigned long long)identity.rolls, (double)identity.rollSum / (double)identity.rolls);
+	for (i = 0; i < recent; i++) {
+		const struct HistoryEntry* entry = &identity.history[(identity.rolls - 1 - i) % HISTORY_LENGTH];
+		outputAppend(out, "%s %s = %d", i == 0 ? "" : ",", entry->text, entry->value);
+		sum += entry->value;
+	}
+	outputAppend(out, "\nDurchschnitt der letzten %d: %.2f", recent, (double)sum / recent);
+	/* anyID ist 16 Bit breit, userColorColor hat CLIENT_ID_COUNT Eintraege */
+	mutexLock(&clientMapMutex);
+	memcpy(color, userColorColor[clientID], COLOR_BUFSIZE);
+	mutexUnlock(&clientMapMutex);
+	if (color[0] != '\0') {
+		outputAppend(out, "\nFarbe: [color=%s]%s[/color]", color, color);
+	}
+}
+
+/*
+ * Text fuer ts3plugin_infoData: Server mit Zustand und Messwerten, Channel mit Mitgliedern und deren Wuerfen,
+ * Client mit Verlauf. Liefert den Cache, solange sich nichts geaendert hat, NULL fuer unbekannte Typen.
+ */
+const char* infoDashboard(uint64 serverConnectionHandlerID, uint64 id, enum PluginItemType type) {
+	uint64 generation = infoGeneration;
+	bool responds = electionResponds(serverConnectionHandlerID, TextMessageTarget_CHANNEL);
+	struct OutputBuilder out;
+
+	if (infoCache.serverConnectionHandlerID == serverConnectionHandlerID && infoCache.type == type && infoCache.id == id &&
+		infoCache.generation == generation && infoCache.responds == responds) {
+		return infoCache.text;
+	}
+	outputInit(&out, infoCache.text, INFO_BUFSIZE);
+	switch (type) {
+		case PLUGIN_SERVER:
+			formatServerInfo(&out, responds);
+			break;
+		case PLUGIN_CHANNEL:
+			formatChannelInfo(&out, serverConnectionHandlerID, id, responds);
+			break;
+		case PLUGIN_CLIENT:
+			formatClientInfo(&out, serverConnectionHandlerID, (anyID)id);
+			break;
+		default:
+			infoCache.serverConnectionHandlerID = 0;
+			return NULL;
+	}
+	infoCache.serverConnectionHandlerID = serverConnectionHandlerID;
+	infoCache.type = type;
+	infoCache.id = id;
+	infoCache.generation = generation;
+	infoCache.responds = responds;
+	return infoCache.text;
+}
+
+/* Beendet den fairen Modus und veroeffentlicht Seed und Nachrichtenzahl, damit alle Wuerfe unter dem Commitment pruefbar sind */
+static void revealFairMode(struct DiceContext* ctx, uint64 serverConnectionHandlerID, uint64 channelID, anyID fromID) {
+	char hex[FAIR_SEED_SIZE * 2 + 1];
+	uint64 messages = fairMessageCounter;
+
+	stopFairMode(hex);
+	snprintf(ctx->ausgabe, OUTPUT_BUFSIZE, "[ZZW DiceBot] Fairer Modus aus - Seed: %s - %llu Nachrichten, Wurf k der Nachricht #m = ((ChaCha20(Seed, m * 2^32 + k)[0] * Seiten) >> 32) + 1, Fate: W81 - 1, die vier Wuerfel sind dessen Ziffern zur Basis 3 minus 1", hex, (unsigned long long)messages);
+	sendMessage(serverConnectionHandlerID, ctx->ausgabe, channelID, fromID, false);
+}
+
+/*
+ * Verarbeitet eine Chatnachricht im aufrufenden Thread (Callback-Thread oder Shard). knownChannelID ist der
+ * Channel des Absenders beim Eintreffen, 0 = hier nachschlagen.
+ */
+void handleTextMessage(uint64 serverConnectionHandlerID, anyID targetMode, anyID toID, anyID fromID, const char* fromName, const char* fromUniqueIdentifier, const char* message, uint64 knownChannelID) {
 	anyID myID;
 	bool isCommandAlreadyTriggered = false;
+	struct DiceContext* ctx = getThreadDiceContext();
+	uint64 messageStart;
+	uint64 channelID;
+
+	if (ctx == NULL) {
+		return;
+	}
+	beginDiceMessage(ctx);
+	messageStart = monotonicNanos();
+	logMetricsPeriodically(messageStart);
+	if (traceActive) {
+		ctx->traceMessage = (uint32_t)atomicIncrement64(&traceMessageCounter);
+	}
+	if (isCommand(message)) {
+		ctx->metrics.counters[METRIC_MESSAGES]++;
+	}
+	channelID = knownChannelID != 0 ? knownChannelID : clientChannel(serverConnectionHandlerID, fromID);  /* Antworten gehen in den Channel des Absenders */
 
 	if (setAn(message)) {
 		ts3Functions.getClientID(serverConnectionHandlerID, &myID);  /* Get own client ID */
 		if (myID == fromID) {
 			if (isCommandAlreadyTriggered == false) {
 				chatBotActive = true;
-				sendMessage(serverConnectionHandlerID, "[ZZW DiceBot] An", ts3Functions.getChannelOfClient, fromID, false);
+				electionJoin(serverConnectionHandlerID);
+				sendMessage(serverConnectionHandlerID, "[ZZW DiceBot] An", channelID, fromID, false);
 				isCommandAlreadyTriggered = true;
+				ctx->metrics.counters[METRIC_CMD_ADMIN]++;
 			}
 		}
 	}
@@ -1074,9 +5590,11 @@ int ts3plugin_onTextMessageEvent(uint64 serverConnectionHandlerID, anyID targetM
 		ts3Functions.getClientID(serverConnectionHandlerID, &myID);  /* Get own client ID */
 		if (myID == fromID) {
 			if (isCommandAlreadyTriggered == false) {
+				electionLeave(serverConnectionHandlerID);
 				chatBotActive = false;
-				sendMessage(serverConnectionHandlerID, "[ZZW DiceBot] Aus", ts3Functions.getChannelOfClient, fromID, false);
+				sendMessage(serverConnectionHandlerID, "[ZZW DiceBot] Aus", channelID, fromID, false);
 				isCommandAlreadyTriggered = true;
+				ctx->metrics.counters[METRIC_CMD_ADMIN]++;
 			}
 		}
 	}
@@ -1084,385 +5602,231 @@ int ts3plugin_onTextMessageEvent(uint64 serverConnectionHandlerID, anyID targetM
 		ts3Functions.getClientID(serverConnectionHandlerID, &myID);  /* Get own client ID */
 		if (myID == fromID) {
 			if (isCommandAlreadyTriggered == false) {
-				char ausgabe[19999] = "[ZZW DiceBot] Installierte Version des ZZW-DiceBots: 0.17 - [url=https://www.dropbox.com/sh/sh85x3ta6zkx2y3/AAAHuqGE_UjCQjrIQa5363QKa?dl=0]Hier der Link zum Download";
-				sendMessage(serverConnectionHandlerID, ausgabe, ts3Functions.getChannelOfClient, fromID, false);
+				sendMessage(serverConnectionHandlerID, "[ZZW DiceBot] Installierte Version des ZZW-DiceBots: 0.17 - [url=https://www.dropbox.com/sh/sh85x3ta6zkx2y3/AAAHuqGE_UjCQjrIQa5363QKa?dl=0]Hier der Link zum Download", channelID, fromID, false);
 				isCommandAlreadyTriggered = true;
+				ctx->metrics.counters[METRIC_CMD_ADMIN]++;
+			}
+		}
+	}
+	if (isFairMode(message)) {
+		ts3Functions.getClientID(serverConnectionHandlerID, &myID);  /* Get own client ID */
+		if (myID == fromID && isCommandAlreadyTriggered == false) {
+			char hex[FAIR_SEED_SIZE * 2 + 1];
+			if (strncmp(message + 6, "an", 2) == 0) {
+				if (fairModeActive) {
+					revealFairMode(ctx, serverConnectionHandlerID, channelID, fromID);  /* alte Wuerfe bleiben pruefbar */
+				}
+				if (startFairMode(hex)) {
+					snprintf(ctx->ausgabe, OUTPUT_BUFSIZE, "[ZZW DiceBot] Fairer Modus an - Commitment SHA-256(Seed): %s", hex);
+				}
+				else {
+					snprintf(ctx->ausgabe, OUTPUT_BUFSIZE, "[ZZW DiceBot] Fairer Modus konnte nicht gestartet werden (keine Zufallsquelle)");
+				}
+				sendMessage(serverConnectionHandlerID, ctx->ausgabe, channelID, fromID, false);
+			}
+			else if (strncmp(message + 6, "aus", 3) == 0 && fairModeActive) {
+				revealFairMode(ctx, serverConnectionHandlerID, channelID, fromID);
+			}
+			ctx->metrics.counters[METRIC_CMD_ADMIN]++;
+		}
+		isCommandAlreadyTriggered = true;
+	}
+	if (isTrace(message)) {
+		ts3Functions.getClientID(serverConnectionHandlerID, &myID);  /* Get own client ID */
+		if (myID == fromID && isCommandAlreadyTriggered == false) {
+			if (strncmp(message + 7, "an", 2) == 0) {
+				if (startTrace()) {
+					snprintf(ctx->ausgabe, OUTPUT_BUFSIZE, "[ZZW DiceBot] Trace an (%d Eintraege im Ring)", TRACE_RING_SIZE);
+				}
+				else {
+					snprintf(ctx->ausgabe, OUTPUT_BUFSIZE, "[ZZW DiceBot] Trace konnte nicht gestartet werden");
+				}
+			}
+			else if (strncmp(message + 7, "aus", 3) == 0) {
+				stopTrace();
+				snprintf(ctx->ausgabe, OUTPUT_BUFSIZE, "[ZZW DiceBot] Trace aus");
+			}
+			else if (strncmp(message + 7, "dump", 4) == 0) {
+				char path[PATH_BUFSIZE];
+				size_t length;
+				int written;
+				ts3Functions.getConfigPath(path, PATH_BUFSIZE);
+				length = strlen(path);
+				snprintf(path + length, PATH_BUFSIZE - length, "alldice_trace_%llu.json", (unsigned long long)time(NULL));
+				written = writeTrace(path);
+				if (written < 0) {
+					snprintf(ctx->ausgabe, OUTPUT_BUFSIZE, "[ZZW DiceBot] Trace konnte nicht nach %s geschrieben werden", path);
+				}
+				else {
+					snprintf(ctx->ausgabe, OUTPUT_BUFSIZE, "[ZZW DiceBot] %d Trace-Eintraege nach %s geschrieben", written, path);
+				}
+			}
+			else {
+				snprintf(ctx->ausgabe, OUTPUT_BUFSIZE, "[ZZW DiceBot] !trace an, !trace aus oder !trace dump");
+			}
+			ts3Functions.printMessageToCurrentTab(ctx->ausgabe);
+			ctx->metrics.counters[METRIC_CMD_ADMIN]++;
+		}
+		isCommandAlreadyTriggered = true;
+	}
+	if (isMetrics(message)) {
+		ts3Functions.getClientID(serverConnectionHandlerID, &myID);  /* Get own client ID */
+		if (myID == fromID && isCommandAlreadyTriggered == false) {
+			printMetrics(ctx, serverConnectionHandlerID, channelID);
+			ctx->metrics.counters[METRIC_CMD_ADMIN]++;
+		}
+		isCommandAlreadyTriggered = true;
+	}
+	if (isCompactMode(message)) {
+		ts3Functions.getClientID(serverConnectionHandlerID, &myID);  /* Get own client ID */
+		if (myID == fromID && isCommandAlreadyTriggered == false) {
+			if (strncmp(message + 9, "an", 2) == 0) {
+				compactModeActive = true;
+				sendMessage(serverConnectionHandlerID, "[ZZW DiceBot] Kompakter Modus an - Wuerfe gehen als Pluginbefehl an andere AllDice-Clients, im Chat steht nur das Ergebnis", channelID, fromID, false);
 			}
+			else if (strncmp(message + 9, "aus", 3) == 0) {
+				compactModeActive = false;
+				sendMessage(serverConnectionHandlerID, "[ZZW DiceBot] Kompakter Modus aus", channelID, fromID, false);
+			}
+			ctx->metrics.counters[METRIC_CMD_ADMIN]++;
+		}
+		isCommandAlreadyTriggered = true;
+	}
+	if (isCommand(message) && isCommandAlreadyTriggered == false && !electionResponds(serverConnectionHandlerID, targetMode)) {
+		/* Ein anderer AllDice-Client fuehrt im Channel und antwortet, die Farbe merken wir uns fuer einen Wechsel */
+		if (isSetColor(message)) {
+			setUserColor(fromID, message + 7);
 		}
+		isCommandAlreadyTriggered = true;
+		ctx->metrics.counters[METRIC_DEFERRED]++;
 	}
 	if (isOpenPrivatChat(message) && chatBotActive) {
+		ts3Functions.getClientID(serverConnectionHandlerID, &myID);  /* Get own client ID */
 		if (myID == fromID) {
 			if (isCommandAlreadyTriggered == false) {
-				char ausgabe[19999] = "[ZZW DiceBot] Schreibe hier um privat zu Wuerfeln!";
-				sendMessage(serverConnectionHandlerID, ausgabe, ts3Functions.getChannelOfClient, fromID, true);
+				sendMessage(serverConnectionHandlerID, "[ZZW DiceBot] Schreibe hier um privat zu Wuerfeln!", channelID, fromID, true);
 				isCommandAlreadyTriggered = true;
+				ctx->metrics.counters[METRIC_CMD_ADMIN]++;
 			}
 		}
 		else {
 			if (isCommandAlreadyTriggered == false) {
-				char ausgabe[19999] = "[ZZW DiceBot] Schreibe hier um privat zu Wuerfeln! - Lediglich der SL kann deine Nachrichten lesen...";
-				sendMessage(serverConnectionHandlerID, ausgabe, ts3Functions.getChannelOfClient, fromID, true);
+				sendMessage(serverConnectionHandlerID, "[ZZW DiceBot] Schreibe hier um privat zu Wuerfeln! - Lediglich der SL kann deine Nachrichten lesen...", channelID, fromID, true);
 				isCommandAlreadyTriggered = true;
+				ctx->metrics.counters[METRIC_CMD_ADMIN]++;
+			}
+		}
+	}
+	if (isSimulation(message) && chatBotActive) {
+		if (isCommandAlreadyTriggered == false) {
+			bool pm = targetMode == TextMessageTarget_CLIENT;
+			if (strncmp(message + 4, " stop", 5) == 0) {
+				ts3Functions.getClientID(serverConnectionHandlerID, &myID);  /* Get own client ID */
+				if (simulationRunning && (fromID == simulationJob.fromID || fromID == myID)) {
+					simulationJob.cancel = true;
+					snprintf(ctx->ausgabe, OUTPUT_BUFSIZE, "[ZZW DiceBot] Simulation wird abgebrochen...");
+				}
+				else {
+					snprintf(ctx->ausgabe, OUTPUT_BUFSIZE, "[ZZW DiceBot] Keine eigene Simulation aktiv");
+				}
 			}
+			else if (strncmp(message + 4, " status", 7) == 0) {
+				struct OutputBuilder out;
+				outputInit(&out, ctx->ausgabe, OUTPUT_BUFSIZE);
+				formatSimulationStatus(&out);
+			}
+			else {
+				startSimulation(ctx, serverConnectionHandlerID, channelID, fromID, pm, false, message + 4);
+			}
+			sendMessage(serverConnectionHandlerID, ctx->ausgabe, channelID, fromID, pm);
+			isCommandAlreadyTriggered = true;
+			ctx->metrics.counters[METRIC_CMD_SIM]++;
 		}
 	}
 	if (isHelp(message)) {
 		if (isCommandAlreadyTriggered == false) {
-			char ausgabe[19999] = "[ZZW DiceBot] Liste moeglicher Befehle:\n";
-			char commands[9][19999] = { 
-				"!an - Aktiviert den Dicebot", 
-				"!aus - Deaktiviert den Dicebot", 
+			static const char* commands[] = {
+				"!an - Aktiviert den Dicebot",
+				"!aus - Deaktiviert den Dicebot",
 				"!help - Gibt eine Hilfsseite aus",
 				"!version - Gibt die aktuelle Version und einen Downloadlink aus",
 				"!pm - Oeffnet ein Fenster zum privaten Wuerfeln",
-				"!farbe [farbe] - Ermoeglicht das setzen einer Ausgabefarbe", 
-				"!f - Fate Wurf",
-				"![zahl]w[zahl]+/-[zahl] - Wuerfelt die angegebene Zahl an Wuerfeln",
-				"!sww[zahl]+/-[zahl] - Savage Worlds Wurf"
+				"!farbe [farbe] - Ermoeglicht das setzen einer Ausgabefarbe"
+			};
+			static const char* moreCommands[] = {
+				"![befehl]; [befehl]; ... - Bis zu 10 Wuerfe in einer Nachricht, z.B. !1w20+5; 2w6+3; 1w10",
+				"![anzahl]x [befehl] - Wuerfelt denselben Befehl bis zu 100 mal als Tabelle, z.B. !6x 4w6kh3",
+				"!fair an/aus - Fairer Modus: Seed-Commitment vorab, Seed wird am Ende aufgedeckt",
+				"!kompakt an/aus - Wuerfe als Pluginbefehl an andere AllDice-Clients, im Chat nur die Ergebnisse (nur eigener Client)",
+				"!sim [ausdruck] [versuche] [ziel] - Monte-Carlo-Simulation eines Wurfes: Mittelwert, Perzentile, Erfolgswahrscheinlichkeit (!sim status, !sim stop; andere Clients hoechstens 10 Mio. Versuche, eine pro Minute)",
+				"!metrics - Zeigt Zaehler und Laufzeiten des Dicebots (nur im eigenen Chatfenster)",
+				"/" CONSOLE_KEYWORD " [befehl], /" CONSOLE_KEYWORD " dist, stats, bench, shards - Wuerfeln, Simulation, Messwerte und Threads nur lokal ueber die Befehlszeile des Clients",
+				"Hotkeys: Zeilen \"name = befehl\" in " HOTKEY_FILE " im Konfigurationsordner, Tasten in den TS3-Optionen belegen",
+				"!trace an/aus/dump - Zeichnet die Verarbeitungsschritte auf und schreibt sie als Chrome-Trace (JSON) in den Konfigurationsordner"
 			};
-			for (int i = 0; i < 9; i++) {
-				strcat(ausgabe, commands[i]);
-				strcat(ausgabe, "\n");
+			struct OutputBuilder out;
+			outputInit(&out, ctx->ausgabe, OUTPUT_BUFSIZE);
+			outputAppend(&out, "[ZZW DiceBot] Liste moeglicher Befehle:\n");
+			for (int i = 0; i < (int)(sizeof(commands) / sizeof(commands[0])); i++) {
+				outputAppend(&out, "%s\n", commands[i]);
 			}
-			sendMessage(serverConnectionHandlerID, ausgabe, ts3Functions.getChannelOfClient, fromID, false);
+			for (int i = 0; i < gameSystemCount; i++) {
+				outputAppend(&out, "%s\n", gameSystems[i].help);
+			}
+			for (int i = 0; i < (int)(sizeof(moreCommands) / sizeof(moreCommands[0])); i++) {
+				outputAppend(&out, "%s\n", moreCommands[i]);
+			}
+			sendMessage(serverConnectionHandlerID, ctx->ausgabe, channelID, fromID, false);
 			isCommandAlreadyTriggered = true;
+			ctx->metrics.counters[METRIC_CMD_HELP]++;
 		}
 	}
 
 	if (chatBotActive == true && isCommandAlreadyTriggered == false) {
-		if (isCommand(message)) {
-			getUserColor(fromID);
-			char ausgabe[19999] = "\n[color=";
-			strcat(ausgabe, tmpUserColor);
-			strcat(ausgabe, "][");
-			strcat(ausgabe, fromName);
-			strcat(ausgabe, "]");
-			char tmp[19999];
-
-			int multi = 1;
-			int pRandomNumber;
-			int randomNumber;
-			int addNumber = 0;
-			int result = 0;
-
-			bool error = true;
-
+		if (isCommand(message) && strlen(message) > COMMAND_MAXLEN) {
+			ctx->metrics.counters[METRIC_REJECTED]++;
+		}
+		else if (isCommand(message) && !setAn(message)) {
 			bool pm = false; //gibt an ob es sich um eine privaten Wurf handelt
 			if (targetMode == TextMessageTarget_CLIENT) {
 				pm = true;
 			}
 
-			if (isMultipleDice(message)) {
-				getSubStringOf(message, 1, getPosOf(message, 'w') - 1);
-				multi = atoi(subString);
-			}
-			if (isDice(message)) {
-				if (isCommandAlreadyTriggered == false) {
-					error = false;
-					strcat(ausgabe, " wuerfelt einen ");
-					getSubStringOf(message, 1, sizeOf(message));
-					strcat(ausgabe, subString);
-					strcat(ausgabe, "\n Ergebnis: ");
-
-					if (isPlusSomething(message)) {
-						getSubStringOf(message, getPosOf(message, 'w') + 1, getPosOf(message, '+') - 2);
-						pRandomNumber = atoi(subString);
-						getSubStringOf(message, getPosOf(message, '+') + 1, sizeOf(message) - getPosOf(message, 'w'));
-						addNumber = atoi(subString);
-
-						getSubStringOf(message, 1, getPosOf(message, '+') - 1);
-						strcat(ausgabe, subString);
-					}
-					else if (isMinusSomething(message)) {
-						getSubStringOf(message, getPosOf(message, 'w') + 1, getPosOf(message, '-') - 2);
-						pRandomNumber = atoi(subString);
-						getSubStringOf(message, getPosOf(message, '-') + 1, sizeOf(message) - getPosOf(message, 'w'));
-						addNumber = atoi(subString);
-						addNumber = addNumber * (-1);
-
-						getSubStringOf(message, 1, getPosOf(message, '-') - 1);
-						strcat(ausgabe, subString);
-					}
-					else {
-						getSubStringOf(message, getPosOf(message, 'w') + 1, sizeOf(message) - getPosOf(message, 'w'));
-						pRandomNumber = atoi(subString);
-
-						getSubStringOf(message, 1, sizeOf(message));
-						strcat(ausgabe, subString);
-					}
-					strcat(ausgabe, "(");
-
-					randomNumber = generateRandomNumber(0, pRandomNumber);
-					result = result + randomNumber;
-
-					sprintf(subString, "%d", randomNumber);
-					strcat(ausgabe, subString);
-
-					for (int i = 1; i < multi; i++) {
-						randomNumber = generateRandomNumber(0, pRandomNumber);
-						result = result + randomNumber;
-
-						strcat(ausgabe, "+");
-						sprintf(subString, "%d", randomNumber);
-						strcat(ausgabe, subString);
-					}
-
-					strcat(ausgabe, ") Summe: ( ");
-					sprintf(subString, "%d", result);
-					strcat(ausgabe, subString);
-
-					result = result + addNumber;
-
-					if (isPlusSomething(message)) {
-						getSubStringOf(message, getPosOf(message, '+'), sizeOf(message) - getPosOf(message, 'w'));
-						strcat(ausgabe, subString);
-					}
-					else if (isMinusSomething(message)) {
-						getSubStringOf(message, getPosOf(message, '-'), sizeOf(message) - getPosOf(message, 'w'));
-						strcat(ausgabe, subString);
-					}
-
-					strcat(ausgabe, " ) = ");
-					sprintf(subString, "%d", result);
-					strcat(ausgabe, subString);
-
-					sendMessage(serverConnectionHandlerID, ausgabe, ts3Functions.getChannelOfClient, fromID, pm);
-					isCommandAlreadyTriggered = true;
-				}
-			}
-			if (isSWWDice(message)) { //funktioniert
-				if (isCommandAlreadyTriggered == false) {
-					error = false;
-					int tmp3;
-					double tmp4;
-					int randomNumberTmp;
-					strcat(ausgabe, " Wildcard Eigenschafts Probe: \nProbewuerfel		W");
-
-					if (isPlusSomething(message)) {
-						getSubStringOf(message, getPosOf(message, 'w') + 2, getPosOf(message, '+') - 1);
-						pRandomNumber = atoi(subString);
-						getSubStringOf(message, getPosOf(message, '+') + 1, sizeOf(message) - getPosOf(message, 'w') + 1);
-						addNumber = atoi(subString);
-
-						getSubStringOf(message, 4, getPosOf(message, '+') - 4);
-						strcat(ausgabe, subString);
-					}
-					else if (isMinusSomething(message)) {
-						getSubStringOf(message, getPosOf(message, 'w') + 2, getPosOf(message, '-') - 1);
-						pRandomNumber = atoi(subString);
-						getSubStringOf(message, getPosOf(message, '-') + 1, sizeOf(message) - getPosOf(message, 'w') + 1);
-						addNumber = atoi(subString);
-						addNumber = addNumber * (-1);
-
-						getSubStringOf(message, 4, getPosOf(message, '-') - 4);
-						strcat(ausgabe, subString);
-					}
-					else {
-						getSubStringOf(message, getPosOf(message, 'w') + 2, sizeOf(message) - getPosOf(message, 'w'));
-						pRandomNumber = atoi(subString);
-						addNumber = 0;
-
-						strcat(ausgabe, subString);
-					}
-
-					strcat(ausgabe, "	(");
-
-					//norm wrfelwurf mit explosion
-					randomNumber = explodingDice(pRandomNumber);
-					if (randomNumber != -1) {
-						result = randomNumber + addNumber;
-					}
-					randomNumberTmp = randomNumber;
-
-					sprintf(subString, "%d", randomNumber);
-					strcat(ausgabe, subString);
-					strcat(ausgabe, ") ");
-					strcat(ausgabe, "	");
-					sprintf(subString, "%d", randomNumber);
-					strcat(ausgabe, subString);
-					if (isPlusSomething(message)) {
-						getSubStringOf(message, getPosOf(message, '+'), sizeOf(message) - (getPosOf(message, 'w') + 1));
-						strcat(ausgabe, subString);
-					}
-					else if (isMinusSomething(message)) {
-						getSubStringOf(message, getPosOf(message, '-'), sizeOf(message) - (getPosOf(message, 'w') + 1));
-						strcat(ausgabe, subString);
-					}
-					strcat(ausgabe, "=");
-					sprintf(subString, "%d", result);
-					strcat(ausgabe, subString);
-
-					tmp3 = result / 4;
-					tmp4 = result / 4;
-					if (tmp4 < 1) { //ausgabe fr fehlgeschlagen um: tmp3
-						tmp3 = 4 - result;
-						strcat(ausgabe, " Fehlschlag um ");
-						sprintf(subString, "%d", tmp3);
-						strcat(ausgabe, subString);
-						strcat(ausgabe, " Punkt(e)\n");
-					}
-					else if (tmp4 == 1) { //ausgabe erfolgreich
-						strcat(ausgabe, " Erfolg\n");
-					}
-					else if (tmp4 > 1) { //ausgabe fr erfolg um: tmp3
-						tmp3 = (result - 4) / 4;
-						strcat(ausgabe, " Erfolg mit ");
-						sprintf(subString, "%d", tmp3);
-						strcat(ausgabe, subString);
-						strcat(ausgabe, " Steigerung(en)\n");
-					}
-
-
-					//wrfelwurf mit w6 und explosion (Wildcardwrfel)
-					randomNumber = explodingDice(6);
-					result = randomNumber + addNumber;
-
-					strcat(ausgabe, "Wildcardwuerfel	W6	(");
-					sprintf(subString, "%d", randomNumber);
-					strcat(ausgabe, subString);
-					strcat(ausgabe, ") ");
-					strcat(ausgabe, "	");
-					sprintf(subString, "%d", randomNumber);
-					strcat(ausgabe, subString);
-					if (isPlusSomething(message)) {
-						getSubStringOf(message, getPosOf(message, '+'), sizeOf(message) - (getPosOf(message, 'w') + 1));
-						strcat(ausgabe, subString);
-					}
-					else if (isMinusSomething(message)) {
-						getSubStringOf(message, getPosOf(message, '-'), sizeOf(message) - (getPosOf(message, 'w') + 1));
-						strcat(ausgabe, subString);
-					}
-					strcat(ausgabe, "=");
-					sprintf(subString, "%d", result);
-					strcat(ausgabe, subString);
-
-					tmp3 = result / 4;
-					tmp4 = result / 4;
-					if (tmp4 < 1) { //ausgabe fr fehlgeschlagen um: tmp3
-						tmp3 = 4 - result;
-						strcat(ausgabe, " Fehlschlag um ");
-						sprintf(subString, "%d", tmp3);
-						strcat(ausgabe, subString);
-						strcat(ausgabe, " Punkt(e)");
-
-						if (randomNumberTmp == randomNumber && randomNumber == 1) {
-							int iFehlschlag = generateRandomNumber(0, 3);
-							switch (iFehlschlag)
-							{
-							case 0:
-								strcat(ausgabe, "\n-Fehlschlag!-");
-								break;
-							case 1:
-								strcat(ausgabe, "\n-Kritischer Fehlschlag!-");
-								break;
-							case 2:
-								strcat(ausgabe, "\n-Schwerer Kritischer Fehlschlag!-");
-								break;
-							default:
-								strcat(ausgabe, "\n-Fehlschlag!-");
-								break;
-							}
-						}
-					}
-					else if (tmp4 == 1) { //ausgabe erfolgreich
-						strcat(ausgabe, " Erfolg");
-					}
-					else if (tmp4 > 1) { //ausgabe fr erfolg um: tmp3
-						tmp3 = (result - 4) / 4;
-						strcat(ausgabe, " Erfolg mit ");
-						sprintf(subString, "%d", tmp3);
-						strcat(ausgabe, subString);
-						strcat(ausgabe, " Steigerung(en)");
-					}
-
-					sendMessage(serverConnectionHandlerID, ausgabe, ts3Functions.getChannelOfClient, fromID, pm);
-					isCommandAlreadyTriggered = true;
-				}
-			}
 			if (isSetColor(message)) {
-				if (isCommandAlreadyTriggered == false) {
-					error = false;
-					getSubStringOf(message, getPosOf(message, '!') + 7, sizeOf(message) - getPosOf(message, '!') + 6);
-					setUserColor(fromID, subString);
-
-					getUserColor(fromID);
-					char ausgabe[19999] = "[color=";
-					strcat(ausgabe, tmpUserColor);
-					strcat(ausgabe, "]");
-					strcat(ausgabe, " Farbe gesetzt...");
-					sendMessage(serverConnectionHandlerID, ausgabe, ts3Functions.getChannelOfClient, fromID, pm);
-					isCommandAlreadyTriggered = true;
-				}
+				setUserColor(fromID, message + 7);
+				getUserColor(ctx, fromID);
+				snprintf(ctx->ausgabe, OUTPUT_BUFSIZE, "[color=%s] Farbe gesetzt...", ctx->userColor);
+				ctx->metrics.counters[METRIC_CMD_COLOR]++;
 			}
-			if (isFate(message)) {
-				if (isCommandAlreadyTriggered == false) {
-					error = false;
-					int ri, ri1, ri2, ri3, ri4, mod, ergi;
-					char rs[19999] = "";
-					char rs1[19999] = "";
-					char rs2[19999] = "";
-					char rs3[19999] = "";
-					char rs4[19999] = "";
-					char ergs[19999] = "";
-
-					//4w3 fuerfeln (geht von -1 bis +1) und dann zusammen rechnen
-					ri1 = generateRandomNumber(-2, 3);
-					ri2 = generateRandomNumber(-2, 3);
-					ri3 = generateRandomNumber(-2, 3);
-					ri4 = generateRandomNumber(-2, 3);
-
-					ri = ri1 + ri2 + ri3 + ri4;
-
-					sprintf(rs, "%d", ri);
-					sprintf(rs1, "%d", ri1);
-					sprintf(rs2, "%d", ri2);
-					sprintf(rs3, "%d", ri3);
-					sprintf(rs4, "%d", ri4);
-
-					//ausgabe zusammen stellen
-					getUserColor(fromID);
-					char ausgabe[19999] = "\n[color=";
-					strcat(ausgabe, tmpUserColor);
-					strcat(ausgabe, "][");
-					strcat(ausgabe, fromName);
-					strcat(ausgabe, "]");
-					strcat(ausgabe, " Fate Fertigkeitsprobe: \nWurf: ");
-					strcat(ausgabe, rs1);
-					strcat(ausgabe, " ");
-					strcat(ausgabe, rs2);
-					strcat(ausgabe, " ");
-					strcat(ausgabe, rs3);
-					strcat(ausgabe, " ");
-					strcat(ausgabe, rs4);
-					strcat(ausgabe, "  >>  ");
-					strcat(ausgabe, rs);
-					strcat(ausgabe, "  >>  ");
-					strcat(ausgabe, rs);
-					strcat(ausgabe, "+");
-					//modifikator (!f4 ==> 4) addieren = erg
-					getSubStringOf(message, getPosOf(message, '!') + 2, sizeOf(message) - getPosOf(message, '!') + 1);
-					strcat(ausgabe, subString);
-					mod = atoi(subString);
-					ergi = ri + mod;
-					sprintf(ergs, "%d", ergi);
-					strcat(ausgabe, "=");
-					strcat(ausgabe, ergs);
-
-
-					sendMessage(serverConnectionHandlerID, ausgabe, ts3Functions.getChannelOfClient, fromID, pm);
-					isCommandAlreadyTriggered = true;
+			else {
+				processRollCommand(ctx, fromID, fromName, message);
+				historyRecord(serverConnectionHandlerID, fromID, fromName, ctx->batch);
+				if (compactModeActive && !pm && ctx->batch != NULL) {
+					sendCompactBatch(ctx, serverConnectionHandlerID, fromName);
 				}
 			}
-
-			if (error == true && (!setAn(message))) {
-				//If no case is true...
-				strcat(ausgabe, " Syntax fehler...");
-				sendMessage(serverConnectionHandlerID, ausgabe, ts3Functions.getChannelOfClient, fromID, pm);
-			}
+			sendMessage(serverConnectionHandlerID, ctx->ausgabe, channelID, fromID, pm);
 		}
 	}
 
+	if (isCommand(message)) {
+		recordTimer(ctx, TIMER_MESSAGE, messageStart);
+		infoChanged();
+		infoRefresh();
+	}
+	else if (traceActive) {
+		traceRecord(ctx, TRACE_MESSAGE, messageStart, monotonicNanos());
+	}
+
 	///// http://www2.hs-fulda.de/~klingebiel/c-stdlib/string.htm
+}
+
+int ts3plugin_onTextMessageEvent(uint64 serverConnectionHandlerID, anyID targetMode, anyID toID, anyID fromID, const char* fromName, const char* fromUniqueIdentifier, const char* message, int ffIgnored) {
+	/* Mit Shards gehen Befehle an den Thread ihres Channels, alles andere bleibt im Callback-Thread */
+	if (isCommand(message) && shardDispatch(serverConnectionHandlerID, targetMode, toID, fromID, fromName, fromUniqueIdentifier, message)) {
+		return 0;
+	}
+	handleTextMessage(serverConnectionHandlerID, targetMode, toID, fromID, fromName, fromUniqueIdentifier, message, 0);
 	return 0;  /* 0 = handle normally, 1 = client will ignore the text message */
 }
 
@@ -1532,6 +5896,8 @@ void ts3plugin_onUserLoggingMessageEvent(const char* logMessage, int logLevel, c
 /* Clientlib rare */
 
 void ts3plugin_onClientBanFromServerEvent(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, int visibility, anyID kickerID, const char* kickerName, const char* kickerUniqueIdentifier, uint64 time, const char* kickMessage) {
+	clientMapMove(serverConnectionHandlerID, clientID, newChannelID);
+	electionClientMoved(serverConnectionHandlerID, clientID, newChannelID);
 }
 
 int ts3plugin_onClientPokeEvent(uint64 serverConnectionHandlerID, anyID fromClientID, const char* pokerName, const char* pokerUniqueIdentity, const char* message, int ffIgnored) {
@@ -1692,8 +6058,55 @@ void ts3plugin_onBanListEvent(uint64 serverConnectionHandlerID, uint64 banid, co
 void ts3plugin_onClientServerQueryLoginPasswordEvent(uint64 serverConnectionHandlerID, const char* loginPassword) {
 }
 
+/* Wurf eines anderen AllDice-Clients im kompakten Modus: dekodieren und lokal im Channel-Tab ausgeben */
 void ts3plugin_onPluginCommandEvent(uint64 serverConnectionHandlerID, const char* pluginName, const char* pluginCommand, anyID invokerClientID, const char* invokerName, const char* invokerUniqueIdentity) {
-	printf("ON PLUGIN COMMAND: %s %s %d %s %s\n", pluginName, pluginCommand, invokerClientID, invokerName, invokerUniqueIdentity);
+	struct DiceContext* ctx = getThreadDiceContext();
+	struct RollBatch batch;
+	struct ByteBuffer buffer;
+	struct OutputBuilder out;
+	struct ClientIdentity identity;
+	anyID myID;
+	int length;
+
+	if (strncmp(pluginCommand, ELECTION_HEARTBEAT_PREFIX, strlen(ELECTION_HEARTBEAT_PREFIX)) == 0 ||
+		strncmp(pluginCommand, ELECTION_BYE_PREFIX, strlen(ELECTION_BYE_PREFIX)) == 0) {
+		electionReceive(serverConnectionHandlerID, pluginCommand, invokerClientID);
+		return;
+	}
+	if (ctx == NULL || strncmp(pluginCommand, COMPACT_PREFIX, strlen(COMPACT_PREFIX)) != 0) {
+		return;
+	}
+	if (ts3Functions.getClientID(serverConnectionHandlerID, &myID) == ERROR_ok && myID == invokerClientID) {
+		return;  /* eigene Wuerfe wurden schon beim Senden ausgegeben */
+	}
+	beginDiceMessage(ctx);
+	buffer.capacity = TS3_MAX_SIZE_TEXTMESSAGE;
+	buffer.data = (unsigned char*)arenaAlloc(&ctx->arena, buffer.capacity);
+	if (buffer.data == NULL) {
+		return;
+	}
+	length = base64Decode(pluginCommand + strlen(COMPACT_PREFIX), buffer.data, buffer.capacity);
+	if (length < 0) {
+		return;
+	}
+	buffer.capacity = (size_t)length;
+	buffer.length = 0;
+	buffer.failed = false;
+	if (!decodeBatch(ctx, &buffer, &batch)) {
+		ctx->metrics.counters[METRIC_REJECTED]++;
+		return;
+	}
+	/* Name aus der Identitaet des Absenders, nicht aus dem Befehl */
+	if (!clientIdentity(serverConnectionHandlerID, invokerClientID, &identity)) {
+		identityRefresh(serverConnectionHandlerID, invokerClientID);
+		if (!clientIdentity(serverConnectionHandlerID, invokerClientID, &identity)) {
+			copyTruncated(identity.name, TS3_MAX_SIZE_CLIENT_NICKNAME, invokerName);
+		}
+	}
+	outputInit(&out, ctx->ausgabe, OUTPUT_BUFSIZE);
+	outputAppend(&out, "\n[color=%s][%s]", ctx->userColor, identity.name);
+	formatBatch(&out, &batch);
+	ts3Functions.printMessage(serverConnectionHandlerID, ctx->ausgabe, PLUGIN_MESSAGE_TARGET_CHANNEL);
 }
 
 void ts3plugin_onIncomingClientQueryEvent(uint64 serverConnectionHandlerID, const char* commandText) {
@@ -1728,59 +6141,73 @@ void ts3plugin_onAvatarUpdated(uint64 serverConnectionHandlerID, anyID clientID,
  * - selectedItemID: Channel or Client ID in the case of PLUGIN_MENU_TYPE_CHANNEL and PLUGIN_MENU_TYPE_CLIENT. 0 for PLUGIN_MENU_TYPE_GLOBAL.
  */
 void ts3plugin_onMenuItemEvent(uint64 serverConnectionHandlerID, enum PluginMenuType type, int menuItemID, uint64 selectedItemID) {
-	//printf("PLUGIN: onMenuItemEvent: serverConnectionHandlerID=%llu, type=%d, menuItemID=%d, selectedItemID=%llu\n", (long long unsigned int)serverConnectionHandlerID, type, menuItemID, (long long unsigned int)selectedItemID);
-	//switch(type) {
-	//	case PLUGIN_MENU_TYPE_GLOBAL:
-	//		/* Global menu item was triggered. selectedItemID is unused and set to zero. */
-	//		switch(menuItemID) {
-	//			case MENU_ID_GLOBAL_1:
-	//				/* Menu global 1 was triggered */
-	//				break;
-	//			case MENU_ID_GLOBAL_2:
-	//				/* Menu global 2 was triggered */
-	//				break;
-	//			default:
-	//				break;
-	//		}
-	//		break;
-	//	case PLUGIN_MENU_TYPE_CHANNEL:
-	//		/* Channel contextmenu item was triggered. selectedItemID is the channelID of the selected channel */
-	//		switch(menuItemID) {
-	//			case MENU_ID_CHANNEL_1:
-	//				/* Menu channel 1 was triggered */
-	//				break;
-	//			case MENU_ID_CHANNEL_2:
-	//				/* Menu channel 2 was triggered */
-	//				break;
-	//			case MENU_ID_CHANNEL_3:
-	//				/* Menu channel 3 was triggered */
-	//				break;
-	//			default:
-	//				break;
-	//		}
-	//		break;
-	//	case PLUGIN_MENU_TYPE_CLIENT:
-	//		/* Client contextmenu item was triggered. selectedItemID is the clientID of the selected client */
-	//		switch(menuItemID) {
-	//			case MENU_ID_CLIENT_1:
-	//				/* Menu client 1 was triggered */
-	//				break;
-	//			case MENU_ID_CLIENT_2:
-	//				/* Menu client 2 was triggered */
-	//				break;
-	//			default:
-	//				break;
-	//		}
-	//		break;
-	//	default:
-	//		break;
-	//}
+	struct DiceContext* ctx = getThreadDiceContext();
+	anyID myID;
+
+	if (ctx == NULL || ts3Functions.getClientID(serverConnectionHandlerID, &myID) != ERROR_ok) {
+		return;
+	}
+	beginDiceMessage(ctx);
+	ctx->metrics.counters[METRIC_CMD_MENU]++;
+	switch (menuItemID) {
+		case MENU_ID_CLIENT_ROLL:
+			/* selectedItemID ist die Client-ID */
+			if (selectedItemID != 0 && selectedItemID < CLIENT_ID_COUNT) {
+				menuRollForClient(ctx, serverConnectionHandlerID, myID, (anyID)selectedItemID);
+			}
+			break;
+		case MENU_ID_CHANNEL_INITIATIVE:
+			/* selectedItemID ist die Channel-ID */
+			menuRollInitiative(ctx, serverConnectionHandlerID, myID, selectedItemID);
+			break;
+		case MENU_ID_GLOBAL_TOGGLE:
+			menuToggleBot(serverConnectionHandlerID, myID);
+			break;
+		case MENU_ID_GLOBAL_METRICS:
+			printMetrics(ctx, serverConnectionHandlerID, clientChannel(serverConnectionHandlerID, myID));
+			break;
+		default:
+			break;
+	}
+	infoChanged();
+	infoRefresh();
 }
 
 /* This function is called if a plugin hotkey was pressed. Omit if hotkeys are unused. */
 void ts3plugin_onHotkeyEvent(const char* keyword) {
-	//printf("PLUGIN: Hotkey event: %s\n", keyword);
-	/* Identify the hotkey by keyword ("keyword_1", "keyword_2" or "keyword_3" in this example) and handle here... */
+	struct Hotkey* hotkey = findHotkey(keyword);
+	struct DiceContext* ctx;
+	struct ClientIdentity identity;
+	struct OutputBuilder out;
+	uint64 serverConnectionHandlerID;
+	anyID myID;
+
+	if (hotkey == NULL || (ctx = getThreadDiceContext()) == NULL) {
+		return;
+	}
+	serverConnectionHandlerID = ts3Functions.getCurrentServerConnectionHandlerID();
+	if (ts3Functions.getClientID(serverConnectionHandlerID, &myID) != ERROR_ok) {
+		return;
+	}
+	if (!clientIdentity(serverConnectionHandlerID, myID, &identity)) {
+		identityRefresh(serverConnectionHandlerID, myID);
+		if (!clientIdentity(serverConnectionHandlerID, myID, &identity)) {
+			return;
+		}
+	}
+
+	/* gewuerfelt wird als eigener Client, wie ein im Channel getippter Befehl */
+	beginDiceMessage(ctx);
+	getUserColor(ctx, myID);
+	outputInit(&out, ctx->ausgabe, OUTPUT_BUFSIZE);
+	outputAppend(&out, "\n[color=%s][%s]", ctx->userColor, identity.name);
+	ctx->metrics.counters[METRIC_CMD_HOTKEY]++;
+	if (rollParsed(ctx, &out, hotkey->roll.exprs, hotkey->roll.count, hotkey->roll.repeat, monotonicNanos()) && compactModeActive) {
+		sendCompactBatch(ctx, serverConnectionHandlerID, identity.name);
+	}
+	historyRecord(serverConnectionHandlerID, myID, identity.name, ctx->batch);
+	sendMessage(serverConnectionHandlerID, ctx->ausgabe, clientChannel(serverConnectionHandlerID, myID), myID, false);
+	infoRefresh();
 }
 
 /* Called when recording a hotkey has finished after calling ts3Functions.requestHotkeyInputDialog */
@@ -1806,4 +6233,5 @@ const char* ts3plugin_keyPrefix() {
 
 /* Called when client custom nickname changed */
 void ts3plugin_onClientDisplayNameChanged(uint64 serverConnectionHandlerID, anyID clientID, const char* displayName, const char* uniqueClientIdentifier) {
+	identityUpdate(serverConnectionHandlerID, clientID, uniqueClientIdentifier, displayName, 0);
 }
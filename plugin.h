@@ -7,6 +7,8 @@
 #ifndef PLUGIN_H
 #define PLUGIN_H
 
+#include <stdbool.h>
+
 #if defined(WIN32) || defined(__WIN32__) || defined(_WIN32)
 #define PLUGINS_EXPORTDLL __declspec(dllexport)
 #else
@@ -143,6 +145,19 @@ PLUGINS_EXPORTDLL const char* ts3plugin_keyDeviceName(const char* keyIdentifier)
 PLUGINS_EXPORTDLL const char* ts3plugin_displayKeyText(const char* keyIdentifier);
 PLUGINS_EXPORTDLL const char* ts3plugin_keyPrefix();
 
+/* AllDice core, used by the tools in tools/ which link plugin.c directly */
+struct DiceContext;
+struct DiceContext* getThreadDiceContext();
+void freeDiceContexts();
+void beginDiceMessage(struct DiceContext* ctx);
+void seedRandomNumberGenerator(uint64 seed);
+bool processRollCommand(struct DiceContext* ctx, anyID fromID, const char* fromName, const char* message);
+void setSendLimits(int sizeLimit, int burst, int intervalMs);
+int shardPoolStart(int count);
+void shardPoolStop();
+void shardPoolDrain();
+void shardPoolSeed(uint64 seed);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,130 @@
+/*
+ * Fuzz target for the chat command parser behind ts3plugin_onTextMessageEvent.
+ *
+ * libFuzzer:  clang -g -O1 -fsanitize=fuzzer,address,undefined -I<sdk>/include -pthread -o fuzz_message tools/fuzz_message.c tools/ts3_stub.c plugin.c -lm
+ *             ./fuzz_message -dict=... tools/corpus   (libFuzzer prints exec/s itself)
+ * AFL++:      afl-clang-fast ... with -fsanitize=fuzzer, then afl-fuzz -i tools/corpus -o out -- ./fuzz_message
+ * Standalone: cc -O2 -DFUZZ_STANDALONE -I<sdk>/include -pthread -o fuzz_message tools/fuzz_message.c tools/ts3_stub.c plugin.c -lm
+ *             ./fuzz_message [-t seconds] tools/corpus/<files>   runs the given inputs in a loop and reports exec/s,
+ *             useful to compare parser speed between builds.
+ *
+ * Input layout: the first byte selects the sender, the rest is the chat message.
+ *   bit 0 set: private message (TextMessageTarget_CLIENT), else channel message
+ *   bit 1 set: message comes from the own client (enables !an, !aus, !fair, !version)
+ *   bit 2 set: the rest is a plugin command from another client (compact mode, "AD1 " + base64)
+ * The corpus files therefore start with '0' (channel, other client), '1' (private), '2' (own client) ...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "teamspeak/public_errors.h"
+#include "teamspeak/public_definitions.h"
+#include "ts3_functions.h"
+#include "../plugin.h"
+#include "ts3_stub.h"
+
+#define FUZZ_OWN_CLIENT_ID 1
+#define FUZZ_OTHER_CLIENT_ID 2
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+	static int initialized = 0;
+	static char message[TS3_MAX_SIZE_TEXTMESSAGE + 1];
+	anyID targetMode, fromID;
+
+	if (!initialized) {
+		ts3StubInstall(FUZZ_OWN_CLIENT_ID, NULL);
+		ts3plugin_init();
+		setSendLimits(TS3_MAX_SIZE_TEXTMESSAGE, 1, 0);  /* ohne Drosselung, alles wird sofort ausgegeben */
+		seedRandomNumberGenerator(1);
+		initialized = 1;
+	}
+	if (size == 0) {
+		return 0;
+	}
+
+	targetMode = (data[0] & 1) ? TextMessageTarget_CLIENT : TextMessageTarget_CHANNEL;
+	fromID = (data[0] & 2) ? FUZZ_OWN_CLIENT_ID : FUZZ_OTHER_CLIENT_ID;
+	data++;
+	size--;
+	if (size > TS3_MAX_SIZE_TEXTMESSAGE) {
+		size = TS3_MAX_SIZE_TEXTMESSAGE;
+	}
+	memcpy(message, data, size);
+	message[size] = '\0';
+
+	if (data[-1] & 4) {
+		ts3plugin_onPluginCommandEvent(1, "AllDice", message, FUZZ_OTHER_CLIENT_ID, "Fuzz", "");
+		return 0;
+	}
+
+	/* Every input sees an active bot, a previous "!aus" must not hide the roll commands */
+	ts3plugin_onTextMessageEvent(1, TextMessageTarget_CHANNEL, 0, FUZZ_OWN_CLIENT_ID, "Fuzz", "", "!an", 0);
+	ts3plugin_onTextMessageEvent(1, targetMode, 0, fromID, "Fuzz", "", message, 0);
+	return 0;
+}
+
+#ifdef FUZZ_STANDALONE
+#include <time.h>
+
+struct FuzzInput {
+	uint8_t* data;
+	size_t size;
+};
+
+static int readInput(const char* path, struct FuzzInput* input) {
+	FILE* f = fopen(path, "rb");
+	long length;
+	if (f == NULL) {
+		return -1;
+	}
+	fseek(f, 0, SEEK_END);
+	length = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	input->data = (uint8_t*)malloc(length > 0 ? (size_t)length : 1);
+	input->size = fread(input->data, 1, (size_t)(length > 0 ? length : 0), f);
+	fclose(f);
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	struct FuzzInput* inputs = (struct FuzzInput*)calloc(argc, sizeof(struct FuzzInput));
+	int inputCount = 0;
+	double seconds = 3.0, elapsed;
+	unsigned long long execs = 0;
+	clock_t start;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+			seconds = atof(argv[++i]);
+		} else if (readInput(argv[i], &inputs[inputCount]) == 0) {
+			inputCount++;
+		} else {
+			perror(argv[i]);
+		}
+	}
+	if (inputCount == 0) {
+		fprintf(stderr, "Usage: %s [-t seconds] input...\n", argv[0]);
+		return 2;
+	}
+
+	start = clock();
+	do {
+		for (i = 0; i < inputCount; i++) {
+			LLVMFuzzerTestOneInput(inputs[i].data, inputs[i].size);
+		}
+		execs += inputCount;
+		elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+	} while (elapsed < seconds);
+
+	printf("%d inputs, %llu execs in %.2f s, %.0f exec/s\n", inputCount, execs, elapsed, execs / elapsed);
+
+	for (i = 0; i < inputCount; i++) {
+		free(inputs[i].data);
+	}
+	free(inputs);
+	return 0;
+}
+#endif
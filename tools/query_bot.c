@@ -0,0 +1,1242 @@
+/*
+ * AllDice query bot: headless dice bot for Linux that talks to TeamSpeak 3 servers through the ServerQuery text
+ * protocol instead of running inside a GUI client. plugin.c is linked unchanged, this file provides the
+ * TS3Functions table it calls and turns query notifications into the plugin callbacks.
+ *
+ * Build (Linux): cc -O2 -pthread -I<sdk>/include -o query_bot tools/query_bot.c plugin.c -lm
+ *
+ * Usage: query_bot [-u login] [-n nickname] [-a adminUID] [-c configdir] [-s seed] [-l burst/intervalMs] [-j shards] target...
+ *   target     host[:port]/sid[/cid], port defaults to 10011. Every target is one query connection that joins
+ *              virtual server sid and moves to channel cid. The bot answers in the channel it sits in and in
+ *              private chats, so one target per channel; any number of channels and virtual servers can be
+ *              served from one process.
+ *   -u login   query login name, the password is read from the environment variable ALLDICE_QUERY_PASSWORD
+ *   -n name    nickname of the bot, "AllDice" by default ("AllDice 2", ... if the name is taken)
+ *   -a uid     unique identifier of the game master. Private messages from this client are run as if the bot
+ *              had written them in its channel, which gives access to !an, !aus, !fair, !metrics, !trace ...
+ *   -c dir     directory for alldice_hotkeys.txt and trace dumps, "./" by default
+ *   -s seed    fixed random seed, for reproducible runs against query_mock
+ *   -l b/ms    send limits of the plugin (burst and refill interval), 5/1000 by default. The default stays
+ *              below the ServerQuery flood protection (10 commands in 3 s), whitelisted hosts may raise it.
+ *   -j n       run the chat commands on n shard threads (0 = one per core) instead of the event loop thread.
+ *              All commands of a channel go to the same shard, so their order is kept; worth it with many
+ *              busy channels, see replay -c/-j for the throughput per core count.
+ *
+ * The bot turns itself on ("!an") once the first connection is ready. One thread runs an epoll loop over all
+ * connections with non-blocking sockets; the send queue, election and simulation threads of the plugin only
+ * append to the output buffers and wake the loop through an eventfd. Lost connections are re-established with
+ * exponential backoff. SIGINT/SIGTERM flush the send queue, log out and exit.
+ *
+ * Limits: plugin commands cannot be sent over ServerQuery, so the compact mode only posts the results and the
+ * election never sees other AllDice clients. The plugin caches clients for 16 connections, further targets
+ * work but look up every sender in the mirror here. Test locally with tools/query_mock.c.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include "teamspeak/public_errors.h"
+#include "teamspeak/public_definitions.h"
+#include "teamspeak/public_rare_definitions.h"
+#include "ts3_functions.h"
+#include "../plugin.h"
+
+#define QUERY_DEFAULT_PORT "10011"
+#define QUERY_DEFAULT_NICKNAME "AllDice"
+#define QUERY_PASSWORD_ENV "ALLDICE_QUERY_PASSWORD"
+#define QUERY_PLUGIN_ID "alldice_query"
+#define QUERY_MAX_TARGETS 256
+#define QUERY_LINE_LIMIT (1024 * 1024)    /* longer lines (huge clientlist) drop the connection */
+#define QUERY_VALUE_SIZE 8192
+#define QUERY_UID_SIZE 64
+#define QUERY_PATH_SIZE 512
+#define QUERY_MESSAGE_LIMIT 1024          /* characters per sendtextmessage accepted by the server */
+#define QUERY_SEND_BURST 5
+#define QUERY_SEND_INTERVAL_MS 1000
+#define QUERY_KEEPALIVE_MS 60000          /* the server drops idle query clients after 5 minutes */
+#define QUERY_SETUP_TIMEOUT_MS 30000
+#define QUERY_BACKOFF_MIN_MS 1000
+#define QUERY_BACKOFF_MAX_MS 60000
+#define QUERY_NICKNAME_ATTEMPTS 9
+#define QUERY_SHUTDOWN_FLUSH_MS 2000
+#define QUERY_ERROR_NICKNAME_IN_USE 513
+
+#define EPOLL_TAG_WAKE 0
+#define EPOLL_TAG_SIGNAL 1
+#define EPOLL_TAG_CONNECTION 2  /* + index */
+
+enum ConnectionState {
+	STATE_IDLE,        /* waiting for the next connect attempt */
+	STATE_CONNECTING,  /* non-blocking connect in progress */
+	STATE_GREETING,    /* "TS3" and the welcome line */
+	STATE_SETUP,       /* login, use, whoami, notifications, clientlist */
+	STATE_READY
+};
+
+/* What the next "error id=... msg=..." line answers, commands are answered in order */
+enum PendingKind {
+	PENDING_IGNORE,
+	PENDING_LOGIN,
+	PENDING_USE,
+	PENDING_WHOAMI,
+	PENDING_NICKNAME,
+	PENDING_CLIENTLIST
+};
+
+struct QueryClient {
+	anyID clientID;
+	uint64 channelID;
+	uint64 databaseID;
+	char nickname[TS3_MAX_SIZE_CLIENT_NICKNAME];
+	char uid[QUERY_UID_SIZE];
+};
+
+struct QueryConnection {
+	uint64 serverConnectionHandlerID;  /* index + 1 */
+	char host[256];
+	char port[16];
+	uint64 serverID;
+	uint64 targetChannelID;            /* 0 = stay in the default channel */
+
+	enum ConnectionState state;
+	int fd;
+	int greetingLines;
+	int nicknameAttempt;
+	unsigned int backoffMs;
+	uint64 deadline;                   /* next connect attempt, setup timeout or keepalive (monotonic ms) */
+	bool writeArmed;
+
+	/* Only touched by the loop thread */
+	char* in;
+	size_t inLength;
+	size_t inCapacity;
+
+	/* Guarded by queryMutex, written by every thread that sends */
+	char* out;
+	size_t outLength;
+	size_t outCapacity;
+	unsigned char* pending;            /* ring of enum PendingKind */
+	size_t pendingHead;
+	size_t pendingCount;
+	size_t pendingCapacity;
+	anyID ownID;
+	uint64 ownChannelID;
+	struct QueryClient* clients;
+	size_t clientCount;
+	size_t clientCapacity;
+};
+
+static struct QueryConnection connections[QUERY_MAX_TARGETS];
+static int connectionCount = 0;
+static pthread_mutex_t queryMutex = PTHREAD_MUTEX_INITIALIZER;
+static int epollFd = -1;
+static int wakeFd = -1;
+static int signalFd = -1;
+
+static const char* loginName = NULL;
+static const char* loginPassword = NULL;
+static const char* nickname = QUERY_DEFAULT_NICKNAME;
+static const char* adminUID = NULL;
+static char configDir[QUERY_PATH_SIZE];
+static bool botActivated = false;
+static bool stopping = false;  /* the plugin is shut down, no more callbacks */
+
+static uint64 monotonicMs() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64)now.tv_sec * 1000 + (uint64)now.tv_nsec / 1000000;
+}
+
+static void logConnection(const struct QueryConnection* conn, const char* format, ...) {
+	va_list args;
+	fprintf(stderr, "query_bot: %s:%s/%llu: ", conn->host, conn->port, (unsigned long long)conn->serverID);
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+	fputc('\n', stderr);
+}
+
+/****************************** ServerQuery encoding ********************************/
+
+/* Escapes value for a ServerQuery parameter, false if out is too small */
+static bool escapeValue(char* out, size_t size, const char* value) {
+	size_t n = 0;
+	for (; *value; value++) {
+		char c = *value, escaped = 0;
+		switch (c) {
+		case '\\': escaped = '\\'; break;
+		case '/': escaped = '/'; break;
+		case ' ': escaped = 's'; break;
+		case '|': escaped = 'p'; break;
+		case '\a': escaped = 'a'; break;
+		case '\b': escaped = 'b'; break;
+		case '\f': escaped = 'f'; break;
+		case '\n': escaped = 'n'; break;
+		case '\r': escaped = 'r'; break;
+		case '\t': escaped = 't'; break;
+		case '\v': escaped = 'v'; break;
+		}
+		if (n + (escaped ? 2 : 1) >= size) {
+			return false;
+		}
+		if (escaped) {
+			out[n++] = '\\';
+			out[n++] = escaped;
+		}
+		else {
+			out[n++] = c;
+		}
+	}
+	out[n] = '\0';
+	return true;
+}
+
+static void unescapeValue(char* out, size_t size, const char* value, size_t length) {
+	size_t n = 0, i;
+	for (i = 0; i < length && n + 1 < size; i++) {
+		char c = value[i];
+		if (c == '\\' && i + 1 < length) {
+			switch (value[++i]) {
+			case 's': c = ' '; break;
+			case 'p': c = '|'; break;
+			case 'a': c = '\a'; break;
+			case 'b': c = '\b'; break;
+			case 'f': c = '\f'; break;
+			case 'n': c = '\n'; break;
+			case 'r': c = '\r'; break;
+			case 't': c = '\t'; break;
+			case 'v': c = '\v'; break;
+			default: c = value[i]; break;  /* "\\" and "\/" */
+			}
+		}
+		out[n++] = c;
+	}
+	out[n] = '\0';
+}
+
+/* Finds "key=value" (or a bare "key") among the space separated parameters of one entry */
+static const char* findParameter(const char* entry, const char* key, size_t* length) {
+	size_t keyLength = strlen(key);
+	const char* p = entry;
+	while (*p) {
+		const char* end = strchr(p, ' ');
+		if (end == NULL) {
+			end = p + strlen(p);
+		}
+		if ((size_t)(end - p) >= keyLength && strncmp(p, key, keyLength) == 0 && (p[keyLength] == '=' || p + keyLength == end)) {
+			const char* value = p[keyLength] == '=' ? p + keyLength + 1 : end;
+			*length = (size_t)(end - value);
+			return value;
+		}
+		p = *end ? end + 1 : end;
+	}
+	return NULL;
+}
+
+static bool parameterString(const char* entry, const char* key, char* out, size_t size) {
+	size_t length;
+	const char* value = findParameter(entry, key, &length);
+	if (value == NULL) {
+		out[0] = '\0';
+		return false;
+	}
+	unescapeValue(out, size, value, length);
+	return true;
+}
+
+static uint64 parameterUInt64(const char* entry, const char* key) {
+	size_t length;
+	const char* value = findParameter(entry, key, &length);
+	return value != NULL ? strtoull(value, NULL, 10) : 0;
+}
+
+/****************************** Output and client mirror ********************************/
+
+static bool reserve(char** buffer, size_t* capacity, size_t needed) {
+	size_t newCapacity = *capacity ? *capacity : 4096;
+	char* grown;
+	if (needed <= *capacity) {
+		return true;
+	}
+	while (newCapacity < needed) {
+		newCapacity *= 2;
+	}
+	if ((grown = (char*)realloc(*buffer, newCapacity)) == NULL) {
+		return false;
+	}
+	*buffer = grown;
+	*capacity = newCapacity;
+	return true;
+}
+
+static bool pushPending(struct QueryConnection* conn, enum PendingKind kind) {
+	if (conn->pendingCount == conn->pendingCapacity) {
+		size_t capacity = conn->pendingCapacity ? conn->pendingCapacity * 2 : 16;
+		unsigned char* grown = (unsigned char*)malloc(capacity);
+		size_t i;
+		if (grown == NULL) {
+			return false;
+		}
+		for (i = 0; i < conn->pendingCount; i++) {
+			grown[i] = conn->pending[(conn->pendingHead + i) % conn->pendingCapacity];
+		}
+		free(conn->pending);
+		conn->pending = grown;
+		conn->pendingHead = 0;
+		conn->pendingCapacity = capacity;
+	}
+	conn->pending[(conn->pendingHead + conn->pendingCount) % conn->pendingCapacity] = (unsigned char)kind;
+	conn->pendingCount++;
+	return true;
+}
+
+static enum PendingKind headPending(const struct QueryConnection* conn) {
+	return conn->pendingCount > 0 ? (enum PendingKind)conn->pending[conn->pendingHead] : PENDING_IGNORE;
+}
+
+static void popPending(struct QueryConnection* conn) {
+	if (conn->pendingCount > 0) {
+		conn->pendingHead = (conn->pendingHead + 1) % conn->pendingCapacity;
+		conn->pendingCount--;
+	}
+}
+
+/* Appends one command line, the caller holds queryMutex */
+static bool appendCommandLocked(struct QueryConnection* conn, enum PendingKind kind, const char* format, va_list args) {
+	va_list copy;
+	int length;
+
+	va_copy(copy, args);
+	length = vsnprintf(NULL, 0, format, copy);
+	va_end(copy);
+	if (length < 0 || !reserve(&conn->out, &conn->outCapacity, conn->outLength + (size_t)length + 2)) {
+		return false;
+	}
+	vsnprintf(conn->out + conn->outLength, (size_t)length + 1, format, args);
+	conn->outLength += (size_t)length;
+	conn->out[conn->outLength++] = '\n';
+	return pushPending(conn, kind);
+}
+
+/* Queues a command from any thread and wakes the loop to write it */
+static bool sendCommand(struct QueryConnection* conn, enum PendingKind kind, const char* format, ...) {
+	static const uint64 one = 1;
+	va_list args;
+	bool queued;
+
+	pthread_mutex_lock(&queryMutex);
+	va_start(args, format);
+	queued = conn->fd >= 0 && appendCommandLocked(conn, kind, format, args);
+	va_end(args);
+	pthread_mutex_unlock(&queryMutex);
+	if (queued && write(wakeFd, &one, sizeof(one)) < 0) {
+		/* the counter is already non-zero, the loop wakes anyway */
+	}
+	return queued;
+}
+
+static struct QueryConnection* connectionFor(uint64 serverConnectionHandlerID) {
+	if (serverConnectionHandlerID == 0 || serverConnectionHandlerID > (uint64)connectionCount) {
+		return NULL;
+	}
+	return &connections[serverConnectionHandlerID - 1];
+}
+
+/* The caller holds queryMutex */
+static struct QueryClient* findClient(struct QueryConnection* conn, anyID clientID) {
+	size_t i;
+	for (i = 0; i < conn->clientCount; i++) {
+		if (conn->clients[i].clientID == clientID) {
+			return &conn->clients[i];
+		}
+	}
+	return NULL;
+}
+
+/* Updates or adds a client from a clientlist or notifycliententerview entry, returns its previous channel */
+static uint64 mirrorEnter(struct QueryConnection* conn, const char* entry, const char* channelKey) {
+	struct QueryClient client;
+	struct QueryClient* known;
+	uint64 oldChannelID = 0;
+
+	memset(&client, 0, sizeof(client));
+	client.clientID = (anyID)parameterUInt64(entry, "clid");
+	client.channelID = parameterUInt64(entry, channelKey);
+	client.databaseID = parameterUInt64(entry, "client_database_id");
+	parameterString(entry, "client_nickname", client.nickname, sizeof(client.nickname));
+	parameterString(entry, "client_unique_identifier", client.uid, sizeof(client.uid));
+	if (client.clientID == 0) {
+		return 0;
+	}
+
+	pthread_mutex_lock(&queryMutex);
+	if ((known = findClient(conn, client.clientID)) != NULL) {
+		oldChannelID = known->channelID;
+		*known = client;
+	}
+	else {
+		if (conn->clientCount == conn->clientCapacity) {
+			size_t capacity = conn->clientCapacity ? conn->clientCapacity * 2 : 64;
+			struct QueryClient* grown = (struct QueryClient*)realloc(conn->clients, capacity * sizeof(struct QueryClient));
+			if (grown != NULL) {
+				conn->clients = grown;
+				conn->clientCapacity = capacity;
+			}
+		}
+		if (conn->clientCount < conn->clientCapacity) {
+			conn->clients[conn->clientCount++] = client;
+		}
+	}
+	if (client.clientID == conn->ownID) {
+		conn->ownChannelID = client.channelID;
+	}
+	pthread_mutex_unlock(&queryMutex);
+	return oldChannelID;
+}
+
+/* Moves a client, newChannelID = 0 removes it. Returns false for unknown clients. */
+static bool mirrorMove(struct QueryConnection* conn, anyID clientID, uint64 newChannelID) {
+	struct QueryClient* client;
+	bool known;
+
+	pthread_mutex_lock(&queryMutex);
+	if ((known = (client = findClient(conn, clientID)) != NULL)) {
+		if (newChannelID == 0) {
+			*client = conn->clients[--conn->clientCount];
+		}
+		else {
+			client->channelID = newChannelID;
+		}
+	}
+	if (clientID == conn->ownID) {
+		conn->ownChannelID = newChannelID;
+	}
+	pthread_mutex_unlock(&queryMutex);
+	return known;
+}
+
+/****************************** TS3Functions ********************************/
+
+static unsigned int queryGetClientID(uint64 serverConnectionHandlerID, anyID* result) {
+	struct QueryConnection* conn = connectionFor(serverConnectionHandlerID);
+	unsigned int error = ERROR_not_connected;
+
+	if (conn == NULL) {
+		return error;
+	}
+	pthread_mutex_lock(&queryMutex);
+	if (conn->ownID != 0) {
+		*result = conn->ownID;
+		error = ERROR_ok;
+	}
+	pthread_mutex_unlock(&queryMutex);
+	return error;
+}
+
+static unsigned int queryGetChannelOfClient(uint64 serverConnectionHandlerID, anyID clientID, uint64* result) {
+	struct QueryConnection* conn = connectionFor(serverConnectionHandlerID);
+	struct QueryClient* client;
+	unsigned int error = ERROR_not_connected;
+
+	if (conn == NULL) {
+		return error;
+	}
+	pthread_mutex_lock(&queryMutex);
+	if ((client = findClient(conn, clientID)) != NULL) {
+		*result = client->channelID;
+		error = ERROR_ok;
+	}
+	pthread_mutex_unlock(&queryMutex);
+	return error;
+}
+
+static uint64 queryGetCurrentServerConnectionHandlerID(void) {
+	uint64 result = 0;
+	int i;
+
+	pthread_mutex_lock(&queryMutex);
+	for (i = 0; i < connectionCount && result == 0; i++) {
+		if (connections[i].state == STATE_READY) {
+			result = connections[i].serverConnectionHandlerID;
+		}
+	}
+	pthread_mutex_unlock(&queryMutex);
+	return result;
+}
+
+static unsigned int queryGetServerConnectionHandlerList(uint64** result) {
+	int i, n = 0;
+
+	if ((*result = (uint64*)calloc((size_t)connectionCount + 1, sizeof(uint64))) == NULL) {
+		return ERROR_undefined;
+	}
+	pthread_mutex_lock(&queryMutex);
+	for (i = 0; i < connectionCount; i++) {
+		if (connections[i].state == STATE_READY) {
+			(*result)[n++] = connections[i].serverConnectionHandlerID;
+		}
+	}
+	pthread_mutex_unlock(&queryMutex);
+	return ERROR_ok;
+}
+
+static unsigned int queryGetClientList(uint64 serverConnectionHandlerID, anyID** result) {
+	struct QueryConnection* conn = connectionFor(serverConnectionHandlerID);
+	size_t i;
+
+	if (conn == NULL) {
+		return ERROR_not_connected;
+	}
+	pthread_mutex_lock(&queryMutex);
+	if ((*result = (anyID*)calloc(conn->clientCount + 1, sizeof(anyID))) != NULL) {
+		for (i = 0; i < conn->clientCount; i++) {
+			(*result)[i] = conn->clients[i].clientID;
+		}
+	}
+	pthread_mutex_unlock(&queryMutex);
+	return *result != NULL ? ERROR_ok : ERROR_undefined;
+}
+
+static unsigned int queryGetClientVariableAsString(uint64 serverConnectionHandlerID, anyID clientID, size_t flag, char** result) {
+	struct QueryConnection* conn = connectionFor(serverConnectionHandlerID);
+	struct QueryClient* client;
+
+	if (conn == NULL || (flag != CLIENT_NICKNAME && flag != CLIENT_UNIQUE_IDENTIFIER)) {
+		return ERROR_undefined;
+	}
+	*result = NULL;
+	pthread_mutex_lock(&queryMutex);
+	if ((client = findClient(conn, clientID)) != NULL) {
+		*result = strdup(flag == CLIENT_NICKNAME ? client->nickname : client->uid);
+	}
+	pthread_mutex_unlock(&queryMutex);
+	return *result != NULL ? ERROR_ok : ERROR_undefined;
+}
+
+static unsigned int queryGetClientVariableAsUInt64(uint64 serverConnectionHandlerID, anyID clientID, size_t flag, uint64* result) {
+	struct QueryConnection* conn = connectionFor(serverConnectionHandlerID);
+	struct QueryClient* client;
+	unsigned int error = ERROR_undefined;
+
+	if (conn == NULL || flag != CLIENT_DATABASE_ID) {
+		return error;
+	}
+	pthread_mutex_lock(&queryMutex);
+	if ((client = findClient(conn, clientID)) != NULL) {
+		*result = client->databaseID;
+		error = ERROR_ok;
+	}
+	pthread_mutex_unlock(&queryMutex);
+	return error;
+}
+
+static unsigned int sendTextMessage(uint64 serverConnectionHandlerID, int targetMode, uint64 target, const char* message) {
+	static __thread char escaped[QUERY_VALUE_SIZE * 2];
+	struct QueryConnection* conn = connectionFor(serverConnectionHandlerID);
+	bool ready;
+
+	if (conn == NULL) {
+		return ERROR_not_connected;
+	}
+	pthread_mutex_lock(&queryMutex);
+	ready = conn->state == STATE_READY;
+	pthread_mutex_unlock(&queryMutex);
+	if (!ready) {
+		return ERROR_not_connected;
+	}
+	if (!escapeValue(escaped, sizeof(escaped), message)) {
+		return ERROR_undefined;
+	}
+	if (!sendCommand(conn, PENDING_IGNORE, "sendtextmessage targetmode=%d target=%llu msg=%s", targetMode, (unsigned long long)target, escaped)) {
+		return ERROR_not_connected;
+	}
+	return ERROR_ok;
+}
+
+/* targetmode=2 always goes to the channel the query client sits in, targetChannelID is informational */
+static unsigned int queryRequestSendChannelTextMsg(uint64 serverConnectionHandlerID, const char* message, uint64 targetChannelID, const char* returnCode) {
+	return sendTextMessage(serverConnectionHandlerID, TextMessageTarget_CHANNEL, targetChannelID, message);
+}
+
+static unsigned int queryRequestSendPrivateTextMsg(uint64 serverConnectionHandlerID, const char* message, anyID targetClientID, const char* returnCode) {
+	return sendTextMessage(serverConnectionHandlerID, TextMessageTarget_CLIENT, targetClientID, message);
+}
+
+/* ServerQuery has no plugin commands, see the header comment */
+static void querySendPluginCommand(uint64 serverConnectionHandlerID, const char* pluginID, const char* command, int targetMode, const anyID* targetIDs, const char* returnCode) {
+}
+
+static void queryPrintMessage(uint64 serverConnectionHandlerID, const char* message, enum PluginMessageTarget messageTarget) {
+	printf("[%llu] %s\n", (unsigned long long)serverConnectionHandlerID, message);
+	fflush(stdout);
+}
+
+static void queryPrintMessageToCurrentTab(const char* message) {
+	printf("%s\n", message);
+	fflush(stdout);
+}
+
+static unsigned int queryLogMessage(const char* logMessage, enum LogLevel severity, const char* channel, uint64 logID) {
+	static const char* const levels[] = { "CRITICAL", "ERROR", "WARNING", "DEBUG", "INFO", "DEVEL" };
+	fprintf(stderr, "%s %s: %s\n", (unsigned int)severity <= LogLevel_DEVEL ? levels[severity] : "?", channel ? channel : "", logMessage);
+	return ERROR_ok;
+}
+
+static void queryGetPath(char* path, size_t maxLen) {
+	snprintf(path, maxLen, "%s", configDir);
+}
+
+static void queryGetPluginPath(char* path, size_t maxLen, const char* pluginID) {
+	queryGetPath(path, maxLen);
+}
+
+static void queryRequestInfoUpdate(uint64 serverConnectionHandlerID, enum PluginItemType itemType, uint64 itemID) {
+}
+
+static unsigned int queryFreeMemory(void* pointer) {
+	free(pointer);
+	return ERROR_ok;
+}
+
+static void installFunctions() {
+	struct TS3Functions funcs;
+
+	memset(&funcs, 0, sizeof(funcs));
+	funcs.getClientID = queryGetClientID;
+	funcs.getChannelOfClient = queryGetChannelOfClient;
+	funcs.getCurrentServerConnectionHandlerID = queryGetCurrentServerConnectionHandlerID;
+	funcs.getServerConnectionHandlerList = queryGetServerConnectionHandlerList;
+	funcs.getClientList = queryGetClientList;
+	funcs.getClientVariableAsString = queryGetClientVariableAsString;
+	funcs.getClientVariableAsUInt64 = queryGetClientVariableAsUInt64;
+	funcs.requestSendChannelTextMsg = queryRequestSendChannelTextMsg;
+	funcs.requestSendPrivateTextMsg = queryRequestSendPrivateTextMsg;
+	funcs.sendPluginCommand = querySendPluginCommand;
+	funcs.printMessage = queryPrintMessage;
+	funcs.printMessageToCurrentTab = queryPrintMessageToCurrentTab;
+	funcs.logMessage = queryLogMessage;
+	funcs.getAppPath = queryGetPath;
+	funcs.getResourcesPath = queryGetPath;
+	funcs.getConfigPath = queryGetPath;
+	funcs.getPluginPath = queryGetPluginPath;
+	funcs.requestInfoUpdate = queryRequestInfoUpdate;
+	funcs.freeMemory = queryFreeMemory;
+	ts3plugin_setFunctionPointers(funcs);
+}
+
+/****************************** Connections ********************************/
+
+static void scheduleReconnect(struct QueryConnection* conn) {
+	conn->deadline = monotonicMs() + conn->backoffMs;
+	conn->backoffMs = conn->backoffMs * 2 < QUERY_BACKOFF_MAX_MS ? conn->backoffMs * 2 : QUERY_BACKOFF_MAX_MS;
+}
+
+static void disconnect(struct QueryConnection* conn, const char* reason) {
+	bool wasReady = conn->state == STATE_READY;
+
+	if (conn->fd >= 0) {
+		epoll_ctl(epollFd, EPOLL_CTL_DEL, conn->fd, NULL);
+		close(conn->fd);
+	}
+	logConnection(conn, "disconnected (%s), retrying in %u s", reason, conn->backoffMs / 1000);
+	pthread_mutex_lock(&queryMutex);
+	conn->fd = -1;
+	conn->state = STATE_IDLE;
+	conn->outLength = 0;
+	conn->pendingHead = 0;
+	conn->pendingCount = 0;
+	conn->ownID = 0;
+	conn->ownChannelID = 0;
+	conn->clientCount = 0;
+	pthread_mutex_unlock(&queryMutex);
+	conn->inLength = 0;
+	conn->writeArmed = false;
+	scheduleReconnect(conn);
+	if (wasReady && !stopping) {
+		ts3plugin_onConnectStatusChangeEvent(conn->serverConnectionHandlerID, STATUS_DISCONNECTED, ERROR_ok);
+	}
+}
+
+/* Starts a non-blocking connect, name resolution itself blocks briefly */
+static void startConnect(struct QueryConnection* conn) {
+	struct addrinfo hints, *addresses, *a;
+	struct epoll_event event;
+	int fd = -1, result;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if ((result = getaddrinfo(conn->host, conn->port, &hints, &addresses)) != 0) {
+		logConnection(conn, "%s", gai_strerror(result));
+		scheduleReconnect(conn);
+		return;
+	}
+	for (a = addresses; a != NULL; a = a->ai_next) {
+		if ((fd = socket(a->ai_family, a->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, a->ai_protocol)) < 0) {
+			continue;
+		}
+		if (connect(fd, a->ai_addr, a->ai_addrlen) == 0 || errno == EINPROGRESS) {
+			break;
+		}
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(addresses);
+	if (fd < 0) {
+		logConnection(conn, "connect: %s", strerror(errno));
+		scheduleReconnect(conn);
+		return;
+	}
+
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN | EPOLLOUT;
+	event.data.u64 = EPOLL_TAG_CONNECTION + (uint64)(conn - connections);
+	epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+	pthread_mutex_lock(&queryMutex);
+	conn->fd = fd;
+	conn->state = STATE_CONNECTING;
+	pthread_mutex_unlock(&queryMutex);
+	conn->writeArmed = true;
+	conn->greetingLines = 0;
+	conn->nicknameAttempt = 0;
+	conn->deadline = monotonicMs() + QUERY_SETUP_TIMEOUT_MS;
+}
+
+/* Writes as much output as the socket takes and watches EPOLLOUT only while something is left */
+static void flushOutput(struct QueryConnection* conn) {
+	struct epoll_event event;
+	bool wantWrite;
+	const char* error = NULL;
+
+	if (conn->fd < 0 || conn->state == STATE_CONNECTING) {
+		return;
+	}
+	pthread_mutex_lock(&queryMutex);
+	while (conn->outLength > 0) {
+		ssize_t written = send(conn->fd, conn->out, conn->outLength, MSG_NOSIGNAL);
+		if (written < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+				error = strerror(errno);
+			}
+			break;
+		}
+		memmove(conn->out, conn->out + written, conn->outLength - (size_t)written);
+		conn->outLength -= (size_t)written;
+	}
+	wantWrite = conn->outLength > 0;
+	pthread_mutex_unlock(&queryMutex);
+
+	if (error != NULL) {
+		disconnect(conn, error);
+	}
+	else if (wantWrite != conn->writeArmed) {
+		memset(&event, 0, sizeof(event));
+		event.events = EPOLLIN | (wantWrite ? EPOLLOUT : 0);
+		event.data.u64 = EPOLL_TAG_CONNECTION + (uint64)(conn - connections);
+		epoll_ctl(epollFd, EPOLL_CTL_MOD, conn->fd, &event);
+		conn->writeArmed = wantWrite;
+	}
+}
+
+static void beginSetup(struct QueryConnection* conn) {
+	conn->state = STATE_SETUP;
+	if (loginName != NULL) {
+		char name[QUERY_VALUE_SIZE], password[QUERY_VALUE_SIZE];
+		escapeValue(name, sizeof(name), loginName);
+		escapeValue(password, sizeof(password), loginPassword != NULL ? loginPassword : "");
+		sendCommand(conn, PENDING_LOGIN, "login client_login_name=%s client_login_password=%s", name, password);
+	}
+	sendCommand(conn, PENDING_USE, "use sid=%llu", (unsigned long long)conn->serverID);
+	sendCommand(conn, PENDING_WHOAMI, "whoami");
+}
+
+static void sendNickname(struct QueryConnection* conn) {
+	char name[TS3_MAX_SIZE_CLIENT_NICKNAME], escaped[TS3_MAX_SIZE_CLIENT_NICKNAME * 2];
+	if (conn->nicknameAttempt == 0) {
+		snprintf(name, sizeof(name), "%s", nickname);
+	}
+	else {
+		snprintf(name, sizeof(name), "%s %d", nickname, conn->nicknameAttempt + 1);
+	}
+	escapeValue(escaped, sizeof(escaped), name);
+	sendCommand(conn, PENDING_NICKNAME, "clientupdate client_nickname=%s", escaped);
+}
+
+/* whoami answered: move, rename, subscribe to everything the plugin listens to and read the client list */
+static void continueSetup(struct QueryConnection* conn) {
+	if (conn->targetChannelID != 0 && conn->targetChannelID != conn->ownChannelID) {
+		sendCommand(conn, PENDING_IGNORE, "clientmove clid=%u cid=%llu", (unsigned int)conn->ownID, (unsigned long long)conn->targetChannelID);
+	}
+	sendNickname(conn);
+	sendCommand(conn, PENDING_IGNORE, "servernotifyregister event=server");
+	sendCommand(conn, PENDING_IGNORE, "servernotifyregister event=channel id=0");
+	sendCommand(conn, PENDING_IGNORE, "servernotifyregister event=textchannel");
+	sendCommand(conn, PENDING_IGNORE, "servernotifyregister event=textprivate");
+	sendCommand(conn, PENDING_CLIENTLIST, "clientlist -uid");
+}
+
+static void becomeReady(struct QueryConnection* conn) {
+	pthread_mutex_lock(&queryMutex);
+	conn->state = STATE_READY;
+	pthread_mutex_unlock(&queryMutex);
+	conn->backoffMs = QUERY_BACKOFF_MIN_MS;
+	conn->deadline = monotonicMs() + QUERY_KEEPALIVE_MS;
+	logConnection(conn, "ready as client %u in channel %llu", (unsigned int)conn->ownID, (unsigned long long)conn->ownChannelID);
+	ts3plugin_onConnectStatusChangeEvent(conn->serverConnectionHandlerID, STATUS_CONNECTION_ESTABLISHED, ERROR_ok);
+	if (!botActivated) {
+		botActivated = true;
+		ts3plugin_onTextMessageEvent(conn->serverConnectionHandlerID, TextMessageTarget_CHANNEL, 0, conn->ownID, nickname, "", "!an", 0);
+	}
+}
+
+/* "error id=0 msg=ok" finishes the oldest pending command */
+static void handleError(struct QueryConnection* conn, const char* line) {
+	char message[256];
+	unsigned int id = (unsigned int)parameterUInt64(line, "id");
+	enum PendingKind kind = headPending(conn);
+
+	pthread_mutex_lock(&queryMutex);
+	popPending(conn);
+	pthread_mutex_unlock(&queryMutex);
+	if (id != 0) {
+		parameterString(line, "msg", message, sizeof(message));
+		if (kind == PENDING_NICKNAME && id == QUERY_ERROR_NICKNAME_IN_USE && conn->nicknameAttempt < QUERY_NICKNAME_ATTEMPTS) {
+			conn->nicknameAttempt++;
+			sendNickname(conn);
+			return;
+		}
+		logConnection(conn, "error %u: %s", id, message);
+		if (kind == PENDING_LOGIN || kind == PENDING_USE || kind == PENDING_WHOAMI || kind == PENDING_CLIENTLIST) {
+			disconnect(conn, "setup failed");
+		}
+		return;
+	}
+	if (kind == PENDING_WHOAMI) {
+		if (conn->ownID == 0) {
+			disconnect(conn, "whoami without client_id");
+			return;
+		}
+		continueSetup(conn);
+	}
+	else if (kind == PENDING_CLIENTLIST && conn->state == STATE_SETUP) {
+		becomeReady(conn);
+	}
+}
+
+/* Data lines belong to the oldest pending command */
+static void handleData(struct QueryConnection* conn, char* line) {
+	enum PendingKind kind = headPending(conn);
+	char* entry;
+	char* next;
+
+	if (kind == PENDING_WHOAMI) {
+		pthread_mutex_lock(&queryMutex);
+		conn->ownID = (anyID)parameterUInt64(line, "client_id");
+		conn->ownChannelID = parameterUInt64(line, "client_channel_id");
+		pthread_mutex_unlock(&queryMutex);
+	}
+	else if (kind == PENDING_CLIENTLIST) {
+		pthread_mutex_lock(&queryMutex);
+		conn->clientCount = 0;
+		pthread_mutex_unlock(&queryMutex);
+		for (entry = line; entry != NULL; entry = next) {
+			if ((next = strchr(entry, '|')) != NULL) {
+				*next++ = '\0';
+			}
+			mirrorEnter(conn, entry, "cid");
+		}
+	}
+}
+
+static void handleTextMessage(struct QueryConnection* conn, const char* line) {
+	static char message[QUERY_VALUE_SIZE];
+	char name[TS3_MAX_SIZE_CLIENT_NICKNAME];
+	char uid[QUERY_UID_SIZE];
+	anyID targetMode = (anyID)parameterUInt64(line, "targetmode");
+	anyID fromID = (anyID)parameterUInt64(line, "invokerid");
+	anyID toID = 0;
+	anyID ownID;
+
+	pthread_mutex_lock(&queryMutex);
+	ownID = conn->ownID;
+	pthread_mutex_unlock(&queryMutex);
+	if (conn->state != STATE_READY || fromID == ownID || (targetMode != TextMessageTarget_CHANNEL && targetMode != TextMessageTarget_CLIENT)) {
+		return;  /* own messages come back as notifications too */
+	}
+	parameterString(line, "msg", message, sizeof(message));
+	parameterString(line, "invokername", name, sizeof(name));
+	parameterString(line, "invokeruid", uid, sizeof(uid));
+	if (targetMode == TextMessageTarget_CLIENT) {
+		toID = ownID;
+		if (adminUID != NULL && strcmp(uid, adminUID) == 0) {
+			targetMode = TextMessageTarget_CHANNEL;  /* the game master speaks through the bot */
+			toID = 0;
+			fromID = ownID;
+		}
+	}
+	ts3plugin_onTextMessageEvent(conn->serverConnectionHandlerID, targetMode, toID, fromID, name, uid, message, 0);
+}
+
+/* Client notifications may carry several entries separated by '|' */
+static void handleClientNotification(struct QueryConnection* conn, char* line) {
+	bool entered = strncmp(line, "notifycliententerview ", 22) == 0;
+	bool left = strncmp(line, "notifyclientleftview ", 21) == 0;
+	char* entry;
+	char* next;
+
+	for (entry = strchr(line, ' ') + 1; entry != NULL; entry = next) {
+		anyID clientID;
+		uint64 oldChannelID, newChannelID;
+		if ((next = strchr(entry, '|')) != NULL) {
+			*next++ = '\0';
+		}
+		clientID = (anyID)parameterUInt64(entry, "clid");
+		oldChannelID = parameterUInt64(entry, "cfid");
+		newChannelID = parameterUInt64(entry, "ctid");
+		if (entered) {
+			mirrorEnter(conn, entry, "ctid");
+			ts3plugin_onClientMoveEvent(conn->serverConnectionHandlerID, clientID, oldChannelID, newChannelID, ENTER_VISIBILITY, "");
+		}
+		else if (left) {
+			mirrorMove(conn, clientID, 0);
+			ts3plugin_onClientMoveEvent(conn->serverConnectionHandlerID, clientID, oldChannelID, 0, LEAVE_VISIBILITY, "");
+		}
+		else {
+			mirrorMove(conn, clientID, newChannelID);
+			ts3plugin_onClientMoveEvent(conn->serverConnectionHandlerID, clientID, 0, newChannelID, RETAIN_VISIBILITY, "");
+		}
+	}
+}
+
+static void handleLine(struct QueryConnection* conn, char* line) {
+	if (conn->state == STATE_GREETING) {
+		if (++conn->greetingLines == 1 && strcmp(line, "TS3") != 0) {
+			disconnect(conn, "not a ServerQuery port");
+		}
+		else if (conn->greetingLines == 2) {
+			beginSetup(conn);
+		}
+		return;
+	}
+	if (strncmp(line, "error ", 6) == 0) {
+		handleError(conn, line);
+	}
+	else if (strncmp(line, "notifytextmessage ", 18) == 0) {
+		if (conn->state == STATE_READY) {
+			handleTextMessage(conn, line);
+		}
+	}
+	else if (strncmp(line, "notifycliententerview ", 22) == 0 || strncmp(line, "notifyclientleftview ", 21) == 0 || strncmp(line, "notifyclientmoved ", 18) == 0) {
+		if (conn->state == STATE_READY) {
+			handleClientNotification(conn, line);
+		}
+	}
+	else if (strncmp(line, "notify", 6) != 0) {
+		handleData(conn, line);
+	}
+}
+
+/* Reads everything available and handles complete lines, the server ends them with "\n\r" */
+static void readInput(struct QueryConnection* conn) {
+	for (;;) {
+		ssize_t received;
+		size_t start = 0, i;
+
+		if (!reserve(&conn->in, &conn->inCapacity, conn->inLength + 4096)) {
+			disconnect(conn, "out of memory");
+			return;
+		}
+		received = recv(conn->fd, conn->in + conn->inLength, conn->inCapacity - conn->inLength, 0);
+		if (received == 0) {
+			disconnect(conn, "closed by server");
+			return;
+		}
+		if (received < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+				disconnect(conn, strerror(errno));
+			}
+			return;
+		}
+		conn->inLength += (size_t)received;
+		for (i = 0; i < conn->inLength; i++) {
+			if (conn->in[i] == '\n') {
+				char* line = conn->in + start;
+				conn->in[i] = '\0';
+				while (*line == '\r') {
+					line++;
+				}
+				line[strcspn(line, "\r")] = '\0';
+				if (*line) {
+					handleLine(conn, line);
+					if (conn->fd < 0) {
+						return;  /* the line ended the connection */
+					}
+				}
+				start = i + 1;
+			}
+		}
+		memmove(conn->in, conn->in + start, conn->inLength - start);
+		conn->inLength -= start;
+		if (conn->inLength > QUERY_LINE_LIMIT) {
+			disconnect(conn, "line too long");
+			return;
+		}
+	}
+}
+
+static void handleConnectionEvent(struct QueryConnection* conn, uint32_t events) {
+	if (conn->fd < 0) {
+		return;
+	}
+	if (conn->state == STATE_CONNECTING) {
+		int error = 0;
+		socklen_t length = sizeof(error);
+		getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &error, &length);
+		if (error != 0) {
+			disconnect(conn, strerror(error));
+			return;
+		}
+		pthread_mutex_lock(&queryMutex);
+		conn->state = STATE_GREETING;
+		pthread_mutex_unlock(&queryMutex);
+		flushOutput(conn);  /* nothing queued yet, disarms EPOLLOUT */
+		return;
+	}
+	if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+		readInput(conn);
+	}
+}
+
+/* Connect attempts, setup timeouts and keepalives, returns the epoll timeout until the next deadline */
+static int runTimers() {
+	uint64 now = monotonicMs();
+	uint64 next = now + QUERY_KEEPALIVE_MS;
+	int i;
+
+	for (i = 0; i < connectionCount; i++) {
+		struct QueryConnection* conn = &connections[i];
+		if (now >= conn->deadline) {
+			if (conn->state == STATE_IDLE) {
+				startConnect(conn);
+			}
+			else if (conn->state == STATE_READY) {
+				sendCommand(conn, PENDING_IGNORE, "version");
+				conn->deadline = now + QUERY_KEEPALIVE_MS;
+			}
+			else {
+				disconnect(conn, "timeout");
+			}
+		}
+		if (conn->deadline < next) {
+			next = conn->deadline;
+		}
+	}
+	return next > now ? (int)(next - now) : 0;
+}
+
+/* Flushes the plugin's send queue, logs out and gives the sockets a moment to drain */
+static void shutdownConnections() {
+	uint64 until;
+	int i;
+
+	ts3plugin_shutdown();
+	stopping = true;
+	for (i = 0; i < connectionCount; i++) {
+		if (connections[i].state == STATE_READY) {
+			sendCommand(&connections[i], PENDING_IGNORE, "quit");
+		}
+	}
+	until = monotonicMs() + QUERY_SHUTDOWN_FLUSH_MS;
+	for (;;) {
+		bool pendingOutput = false;
+		for (i = 0; i < connectionCount; i++) {
+			if (connections[i].fd >= 0 && connections[i].state != STATE_CONNECTING) {
+				flushOutput(&connections[i]);
+				pendingOutput |= connections[i].fd >= 0 && connections[i].outLength > 0;
+			}
+		}
+		if (!pendingOutput || monotonicMs() >= until) {
+			break;
+		}
+		poll(NULL, 0, 10);
+	}
+	for (i = 0; i < connectionCount; i++) {
+		if (connections[i].fd >= 0) {
+			close(connections[i].fd);
+		}
+		free(connections[i].in);
+		free(connections[i].out);
+		free(connections[i].pending);
+		free(connections[i].clients);
+	}
+}
+
+static bool parseTarget(const char* text, struct QueryConnection* conn) {
+	char host[256];
+	const char* slash = strchr(text, '/');
+	const char* colon;
+	char* end;
+	size_t length;
+
+	if (slash == NULL || (length = (size_t)(slash - text)) == 0 || length >= sizeof(host)) {
+		return false;
+	}
+	memcpy(host, text, length);
+	host[length] = '\0';
+	colon = strrchr(host, ':');
+	if (colon != NULL && strchr(host, ':') == colon) {  /* host:port, IPv6 literals without port stay whole */
+		snprintf(conn->port, sizeof(conn->port), "%s", colon + 1);
+		host[colon - host] = '\0';
+	}
+	else {
+		snprintf(conn->port, sizeof(conn->port), "%s", QUERY_DEFAULT_PORT);
+	}
+	snprintf(conn->host, sizeof(conn->host), "%s", host);
+	conn->serverID = strtoull(slash + 1, &end, 10);
+	if (conn->serverID == 0 || (*end != '\0' && *end != '/')) {
+		return false;
+	}
+	conn->targetChannelID = *end == '/' ? strtoull(end + 1, NULL, 10) : 0;
+	return true;
+}
+
+static void usage(const char* program) {
+	fprintf(stderr, "Usage: %s [-u login] [-n nickname] [-a adminUID] [-c configdir] [-s seed] [-l burst/intervalMs] [-j shards] host[:port]/sid[/cid] ...\n", program);
+	fprintf(stderr, "The query password is read from %s.\n", QUERY_PASSWORD_ENV);
+}
+
+int main(int argc, char** argv) {
+	struct epoll_event events[64];
+	struct epoll_event event;
+	sigset_t signals;
+	unsigned long long seed = 0;
+	int burst = QUERY_SEND_BURST, intervalMs = QUERY_SEND_INTERVAL_MS;
+	int shards = -1;
+	bool seeded = false, running = true;
+	int i;
+
+	snprintf(configDir, sizeof(configDir), "./");
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-u") && i + 1 < argc) {
+			loginName = argv[++i];
+		} else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+			nickname = argv[++i];
+		} else if (!strcmp(argv[i], "-a") && i + 1 < argc) {
+			adminUID = argv[++i];
+		} else if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+			const char* dir = argv[++i];
+			size_t length = strlen(dir);
+			snprintf(configDir, sizeof(configDir), "%s%s", dir, length > 0 && dir[length - 1] == '/' ? "" : "/");
+		} else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+			seed = strtoull(argv[++i], NULL, 10);
+			seeded = true;
+		} else if (!strcmp(argv[i], "-l") && i + 1 < argc) {
+			if (sscanf(argv[++i], "%d/%d", &burst, &intervalMs) != 2 || burst < 1 || intervalMs < 0) {
+				usage(argv[0]);
+				return 2;
+			}
+		} else if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+			if ((shards = atoi(argv[++i])) < 0) {
+				usage(argv[0]);
+				return 2;
+			}
+		} else if (argv[i][0] == '-' || connectionCount == QUERY_MAX_TARGETS) {
+			usage(argv[0]);
+			return 2;
+		} else {
+			struct QueryConnection* conn = &connections[connectionCount];
+			if (!parseTarget(argv[i], conn)) {
+				fprintf(stderr, "query_bot: invalid target %s\n", argv[i]);
+				return 2;
+			}
+			conn->serverConnectionHandlerID = (uint64)++connectionCount;
+			conn->fd = -1;
+			conn->backoffMs = QUERY_BACKOFF_MIN_MS;
+		}
+	}
+	if (connectionCount == 0) {
+		usage(argv[0]);
+		return 2;
+	}
+	loginPassword = getenv(QUERY_PASSWORD_ENV);
+
+	/* Block the signals before the plugin starts its threads, they inherit the mask */
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &signals, NULL);
+	signal(SIGPIPE, SIG_IGN);
+	if ((epollFd = epoll_create1(EPOLL_CLOEXEC)) < 0 || (wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0 || (signalFd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC)) < 0) {
+		perror("query_bot");
+		return 1;
+	}
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.u64 = EPOLL_TAG_WAKE;
+	epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+	event.data.u64 = EPOLL_TAG_SIGNAL;
+	epoll_ctl(epollFd, EPOLL_CTL_ADD, signalFd, &event);
+
+	installFunctions();
+	ts3plugin_registerPluginID(QUERY_PLUGIN_ID);
+	if (ts3plugin_init() != 0) {
+		fprintf(stderr, "query_bot: plugin init failed\n");
+		return 1;
+	}
+	setSendLimits(QUERY_MESSAGE_LIMIT, burst, intervalMs);
+	if (shards >= 0) {
+		fprintf(stderr, "query_bot: %d shards\n", shardPoolStart(shards));
+	}
+	if (seeded) {
+		seedRandomNumberGenerator(seed);
+		shardPoolSeed(seed);
+	}
+
+	while (running) {
+		int timeout = runTimers();
+		int count = epoll_wait(epollFd, events, (int)(sizeof(events) / sizeof(events[0])), timeout);
+		if (count < 0 && errno != EINTR) {
+			perror("epoll_wait");
+			break;
+		}
+		for (i = 0; i < count; i++) {
+			uint64 tag = events[i].data.u64;
+			if (tag == EPOLL_TAG_WAKE) {
+				uint64 value;
+				if (read(wakeFd, &value, sizeof(value)) < 0) {
+					/* EAGAIN, woken by an earlier event */
+				}
+			}
+			else if (tag == EPOLL_TAG_SIGNAL) {
+				running = false;
+			}
+			else {
+				handleConnectionEvent(&connections[tag - EPOLL_TAG_CONNECTION], events[i].events);
+			}
+		}
+		/* Replies of the callbacks above and output of the plugin threads */
+		for (i = 0; i < connectionCount; i++) {
+			flushOutput(&connections[i]);
+		}
+	}
+
+	shutdownConnections();
+	close(signalFd);
+	close(wakeFd);
+	close(epollFd);
+	return 0;
+}
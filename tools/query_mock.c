@@ -0,0 +1,517 @@
+/*
+ * Local stand-in for a TeamSpeak 3 ServerQuery port, for testing tools/query_bot.c without a server. Every query
+ * connection gets the greeting, canned answers for the commands the bot uses, and once it is set up the chat
+ * of a transcript (same format as tools/replay.c) as notifytextmessage lines. Whatever the bot sends with
+ * sendtextmessage is printed to stdout as "sid/cid [channel] ..." or "sid/cid [privat <clid>] ...".
+ *
+ * Build (Linux): cc -O2 -o query_mock tools/query_mock.c
+ *
+ * Usage: query_mock [-p port] [-d delayMs] [-x idleMs] transcript.txt
+ *   -p port    listen on 127.0.0.1:port, 10011 by default
+ *   -d ms      pause between two transcript lines, 0 by default
+ *   -x ms      exit once every connection has seen the whole transcript and the bot was quiet for ms
+ *
+ * Transcript senders become clients with their fromID as client ID and the unique identifier "mock<id>=", all
+ * in the bot's channel. Lines of client 1 (the own client in replay.c) are sent as private messages from
+ * "mockadmin=", so a bot started with "-a mockadmin=" runs them as its own commands:
+ *
+ *   query_mock -x 3000 tools/transcripts/session.txt > out.txt &
+ *   query_bot -s 1 -a mockadmin= -l 100/0 127.0.0.1/1/5 & wait %1; kill %2
+ *
+ * A guest "Gast" (client 50) enters before and leaves after the transcript, to exercise the client events.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#define MOCK_DEFAULT_PORT 10011
+#define MOCK_MAX_SESSIONS 64
+#define MOCK_MAX_CLIENTS 64
+#define MOCK_LINE_BUFSIZE 65536
+#define MOCK_VALUE_SIZE 16384
+#define MOCK_NAME_SIZE 64
+#define MOCK_FIRST_BOT_ID 100
+#define MOCK_ADMIN_ID 1
+#define MOCK_GUEST_ID 50
+#define MOCK_DEFAULT_CHANNEL 1
+
+struct TranscriptLine {
+	unsigned int fromID;
+	unsigned int targetMode;
+	char* fromName;
+	char* message;
+};
+
+struct MockClient {
+	unsigned int clientID;
+	char name[MOCK_NAME_SIZE];
+};
+
+struct MockSession {
+	int fd;
+	unsigned int clientID;
+	unsigned long long serverID;
+	unsigned long long channelID;
+	char nickname[MOCK_NAME_SIZE];
+	int textChannel;
+	int listed;
+	int replaying;      /* 1 while the transcript runs, 2 when done */
+	size_t next;
+	uint64_t nextAt;
+	char in[MOCK_LINE_BUFSIZE];
+	size_t inLength;
+};
+
+static struct TranscriptLine* lines = NULL;
+static size_t lineCount = 0;
+static struct MockClient clients[MOCK_MAX_CLIENTS];
+static int clientCount = 0;
+static struct MockSession sessions[MOCK_MAX_SESSIONS];
+static unsigned int nextBotID = MOCK_FIRST_BOT_ID;
+static int delayMs = 0;
+
+static uint64_t nowMs() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+static void escapeValue(char* out, size_t size, const char* value) {
+	static const char plain[] = "\\/ |\a\b\f\n\r\t\v";
+	static const char coded[] = "\\/sp" "abfnrtv";
+	size_t n = 0;
+	for (; *value && n + 2 < size; value++) {
+		const char* special = strchr(plain, *value);
+		if (special != NULL) {
+			out[n++] = '\\';
+			out[n++] = coded[special - plain];
+		}
+		else {
+			out[n++] = *value;
+		}
+	}
+	out[n] = '\0';
+}
+
+/* Copies the unescaped value of key from a command line, "" if it is missing */
+static void parameter(const char* line, const char* key, char* out, size_t size) {
+	static const char plain[] = "\\/ |\a\b\f\n\r\t\v";
+	static const char coded[] = "\\/sp" "abfnrtv";
+	size_t keyLength = strlen(key), n = 0;
+	const char* p = line;
+
+	out[0] = '\0';
+	while ((p = strchr(p, ' ')) != NULL) {
+		p++;
+		if (strncmp(p, key, keyLength) == 0 && p[keyLength] == '=') {
+			for (p += keyLength + 1; *p && *p != ' ' && n + 1 < size; p++) {
+				if (*p == '\\' && p[1] && strchr(coded, p[1]) != NULL) {
+					out[n++] = plain[strchr(coded, *++p) - coded];
+				}
+				else {
+					out[n++] = *p;
+				}
+			}
+			out[n] = '\0';
+			return;
+		}
+	}
+}
+
+static void sendLine(struct MockSession* session, const char* format, ...) {
+	char buf[MOCK_VALUE_SIZE * 2];
+	va_list args;
+	int length;
+
+	va_start(args, format);
+	length = vsnprintf(buf, sizeof(buf) - 2, format, args);
+	va_end(args);
+	if (length < 0 || session->fd < 0) {
+		return;
+	}
+	if (length > (int)sizeof(buf) - 3) {
+		length = (int)sizeof(buf) - 3;
+	}
+	buf[length++] = '\n';
+	buf[length++] = '\r';
+	if (send(session->fd, buf, (size_t)length, MSG_NOSIGNAL) < 0) {
+		perror("send");
+	}
+}
+
+static void sendOk(struct MockSession* session) {
+	sendLine(session, "error id=0 msg=ok");
+}
+
+static void clientUid(char* out, size_t size, unsigned int clientID) {
+	if (clientID == MOCK_ADMIN_ID) {
+		snprintf(out, size, "mockadmin=");
+	}
+	else {
+		snprintf(out, size, "mock%u=", clientID);
+	}
+}
+
+static void sendClientList(struct MockSession* session) {
+	char list[MOCK_VALUE_SIZE];
+	char name[MOCK_NAME_SIZE * 2];
+	char uid[32];
+	size_t n;
+	int i;
+
+	escapeValue(name, sizeof(name), session->nickname);
+	n = (size_t)snprintf(list, sizeof(list), "clid=%u cid=%llu client_database_id=1 client_nickname=%s client_type=1 client_unique_identifier=serveradmin",
+		session->clientID, session->channelID, name);
+	for (i = 0; i < clientCount && n < sizeof(list); i++) {
+		escapeValue(name, sizeof(name), clients[i].name);
+		clientUid(uid, sizeof(uid), clients[i].clientID);
+		n += (size_t)snprintf(list + n, sizeof(list) - n, "|clid=%u cid=%llu client_database_id=%u client_nickname=%s client_type=0 client_unique_identifier=%s",
+			clients[i].clientID, session->channelID, clients[i].clientID, name, uid);
+	}
+	sendLine(session, "%s", list);
+	sendOk(session);
+}
+
+static void printSent(const struct MockSession* session, const char* command) {
+	char target[32], mode[8], message[MOCK_VALUE_SIZE];
+
+	parameter(command, "targetmode", mode, sizeof(mode));
+	parameter(command, "target", target, sizeof(target));
+	parameter(command, "msg", message, sizeof(message));
+	if (atoi(mode) == 1) {
+		printf("%llu/%llu [privat %s] %s\n", session->serverID, session->channelID, target, message);
+	}
+	else {
+		printf("%llu/%llu [channel] %s\n", session->serverID, session->channelID, message);
+	}
+	fflush(stdout);
+}
+
+static int nicknameTaken(const struct MockSession* session, const char* name) {
+	int i;
+	for (i = 0; i < MOCK_MAX_SESSIONS; i++) {
+		const struct MockSession* other = &sessions[i];
+		if (other != session && other->fd >= 0 && other->serverID == session->serverID && strcmp(other->nickname, name) == 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void handleCommand(struct MockSession* session, const char* command) {
+	char value[MOCK_VALUE_SIZE];
+	size_t nameLength = strcspn(command, " ");
+
+	if (!strncmp(command, "login", nameLength) && nameLength == 5) {
+		sendOk(session);
+	}
+	else if (!strncmp(command, "use", nameLength) && nameLength == 3) {
+		parameter(command, "sid", value, sizeof(value));
+		session->serverID = strtoull(value, NULL, 10);
+		sendOk(session);
+	}
+	else if (!strcmp(command, "whoami")) {
+		sendLine(session, "virtualserver_status=online virtualserver_id=%llu virtualserver_unique_identifier=mockserver= virtualserver_port=9987 client_id=%u client_channel_id=%llu client_nickname=%s client_database_id=1 client_login_name=serveradmin client_unique_identifier=serveradmin client_origin_server_id=0",
+			session->serverID, session->clientID, session->channelID, "serveradmin");
+		sendOk(session);
+	}
+	else if (!strncmp(command, "clientmove", nameLength) && nameLength == 10) {
+		parameter(command, "cid", value, sizeof(value));
+		session->channelID = strtoull(value, NULL, 10);
+		sendOk(session);
+	}
+	else if (!strncmp(command, "clientupdate", nameLength) && nameLength == 12) {
+		parameter(command, "client_nickname", value, sizeof(value));
+		if (nicknameTaken(session, value)) {
+			sendLine(session, "error id=513 msg=nickname\\sis\\salready\\sin\\suse");
+			return;
+		}
+		snprintf(session->nickname, sizeof(session->nickname), "%.63s", value);
+		sendOk(session);
+	}
+	else if (!strncmp(command, "servernotifyregister", nameLength) && nameLength == 20) {
+		parameter(command, "event", value, sizeof(value));
+		if (!strcmp(value, "textchannel")) {
+			session->textChannel = 1;
+		}
+		sendOk(session);
+	}
+	else if (!strncmp(command, "clientlist", nameLength) && nameLength == 10) {
+		sendClientList(session);
+		session->listed = 1;
+	}
+	else if (!strncmp(command, "sendtextmessage", nameLength) && nameLength == 15) {
+		printSent(session, command);
+		sendOk(session);
+	}
+	else if (!strcmp(command, "version")) {
+		sendLine(session, "version=3.13.7 build=0 platform=Linux");
+		sendOk(session);
+	}
+	else if (!strcmp(command, "quit")) {
+		sendOk(session);
+		close(session->fd);
+		session->fd = -1;
+	}
+	else {
+		sendLine(session, "error id=256 msg=command\\snot\\sfound");
+	}
+}
+
+/* Sends the next transcript line (or the guest entering and leaving around it) */
+static void replayStep(struct MockSession* session) {
+	char message[MOCK_VALUE_SIZE], name[MOCK_NAME_SIZE * 2], uid[32];
+	const struct TranscriptLine* line;
+
+	if (session->next == 0) {
+		sendLine(session, "notifycliententerview cfid=0 ctid=%llu reasonid=0 clid=%u client_unique_identifier=mock%u= client_nickname=Gast client_database_id=%u client_type=0",
+			session->channelID, MOCK_GUEST_ID, MOCK_GUEST_ID, MOCK_GUEST_ID);
+	}
+	if (session->next == lineCount) {
+		sendLine(session, "notifyclientleftview cfid=%llu ctid=0 reasonid=8 reasonmsg=leaving clid=%u", session->channelID, MOCK_GUEST_ID);
+		session->replaying = 2;
+		return;
+	}
+	line = &lines[session->next++];
+	escapeValue(message, sizeof(message), line->message);
+	escapeValue(name, sizeof(name), line->fromName);
+	clientUid(uid, sizeof(uid), line->fromID);
+	if (line->fromID == MOCK_ADMIN_ID || line->targetMode == 1) {
+		sendLine(session, "notifytextmessage targetmode=1 msg=%s target=%u invokerid=%u invokername=%s invokeruid=%s", message, session->clientID, line->fromID, name, uid);
+	}
+	else {
+		sendLine(session, "notifytextmessage targetmode=%u msg=%s invokerid=%u invokername=%s invokeruid=%s", line->targetMode, message, line->fromID, name, uid);
+	}
+	session->nextAt = nowMs() + (uint64_t)delayMs;
+}
+
+static char* nextField(char** s) {
+	char* start = *s;
+	char* tab = strchr(start, '\t');
+	if (tab == NULL) {
+		return NULL;
+	}
+	*tab = '\0';
+	*s = tab + 1;
+	return start;
+}
+
+static int readTranscript(const char* path) {
+	char buf[MOCK_LINE_BUFSIZE];
+	size_t capacity = 0;
+	FILE* f = fopen(path, "r");
+	int number;
+
+	if (f == NULL) {
+		perror(path);
+		return -1;
+	}
+	for (number = 1; fgets(buf, sizeof(buf), f) != NULL; number++) {
+		struct TranscriptLine line;
+		char* rest = buf;
+		char* fromID;
+		char* targetMode;
+		int i;
+
+		buf[strcspn(buf, "\r\n")] = '\0';
+		if (buf[0] == '\0' || buf[0] == '#') {
+			continue;
+		}
+		if ((fromID = nextField(&rest)) == NULL || (targetMode = nextField(&rest)) == NULL || (line.fromName = nextField(&rest)) == NULL) {
+			fprintf(stderr, "%s:%d: malformed line\n", path, number);
+			fclose(f);
+			return -1;
+		}
+		line.fromID = (unsigned int)atoi(fromID);
+		line.targetMode = (unsigned int)atoi(targetMode);
+		line.fromName = strdup(line.fromName);
+		line.message = strdup(rest);
+		if (lineCount == capacity) {
+			capacity = capacity ? capacity * 2 : 64;
+			lines = (struct TranscriptLine*)realloc(lines, capacity * sizeof(struct TranscriptLine));
+		}
+		lines[lineCount++] = line;
+		for (i = 0; i < clientCount && clients[i].clientID != line.fromID; i++) {
+		}
+		if (i == clientCount && clientCount < MOCK_MAX_CLIENTS) {
+			clients[clientCount].clientID = line.fromID;
+			snprintf(clients[clientCount].name, MOCK_NAME_SIZE, "%s", line.fromName);
+			clientCount++;
+		}
+	}
+	fclose(f);
+	return 0;
+}
+
+static void acceptSession(int listenFd) {
+	int fd = accept(listenFd, NULL, NULL);
+	int i;
+
+	if (fd < 0) {
+		return;
+	}
+	for (i = 0; i < MOCK_MAX_SESSIONS && sessions[i].fd >= 0; i++) {
+	}
+	if (i == MOCK_MAX_SESSIONS) {
+		close(fd);
+		return;
+	}
+	memset(&sessions[i], 0, sizeof(sessions[i]));
+	sessions[i].fd = fd;
+	sessions[i].clientID = nextBotID++;
+	sessions[i].channelID = MOCK_DEFAULT_CHANNEL;
+	snprintf(sessions[i].nickname, MOCK_NAME_SIZE, "serveradmin from 127.0.0.1:%u", sessions[i].clientID);
+	sendLine(&sessions[i], "TS3");
+	sendLine(&sessions[i], "Welcome to the TeamSpeak 3 ServerQuery interface, type \"help\" for a list of commands and \"help <command>\" for information on a specific command.");
+}
+
+static void readSession(struct MockSession* session) {
+	ssize_t received = recv(session->fd, session->in + session->inLength, sizeof(session->in) - session->inLength - 1, 0);
+	size_t start = 0, i;
+
+	if (received <= 0) {
+		close(session->fd);
+		session->fd = -1;
+		return;
+	}
+	session->inLength += (size_t)received;
+	for (i = 0; i < session->inLength && session->fd >= 0; i++) {
+		if (session->in[i] == '\n') {
+			session->in[i] = '\0';
+			if (i > start && session->in[i - 1] == '\r') {
+				session->in[i - 1] = '\0';
+			}
+			if (session->in[start] != '\0') {
+				handleCommand(session, session->in + start);
+			}
+			start = i + 1;
+		}
+	}
+	if (session->fd < 0) {
+		return;
+	}
+	memmove(session->in, session->in + start, session->inLength - start);
+	session->inLength -= start;
+	if (session->inLength == sizeof(session->in) - 1) {
+		session->inLength = 0;  /* overlong command, drop it */
+	}
+}
+
+int main(int argc, char** argv) {
+	struct pollfd fds[MOCK_MAX_SESSIONS + 1];
+	struct MockSession* polled[MOCK_MAX_SESSIONS + 1];
+	struct sockaddr_in address;
+	int port = MOCK_DEFAULT_PORT, idleMs = 0, listenFd, one = 1, i;
+	const char* path = NULL;
+	uint64_t lastActivity = nowMs();
+	int everReplayed = 0;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-p") && i + 1 < argc) {
+			port = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-d") && i + 1 < argc) {
+			delayMs = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-x") && i + 1 < argc) {
+			idleMs = atoi(argv[++i]);
+		} else {
+			path = argv[i];
+		}
+	}
+	if (path == NULL) {
+		fprintf(stderr, "Usage: %s [-p port] [-d delayMs] [-x idleMs] transcript.txt\n", argv[0]);
+		return 2;
+	}
+	if (readTranscript(path) != 0) {
+		return 1;
+	}
+	signal(SIGPIPE, SIG_IGN);
+	for (i = 0; i < MOCK_MAX_SESSIONS; i++) {
+		sessions[i].fd = -1;
+	}
+
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons((uint16_t)port);
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if ((listenFd = socket(AF_INET, SOCK_STREAM, 0)) < 0 || setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0
+		|| bind(listenFd, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(listenFd, 16) < 0) {
+		perror("query_mock");
+		return 1;
+	}
+
+	for (;;) {
+		uint64_t now = nowMs();
+		int count = 1, timeout = -1, allDone = everReplayed;
+
+		fds[0].fd = listenFd;
+		fds[0].events = POLLIN;
+		for (i = 0; i < MOCK_MAX_SESSIONS; i++) {
+			struct MockSession* session = &sessions[i];
+			if (session->fd < 0) {
+				continue;
+			}
+			if (!session->replaying && session->listed && session->textChannel) {
+				session->replaying = 1;
+				session->nextAt = now;
+				everReplayed = allDone = 1;
+			}
+			while (session->replaying == 1 && session->nextAt <= now) {
+				replayStep(session);
+			}
+			if (session->replaying == 1) {
+				int wait = (int)(session->nextAt - now);
+				timeout = timeout < 0 || wait < timeout ? wait : timeout;
+				allDone = 0;
+			}
+			fds[count].fd = session->fd;
+			fds[count].events = POLLIN;
+			polled[count++] = session;
+		}
+		if (idleMs > 0 && allDone) {
+			int wait = (int)(lastActivity + (uint64_t)idleMs - now);
+			if (wait <= 0) {
+				break;
+			}
+			timeout = timeout < 0 || wait < timeout ? wait : timeout;
+		}
+
+		if (poll(fds, (nfds_t)count, timeout) < 0 && errno != EINTR) {
+			perror("poll");
+			return 1;
+		}
+		if (fds[0].revents & POLLIN) {
+			acceptSession(listenFd);
+			lastActivity = nowMs();
+		}
+		for (i = 1; i < count; i++) {
+			if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+				readSession(polled[i]);
+				lastActivity = nowMs();
+			}
+		}
+	}
+
+	close(listenFd);
+	for (i = 0; i < MOCK_MAX_SESSIONS; i++) {
+		if (sessions[i].fd >= 0) {
+			close(sessions[i].fd);
+		}
+	}
+	for (i = 0; i < (int)lineCount; i++) {
+		free(lines[i].fromName);
+		free(lines[i].message);
+	}
+	free(lines);
+	return 0;
+}
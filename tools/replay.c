@@ -0,0 +1,224 @@
+/*
+ * AllDice replay: feeds a transcript of chat messages through ts3plugin_onTextMessageEvent with a fixed
+ * random seed and writes every message the plugin sends to stdout. The same transcript and seed always
+ * produce byte-identical output, so the output can be diffed against a known good run or used as a
+ * stable workload for timing.
+ *
+ * Build (Linux): cc -O2 -pthread -I<sdk>/include -o replay tools/replay.c tools/ts3_stub.c plugin.c -lm
+ *
+ * Usage: replay [-s seed] [-i ownClientID] [-n runs] [-c channels] [-j shards] transcript.txt
+ *
+ * Transcript format, one message per line, fields separated by tabs:
+ *   fromID <TAB> targetMode <TAB> fromName <TAB> message
+ * targetMode is 1 (private), 2 (channel) or 3 (server). Empty lines and lines starting with '#' are skipped.
+ * Rolls in the fair mode ("!fair an") take their seed from the OS and are not reproducible.
+ * Plugin commands of the compact mode ("!kompakt an") are fed back as if another AllDice client had received
+ * them, what that client prints locally is written as "[lokal] ...".
+ *
+ * With -n the transcript is replayed several times (reseeded identically for each run), only the
+ * first run is written to stdout and the average wall time per message and the throughput are reported on stderr.
+ *
+ * -c plays the transcript at several tables at once: copy k runs in channel k + 1 with the client IDs shifted
+ * by k * 1000, lines of the own client are only played once (they switch the bot for every channel). -j hands
+ * the commands to that many shard threads, each channel always to the same one. Every shard has its own random
+ * stream derived from the seed, so the results per channel are reproducible, but the output of different
+ * channels interleaves. Throughput versus core count:
+ *   for j in 0 1 2 4 8; do replay -n 20 -c 64 -j $j transcript.txt > /dev/null; done
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "teamspeak/public_errors.h"
+#include "teamspeak/public_definitions.h"
+#include "ts3_functions.h"
+#include "../plugin.h"
+#include "ts3_stub.h"
+
+#define LINE_BUFSIZE 8192
+#define REPLAY_PEER_CLIENT_ID 999  /* receives the plugin commands of the compact mode ("!kompakt an") */
+#define REPLAY_CHANNEL_STRIDE 1000 /* client ID offset between two copies of the transcript (-c) */
+#define REPLAY_MAX_CHANNELS 64     /* client IDs are 16 bit */
+
+struct TranscriptLine {
+	anyID fromID;
+	anyID targetMode;
+	char* fromName;
+	char* message;
+};
+
+static int printOutput = 1;
+
+static void writeOutput(uint64 serverConnectionHandlerID, const char* message, int isPrivate, anyID targetClientID) {
+	if (!printOutput) {
+		return;
+	}
+	if (isPrivate == 2) {
+		printf("[lokal] %s\n", message);
+	}
+	else if (isPrivate) {
+		printf("[privat %u] %s\n", (unsigned int)targetClientID, message);
+	}
+	else {
+		printf("[channel] %s\n", message);
+	}
+}
+
+static double wallSeconds() {
+	struct timespec now;
+	timespec_get(&now, TIME_UTC);
+	return (double)now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/* Seats every sender of copy k in channel k + 1, the own client sits in channel 1 */
+static void seatClients(const struct TranscriptLine* lines, size_t lineCount, anyID ownClientID, int channels) {
+	static unsigned char seen[REPLAY_CHANNEL_STRIDE];
+	size_t n;
+	int c;
+
+	ts3plugin_onClientMoveEvent(1, ownClientID, 0, 1, ENTER_VISIBILITY, "");
+	for (n = 0; n < lineCount; n++) {
+		if (lines[n].fromID == ownClientID || seen[lines[n].fromID]) {
+			continue;
+		}
+		seen[lines[n].fromID] = 1;
+		for (c = 0; c < channels; c++) {
+			ts3plugin_onClientMoveEvent(1, (anyID)(lines[n].fromID + c * REPLAY_CHANNEL_STRIDE), 0, (uint64)c + 1, ENTER_VISIBILITY, "");
+		}
+	}
+}
+
+static char* nextField(char** s) {
+	char* start = *s;
+	char* tab = strchr(start, '\t');
+	if (tab == NULL) {
+		return NULL;
+	}
+	*tab = '\0';
+	*s = tab + 1;
+	return start;
+}
+
+static int parseLine(char* line, struct TranscriptLine* out) {
+	char* rest = line;
+	char* fromID;
+	char* targetMode;
+
+	line[strcspn(line, "\r\n")] = '\0';
+	if (line[0] == '\0' || line[0] == '#') {
+		return 0;
+	}
+	if ((fromID = nextField(&rest)) == NULL || (targetMode = nextField(&rest)) == NULL || (out->fromName = nextField(&rest)) == NULL) {
+		return -1;
+	}
+	out->fromID = (anyID)atoi(fromID);
+	out->targetMode = (anyID)atoi(targetMode);
+	out->message = rest;
+	return 1;
+}
+
+int main(int argc, char** argv) {
+	unsigned long long seed = 1;
+	anyID ownClientID = 1;
+	int runs = 1, channels = 1, shards = 0;
+	const char* path = NULL;
+	struct TranscriptLine* lines = NULL;
+	size_t lineCount = 0, lineCapacity = 0, messages = 0;
+	char buf[LINE_BUFSIZE];
+	FILE* f;
+	double start;
+	int i, run, c;
+	size_t n;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+			seed = strtoull(argv[++i], NULL, 10);
+		} else if (!strcmp(argv[i], "-i") && i + 1 < argc) {
+			ownClientID = (anyID)atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+			runs = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+			channels = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+			shards = atoi(argv[++i]);
+		} else {
+			path = argv[i];
+		}
+	}
+	if (path == NULL || runs < 1 || channels < 1 || channels > REPLAY_MAX_CHANNELS || shards < 0) {
+		fprintf(stderr, "Usage: %s [-s seed] [-i ownClientID] [-n runs] [-c channels] [-j shards] transcript.txt\n", argv[0]);
+		return 2;
+	}
+
+	if ((f = fopen(path, "r")) == NULL) {
+		perror(path);
+		return 1;
+	}
+	for (i = 1; fgets(buf, sizeof(buf), f) != NULL; i++) {
+		struct TranscriptLine line;
+		int result = parseLine(buf, &line);
+		if (result < 0) {
+			fprintf(stderr, "%s:%d: malformed line\n", path, i);
+			fclose(f);
+			return 1;
+		}
+		if (result == 0) {
+			continue;
+		}
+		if (channels > 1 && line.fromID >= REPLAY_CHANNEL_STRIDE) {
+			fprintf(stderr, "%s:%d: client IDs must stay below %d with -c\n", path, i, REPLAY_CHANNEL_STRIDE);
+			fclose(f);
+			return 1;
+		}
+		if (lineCount == lineCapacity) {
+			lineCapacity = lineCapacity ? lineCapacity * 2 : 64;
+			lines = (struct TranscriptLine*)realloc(lines, lineCapacity * sizeof(struct TranscriptLine));
+		}
+		line.fromName = strdup(line.fromName);
+		line.message = strdup(line.message);
+		lines[lineCount++] = line;
+	}
+	fclose(f);
+
+	ts3StubInstall(ownClientID, writeOutput);
+	ts3plugin_init();
+	setSendLimits(TS3_MAX_SIZE_TEXTMESSAGE, 1, 0);  /* ohne Drosselung, alles wird sofort ausgegeben */
+	if (channels > 1) {
+		seatClients(lines, lineCount, ownClientID, channels);
+	}
+	if (shards > 0) {
+		shards = shardPoolStart(shards);
+	}
+
+	start = wallSeconds();
+	for (run = 0; run < runs; run++) {
+		seedRandomNumberGenerator(seed);
+		shardPoolSeed(seed);
+		for (n = 0; n < lineCount; n++) {
+			for (c = 0; c < channels; c++) {
+				if (c > 0 && lines[n].fromID == ownClientID) {
+					continue;
+				}
+				ts3plugin_onTextMessageEvent(1, lines[n].targetMode, 0, (anyID)(lines[n].fromID + c * REPLAY_CHANNEL_STRIDE), lines[n].fromName, "", lines[n].message, 0);
+				messages++;
+			}
+			ts3StubDeliverPluginCommands(REPLAY_PEER_CLIENT_ID, "Mitspieler");
+		}
+		shardPoolDrain();
+		printOutput = 0;
+	}
+	if (runs > 1 && messages > 0) {
+		double seconds = wallSeconds() - start;
+		fprintf(stderr, "%d runs, %lu messages, %d shards, %.3f us/message, %.0f messages/s\n", runs, (unsigned long)(messages / runs), shards,
+			seconds * 1e6 / (double)messages, (double)messages / seconds);
+	}
+	shardPoolStop();
+
+	for (n = 0; n < lineCount; n++) {
+		free(lines[n].fromName);
+		free(lines[n].message);
+	}
+	free(lines);
+	return 0;
+}
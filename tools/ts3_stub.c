@@ -0,0 +1,174 @@
+/*
+ * Minimal TS3Functions table for running the AllDice core outside of the TeamSpeak 3 client
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "teamspeak/public_errors.h"
+#include "teamspeak/public_definitions.h"
+#include "ts3_functions.h"
+#include "../plugin.h"
+#include "ts3_stub.h"
+
+static anyID stubOwnClientID = 1;
+static ts3StubOutputFunc stubOutput = NULL;
+
+/*
+ * Plugin commands are collected and only handed back by ts3StubDeliverPluginCommands. The election heartbeat
+ * sends from its own thread, hence the mutex.
+ */
+#define STUB_PLUGIN_COMMANDS 16
+static char* stubPluginCommands[STUB_PLUGIN_COMMANDS];
+static int stubPluginCommandCount = 0;
+static pthread_mutex_t stubPluginCommandMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned int stubGetClientID(uint64 serverConnectionHandlerID, anyID* result) {
+	*result = stubOwnClientID;
+	return ERROR_ok;
+}
+
+static uint64 stubGetCurrentServerConnectionHandlerID(void) {
+	return 1;
+}
+
+static void stubRequestInfoUpdate(uint64 serverConnectionHandlerID, enum PluginItemType itemType, uint64 itemID) {
+}
+
+static unsigned int stubGetChannelOfClient(uint64 serverConnectionHandlerID, anyID clientID, uint64* result) {
+	*result = 1;
+	return ERROR_ok;
+}
+
+static unsigned int stubFreeMemory(void* pointer) {
+	free(pointer);
+	return ERROR_ok;
+}
+
+/* One connection (ID 1) on which only the own client is visible, everyone else is looked up on demand */
+static unsigned int stubGetServerConnectionHandlerList(uint64** result) {
+	*result = (uint64*)calloc(2, sizeof(uint64));
+	if (*result == NULL) {
+		return ERROR_undefined;
+	}
+	(*result)[0] = 1;
+	return ERROR_ok;
+}
+
+static unsigned int stubGetClientList(uint64 serverConnectionHandlerID, anyID** result) {
+	*result = (anyID*)calloc(2, sizeof(anyID));
+	if (*result == NULL) {
+		return ERROR_undefined;
+	}
+	(*result)[0] = stubOwnClientID;
+	return ERROR_ok;
+}
+
+/* Every client is "Client<id>" with database ID = client ID */
+static unsigned int stubGetClientVariableAsString(uint64 serverConnectionHandlerID, anyID clientID, size_t flag, char** result) {
+	char value[64];
+	if (flag == CLIENT_UNIQUE_IDENTIFIER) {
+		snprintf(value, sizeof(value), "stub%05u=", (unsigned int)clientID);
+	} else if (flag == CLIENT_NICKNAME) {
+		snprintf(value, sizeof(value), "Client%u", (unsigned int)clientID);
+	} else {
+		return ERROR_undefined;
+	}
+	*result = strdup(value);
+	return *result != NULL ? ERROR_ok : ERROR_undefined;
+}
+
+static unsigned int stubGetClientVariableAsUInt64(uint64 serverConnectionHandlerID, anyID clientID, size_t flag, uint64* result) {
+	*result = clientID;
+	return ERROR_ok;
+}
+
+static unsigned int stubRequestSendChannelTextMsg(uint64 serverConnectionHandlerID, const char* message, uint64 targetChannelID, const char* returnCode) {
+	if (stubOutput) {
+		stubOutput(serverConnectionHandlerID, message, 0, 0);
+	}
+	return ERROR_ok;
+}
+
+static unsigned int stubRequestSendPrivateTextMsg(uint64 serverConnectionHandlerID, const char* message, anyID targetClientID, const char* returnCode) {
+	if (stubOutput) {
+		stubOutput(serverConnectionHandlerID, message, 1, targetClientID);
+	}
+	return ERROR_ok;
+}
+
+static void stubSendPluginCommand(uint64 serverConnectionHandlerID, const char* pluginID, const char* command, int targetMode, const anyID* targetIDs, const char* returnCode) {
+	pthread_mutex_lock(&stubPluginCommandMutex);
+	if (stubPluginCommandCount < STUB_PLUGIN_COMMANDS) {
+		stubPluginCommands[stubPluginCommandCount++] = strdup(command);
+	}
+	pthread_mutex_unlock(&stubPluginCommandMutex);
+}
+
+static void stubPrintMessage(uint64 serverConnectionHandlerID, const char* message, enum PluginMessageTarget messageTarget) {
+	if (stubOutput) {
+		stubOutput(serverConnectionHandlerID, message, 2, 0);
+	}
+}
+
+static unsigned int stubLogMessage(const char* logMessage, enum LogLevel severity, const char* channel, uint64 logID) {
+	return ERROR_ok;
+}
+
+static void stubPrintMessageToCurrentTab(const char* message) {
+}
+
+static void stubGetPath(char* path, size_t maxLen) {
+	if (maxLen > 0) {
+		path[0] = '\0';
+	}
+}
+
+static void stubGetPluginPath(char* path, size_t maxLen, const char* pluginID) {
+	stubGetPath(path, maxLen);
+}
+
+void ts3StubInstall(anyID ownClientID, ts3StubOutputFunc output) {
+	struct TS3Functions funcs;
+
+	memset(&funcs, 0, sizeof(funcs));
+	funcs.getClientID = stubGetClientID;
+	funcs.getChannelOfClient = stubGetChannelOfClient;
+	funcs.getCurrentServerConnectionHandlerID = stubGetCurrentServerConnectionHandlerID;
+	funcs.requestInfoUpdate = stubRequestInfoUpdate;
+	funcs.getServerConnectionHandlerList = stubGetServerConnectionHandlerList;
+	funcs.getClientList = stubGetClientList;
+	funcs.getClientVariableAsString = stubGetClientVariableAsString;
+	funcs.getClientVariableAsUInt64 = stubGetClientVariableAsUInt64;
+	funcs.freeMemory = stubFreeMemory;
+	funcs.requestSendChannelTextMsg = stubRequestSendChannelTextMsg;
+	funcs.requestSendPrivateTextMsg = stubRequestSendPrivateTextMsg;
+	funcs.sendPluginCommand = stubSendPluginCommand;
+	funcs.printMessage = stubPrintMessage;
+	funcs.logMessage = stubLogMessage;
+	funcs.printMessageToCurrentTab = stubPrintMessageToCurrentTab;
+	funcs.getAppPath = stubGetPath;
+	funcs.getResourcesPath = stubGetPath;
+	funcs.getConfigPath = stubGetPath;
+	funcs.getPluginPath = stubGetPluginPath;
+
+	stubOwnClientID = ownClientID;
+	stubOutput = output;
+	ts3plugin_setFunctionPointers(funcs);
+}
+
+void ts3StubDeliverPluginCommands(anyID fromID, const char* fromName) {
+	char* commands[STUB_PLUGIN_COMMANDS];
+	int count, i;
+
+	pthread_mutex_lock(&stubPluginCommandMutex);
+	count = stubPluginCommandCount;
+	memcpy(commands, stubPluginCommands, count * sizeof(char*));
+	stubPluginCommandCount = 0;
+	pthread_mutex_unlock(&stubPluginCommandMutex);
+	for (i = 0; i < count; i++) {
+		ts3plugin_onPluginCommandEvent(1, "AllDice", commands[i], fromID, fromName, "");
+		free(commands[i]);
+	}
+}
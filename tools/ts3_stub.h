@@ -0,0 +1,25 @@
+/*
+ * Minimal TS3Functions table for running the AllDice core outside of the TeamSpeak 3 client
+ */
+
+#ifndef TS3_STUB_H
+#define TS3_STUB_H
+
+#include "teamspeak/public_definitions.h"
+
+/*
+ * Called for every text message the plugin sends. isPrivate is 0 for channel, 1 for private messages (then
+ * targetClientID is set) and 2 for messages the plugin only prints locally (printMessage).
+ */
+typedef void (*ts3StubOutputFunc)(uint64 serverConnectionHandlerID, const char* message, int isPrivate, anyID targetClientID);
+
+/* Installs the stub table via ts3plugin_setFunctionPointers. output may be NULL to drop all messages. */
+void ts3StubInstall(anyID ownClientID, ts3StubOutputFunc output);
+
+/*
+ * Feeds the plugin commands sent since the last call back into ts3plugin_onPluginCommandEvent as if fromID had
+ * sent them, like another AllDice client in the same channel would see them.
+ */
+void ts3StubDeliverPluginCommands(anyID fromID, const char* fromName);
+
+#endif